@@ -2,15 +2,21 @@
 #define DAWNSEEKER_LOGGER_H
 
 #include "global.h"
+#include <algorithm>
+#include <atomic>
 #include <chrono> 
 #include <compare>
+#include <condition_variable>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <source_location>
 #include <string>
 #include <syncstream>
+#include <thread>
 #include <vector>
+#include "utils/perthread.h"
 
 namespace logger {
     enum class LogLevel { Debug, Info, Warning, Error, Critical };
@@ -99,6 +105,117 @@ namespace logger {
         }
     };
 
+    /*!
+     * @brief Background writer of log lines, so that logging threads never wait for I/O.
+     *
+     * Each thread appends its lines to its own buffer (registered on its first use),
+     * whose mutex is contended only by the writer thread.
+     * The writer wakes up periodically, collects all the buffers and writes the lines in the order of logging.
+     *
+     * Lines still pending are written when flush() is called, or when the program exits.
+     */
+    class AsyncWriter {
+    public:
+        // How often the background writer wakes up
+        static constexpr auto flushInterval = std::chrono::milliseconds(50);
+
+        /*!
+         * @brief Gets the process-wide writer.
+         */
+        static AsyncWriter& global() {
+            static auto writer = AsyncWriter{};
+            return writer;
+        }
+
+        AsyncWriter() = default;
+        AsyncWriter(const AsyncWriter&) = delete;
+
+        ~AsyncWriter() {
+            {
+                auto lock = std::scoped_lock(mtx);
+                stopping = true;
+            }
+            cond.notify_one();
+            if (writer.joinable()) {
+                writer.join();
+            }
+            flush();
+        }
+
+        /*!
+         * @brief Appends a line (with the trailing new-line character) to the buffer of the calling thread.
+         */
+        void append(std::ostream& out, std::string line) {
+            auto& buffer = local();
+            auto seq = nextSeq.fetch_add(1, std::memory_order_relaxed);
+            auto lock = std::scoped_lock(buffer.mtx);
+            buffer.lines.push_back({seq, &out, std::move(line)});
+        }
+
+        /*!
+         * @brief Writes all the pending lines synchronously.
+         */
+        void flush() {
+            auto pending = std::vector<Line>{};
+            auto writeLock = std::scoped_lock(writeMutex);
+            buffers.forEach([&](ThreadBuffer& buffer) {
+                auto bufferLock = std::scoped_lock(buffer.mtx);
+                std::move(buffer.lines.begin(), buffer.lines.end(), std::back_inserter(pending));
+                buffer.lines.clear();
+            });
+            std::ranges::sort(pending, std::less<>{}, &Line::seq);
+            auto lastOut = static_cast<std::ostream*>(nullptr);
+            for (const auto& line: pending) {
+                if (lastOut != nullptr && lastOut != line.out) {
+                    lastOut->flush();
+                }
+                *(lastOut = line.out) << line.content;
+            }
+            if (lastOut != nullptr) {
+                lastOut->flush();
+            }
+        }
+
+    private:
+        struct Line {
+            std::uint64_t   seq;
+            std::ostream*   out;
+            std::string     content;
+        };
+
+        struct ThreadBuffer {
+            std::mutex          mtx;
+            std::vector<Line>   lines;
+        };
+
+        ThreadBuffer& local() {
+            return buffers.local([this](ThreadBuffer&) {
+                auto lock = std::scoped_lock(mtx);
+                if (!writer.joinable()) {
+                    writer = std::thread([this]() { writerLoop(); });
+                }
+            });
+        }
+
+        void writerLoop() {
+            for (auto lock = std::unique_lock(mtx); !stopping; ) {
+                cond.wait_for(lock, flushInterval, [this]() { return stopping; });
+                lock.unlock();
+                flush();
+                lock.lock();
+            }
+        }
+
+        std::mutex                  mtx;
+        // Serializes the writers, i.e. the background thread and explicit flush() calls
+        std::mutex                  writeMutex;
+        std::condition_variable     cond;
+        utils::PerThreadBlocks<ThreadBuffer>    buffers;
+        std::atomic<std::uint64_t>  nextSeq = 0;
+        std::thread                 writer;
+        bool                        stopping = false;
+    };
+
     class Logger {
     public:
         static inline LogHeadFormatter defaultFormatter = LogHeadFormatter{
@@ -118,6 +235,8 @@ namespace logger {
         // Minimum log level
         // Message lower than this level is ignored
         LogLevel		    minLevel;
+        // Whether lines are written by the background writer (see AsyncWriter)
+        bool                async = false;
 
     public:
         Logger(std::string id,
@@ -128,8 +247,18 @@ namespace logger {
                 formatter(formatter), formatterString(formatter.transform()),
                 minLevel(minLevel) {}
 
-        void setMinLevel(LogLevel level) {
-            minLevel = level;
+        void setMinLevel(LogLevel level);
+
+        [[nodiscard]] LogLevel getMinLevel() const {
+            return minLevel;
+        }
+
+        // Messages of Warning level or higher are still written synchronously, after all the pending ones
+        void setAsync(bool value) {
+            async = value;
+            if (!async) {
+                AsyncWriter::global().flush();
+            }
         }
 
         void setFormatter(LogHeadFormatter headFormatter) {
@@ -144,27 +273,33 @@ namespace logger {
                 return;
             }
             // C-style formatter is still required for fmt::v7
-            static char buffer[256];
+            char buffer[64];
             auto timeValue = ch::system_clock::to_time_t(now());
-#ifdef _WIN32
             std::tm tm{};
+#ifdef _WIN32
             localtime_s(&tm, &timeValue);
-            std::strftime(buffer, sizeof(buffer), formatter.time.c_str(), &tm);
 #else
-            std::strftime(
-                buffer, sizeof(buffer), formatter.time.c_str(), std::localtime(&timeValue)
-            );
+            localtime_r(&timeValue, &tm);
 #endif
+            std::strftime(buffer, sizeof(buffer), formatter.time.c_str(), &tm);
             // Use std::filesystem::path as the intermediate
             //  so that file name displayed does not contain the full path
             auto path = fs::path(loc.file_name());
-            std::osyncstream(out)
-                    << FORMAT_NAMESPACE::vformat(
-                            formatterString, FORMAT_NAMESPACE::make_format_args(
-                                    buffer, toString(level), _id,
-                                    path.filename().string(), loc.line(),
-                                    loc.function_name()))
-                    << content << std::endl;
+            auto line = FORMAT_NAMESPACE::vformat(
+                    formatterString, FORMAT_NAMESPACE::make_format_args(
+                            buffer, toString(level), _id,
+                            path.filename().string(), loc.line(),
+                            loc.function_name()));
+            line += content;
+            line += '\n';
+            if (async) {
+                AsyncWriter::global().append(out, std::move(line));
+                if (level >= LogLevel::Warning) {
+                    AsyncWriter::global().flush();
+                }
+            } else {
+                std::osyncstream(out) << line << std::flush;
+            }
         }
 
 #define FUNC(fnName, level) \
@@ -196,6 +331,8 @@ namespace logger {
 
     class Loggers {
         static inline std::vector<std::shared_ptr<Logger>> loggers;
+        // Minimum level accepted by any of the loggers, one more than Critical if there's no logger
+        static inline std::atomic<int> minLevel = static_cast<int>(LogLevel::Critical) + 1;
 
         static auto findLogger(const std::string& id) {
             auto it = loggers.begin();
@@ -208,6 +345,21 @@ namespace logger {
         }
 
     public:
+        // Whether any of the loggers accepts the level.
+        // Checked by the LOG_* macros before the message is built.
+        static bool enabled(LogLevel level) {
+            return static_cast<int>(level) >= minLevel.load(std::memory_order_relaxed);
+        }
+
+        // Updates the minimum level after the loggers or their levels change
+        static void refreshMinLevel() {
+            auto res = static_cast<int>(LogLevel::Critical) + 1;
+            for (const auto& logger: loggers) {
+                res = std::min(res, static_cast<int>(logger->getMinLevel()));
+            }
+            minLevel.store(res, std::memory_order_relaxed);
+        }
+
         // Adds a logger via a shared_ptr
         // Fails if another logger with the same _id is already added
         // Returns: whether the logger is added successfully
@@ -217,6 +369,7 @@ namespace logger {
                 return false;
             }
             loggers.push_back(std::move(logger));
+            refreshMinLevel();
             return true;
         }
 
@@ -229,6 +382,7 @@ namespace logger {
                 return false;
             }
             loggers.erase(it);
+            refreshMinLevel();
             return true;
         }
 
@@ -271,34 +425,48 @@ namespace logger {
         FUNC(critical, Critical)
 #undef FUNC
     };
+
+    inline void Logger::setMinLevel(LogLevel level) {
+        minLevel = level;
+        Loggers::refreshMinLevel();
+    }
 }
 
+// Log macros evaluate their arguments (e.g. format(...)) only if any logger accepts the level.
+// Levels lower than LOG_LEVEL (0 = Debug, ..., 3 = Error) are stripped at compile time,
+// whose arguments are never evaluated.
+
 #if !defined(LOG_LEVEL) || LOG_LEVEL <= 0
 #define LOG_DEBUG_ENABLED
-#define LOG_DEBUG(...) logger::Loggers::debug(__VA_ARGS__)
+#define LOG_DEBUG(...) \
+    (logger::Loggers::enabled(logger::LogLevel::Debug) ? logger::Loggers::debug(__VA_ARGS__) : (void)0)
 #else
 #define LOG_DEBUG(...) (void)0
 #endif
 
 #if !defined(LOG_LEVEL) || LOG_LEVEL <= 1
 #define LOG_INFO_ENABLED
-#define LOG_INFO(...) logger::Loggers::info(__VA_ARGS__)
+#define LOG_INFO(...) \
+    (logger::Loggers::enabled(logger::LogLevel::Info) ? logger::Loggers::info(__VA_ARGS__) : (void)0)
 #else
 #define LOG_INFO(...) (void)0
 #endif
 
 #if !defined(LOG_LEVEL) || LOG_LEVEL <= 2
 #define LOG_WARNING_ENABLED
-#define LOG_WARNING(...) logger::Loggers::warning(__VA_ARGS__)
+#define LOG_WARNING(...) \
+    (logger::Loggers::enabled(logger::LogLevel::Warning) ? logger::Loggers::warning(__VA_ARGS__) : (void)0)
 #else
 #define LOG_WARNING(...) (void)0
 #endif
 
 #if !defined(LOG_LEVEL) || LOG_LEVEL <= 3
 #define LOG_ERROR_ENABLED
-#define LOG_ERROR(...) logger::Loggers::error(__VA_ARGS__)
+#define LOG_ERROR(...) \
+    (logger::Loggers::enabled(logger::LogLevel::Error) ? logger::Loggers::error(__VA_ARGS__) : (void)0)
 #define LOG_CRITICAL_ENABLED
-#define LOG_CRITICAL(...) logger::Loggers::critical(__VA_ARGS__)
+#define LOG_CRITICAL(...) \
+    (logger::Loggers::enabled(logger::LogLevel::Critical) ? logger::Loggers::critical(__VA_ARGS__) : (void)0)
 #else
 #define LOG_ERROR(...) (void)0
 #define LOG_CRITICAL(...) (void)0
@@ -1,5 +1,6 @@
 #include "global.h"
 #include "Logger.h"
+#include "perf.h"
 #include "PRRGraph.h"
 #include <cassert>
 #include <queue>
@@ -52,7 +53,10 @@ int getLimitDist(
 *   Sets the state of all the visited nodes to either Ca or Cr
 *   Note that some nodes may not be visited, whose states are left as None
 */
-void simulateNoBoost(PRRGraph& prrGraph, IMMLinkStateSamples& linkStates, const SeedSet& seeds)
+void simulateNoBoost(PRRGraph&               prrGraph,
+                     IMMLinkStateSamples&    linkStates,
+                     const SeedSet&          seeds,
+                     const NodeStateContext& stateCtx)
 {
     // Initialize distance to infinity, and state to None
     for (auto& node : prrGraph.nodes()) {
@@ -73,7 +77,7 @@ void simulateNoBoost(PRRGraph& prrGraph, IMMLinkStateSamples& linkStates, const
     };
     // Initializes the queue with higher priority seeds first,
     //  lower priority seeds then.
-    if ((NodeState::Ca <=> NodeState::Cr) == std::strong_ordering::greater) {
+    if (stateCtx.compare(NodeState::Ca, NodeState::Cr) > 0) {
         initSeeds(seeds.Sa(), NodeState::Ca);
         initSeeds(seeds.Sr(), NodeState::Cr);
     }
@@ -114,8 +118,10 @@ void samplePRRSketch(
         IMMLinkStateSamples&    linkStates,
         PRRGraph&               prrGraph,
         const SeedSet&          seeds,
+        const NodeStateContext& stateCtx,
         std::size_t             center)
 {
+    auto kernel = perf::ScopedKernel(perf::Kernel::SketchBuild);
     // First resets all the link states
     linkStates.initOrRefresh(graph.nLinks());
     // Clears the old graph
@@ -152,20 +158,22 @@ void samplePRRSketch(
         }
     }
     // Step 3: forward simulation
-    simulateNoBoost(prrGraph, linkStates, seeds);
+    simulateNoBoost(prrGraph, linkStates, seeds, stateCtx);
 }
 
 void samplePRRSketch(
         const IMMGraph&         graph,
         PRRGraph&               prrGraph,
         const SeedSet&          seeds,
+        const NodeStateContext& stateCtx,
         std::size_t             center)
 {
     auto linkStates = IMMLinkStateSamples(graph.nLinks());
-    samplePRRSketch(graph, linkStates, prrGraph, seeds, center);
+    samplePRRSketch(graph, linkStates, prrGraph, seeds, stateCtx, center);
 }
 
-PRRGraph samplePRRSketch(const IMMGraph& graph, const SeedSet& seeds, std::size_t center)
+PRRGraph samplePRRSketch(const IMMGraph& graph, const SeedSet& seeds, const NodeStateContext& stateCtx,
+                         std::size_t center)
 {
     // Creates an empty graph
     auto prrGraph = PRRGraph({
@@ -173,7 +181,7 @@ PRRGraph samplePRRSketch(const IMMGraph& graph, const SeedSet& seeds, std::size_
         {"links", graph.nLinks()},
         {"nodes", graph.nNodes()}
     });
-    samplePRRSketch(graph, prrGraph, seeds, center);
+    samplePRRSketch(graph, prrGraph, seeds, stateCtx, center);
     return prrGraph;
 }
 
@@ -217,9 +225,10 @@ void calculateCenterStateToFastR(PRRGraph& prrGraph)
 }
 
 /*
-* Step 4
+* Step 4, with the node state priority fixed at compile time
 */
-void calculateCenterStateToFast(PRRGraph& prrGraph)
+template <class Priority>
+void _calculateCenterStateToFast(Priority, PRRGraph& prrGraph)
 {
     graph::NodeOrIndex auto& centerNode = prrGraph.centerNode();
     // Resets v.centerStateTo = G.centerState for each v
@@ -241,7 +250,7 @@ void calculateCenterStateToFast(PRRGraph& prrGraph)
         calculateCenterStateToFastR(prrGraph);
     }
 
-    bool crHigher = (NodeState::Cr <=> NodeState::CaPlus) == std::strong_ordering::greater;
+    constexpr bool crHigher = Priority::higher(NodeState::Cr, NodeState::CaPlus);
 
     // Initializes all the maxDistP (including center node) as inf
     for (auto& node : prrGraph.nodes()) {
@@ -293,7 +302,16 @@ void calculateCenterStateToFast(PRRGraph& prrGraph)
     }
 }
 
-NodeState _calculateCenterStateToSlow(PRRGraph& prrGraph, std::size_t maxIndex, std::size_t v) {
+void calculateCenterStateToFast(PRRGraph& prrGraph, const NodeStateContext& stateCtx)
+{
+    auto kernel = perf::ScopedKernel(perf::Kernel::GainComputation);
+    stateCtx.visitPriority([&](auto priority) {
+        _calculateCenterStateToFast(priority, prrGraph);
+    });
+}
+
+template <class Priority>
+NodeState _calculateCenterStateToSlow(Priority, PRRGraph& prrGraph, std::size_t maxIndex, std::size_t v) {
     graph::NodeOrIndex auto& vNode = prrGraph[v];
     auto& centerNode = prrGraph.centerNode();
 
@@ -327,7 +345,7 @@ NodeState _calculateCenterStateToSlow(PRRGraph& prrGraph, std::size_t maxIndex,
             //  (2) cur.dist + 1 == e.to.dist,
             //      but message with higher priority replaces the old one
             if (nextDist < to.dist ||
-                nextDist == to.dist && compare(cur.state, to.state) > 0) {
+                nextDist == to.dist && Priority::higher(cur.state, to.state)) {
                 // Replace the target's state to the current one
                 //  that arrives earlier due to boosting, or has higher priority
                 to.dist = nextDist; 
@@ -346,8 +364,9 @@ NodeState _calculateCenterStateToSlow(PRRGraph& prrGraph, std::size_t maxIndex,
     return centerNode.state;
 }
 
-void calculateCenterStateToSlow(PRRGraph& prrGraph)
+void calculateCenterStateToSlow(PRRGraph& prrGraph, const NodeStateContext& stateCtx)
 {
+    auto kernel = perf::ScopedKernel(perf::Kernel::GainComputation);
     auto maxIndex = rs::max(prrGraph.nodes() | vs::transform(&PRRNode::index));
     auto oldStates = std::vector<NodeState>(maxIndex + 1);
     auto oldDists = std::vector<int>(maxIndex + 1);
@@ -365,14 +384,86 @@ void calculateCenterStateToSlow(PRRGraph& prrGraph)
         }
     };
 
+    stateCtx.visitPriority([&](auto priority) {
+        for (auto& node : prrGraph.nodes()) {
+            // If current node can not receive any message, simply sets its centerStateTo = G.centerState
+            if (node.state == NodeState::None) {
+                node.centerStateTo = prrGraph.centerNode().state;
+                continue;
+            }
+            // Consider each node separately
+            node.centerStateTo = _calculateCenterStateToSlow(priority, prrGraph, maxIndex, node.index());
+            restore();
+        }
+    });
+}
+
+template <class Priority>
+NodeState _calculateCenterStateBoosted(Priority,
+                                       PRRGraph&                       prrGraph,
+                                       const SeedSet&                  seeds,
+                                       const std::vector<std::size_t>& boostedRank,
+                                       std::size_t                     k)
+{
+    // Initialize distance to infinity, and state to None
     for (auto& node : prrGraph.nodes()) {
-        // If current node can not receive any message, simply sets its centerStateTo = G.centerState
-        if (node.state == NodeState::None) {
-            node.centerStateTo = prrGraph.centerNode().state;
-            continue; 
+        node.state = NodeState::None;
+        node.dist = halfMax<int>;
+    }
+
+    auto Q = std::queue<PRRNode*>();
+    auto initSeeds = [&](const auto& seeds, NodeState state) {
+        for (auto a : seeds) {
+            if (auto node = prrGraph.node(a); node != nullptr) {
+                node->dist = 0;
+                node->state = state;
+                Q.emplace(node);
+            }
+        }
+    };
+    initSeeds(seeds.Sa(), NodeState::Ca);
+    initSeeds(seeds.Sr(), NodeState::Cr);
+
+    for (; !Q.empty(); Q.pop()) {
+        auto& cur = *Q.front();
+        // Boosted nodes make positive message boosted and negative message neutralized
+        if (boostedRank[cur.index()] < k) {
+            if (cur.state == NodeState::Ca) {
+                cur.state = NodeState::CaPlus;
+            } else if (cur.state == NodeState::Cr) {
+                cur.state = NodeState::CrMinus;
+            }
+        }
+        for (auto [to, e] : prrGraph.fastLinksFrom(cur)) {
+            // For Ca+ message, either boosted or active is OK. For others, only active.
+            if (cur.state != NodeState::CaPlus && e.state != LinkState::Active) {
+                continue;
+            }
+            if (cur.dist + 1 < to.dist) {
+                // If never visited before, adds it to queue
+                if (to.dist == halfMax<int>) {
+                    Q.emplace(&to);
+                }
+                to.dist = cur.dist + 1;
+                to.state = cur.state;
+            }
+            // Some other message has arrived in the same round, but current one has higher priority
+            else if (cur.dist + 1 == to.dist && Priority::higher(cur.state, to.state)) {
+                to.state = cur.state;
+            }
         }
-        // Consider each node separately
-        node.centerStateTo = _calculateCenterStateToSlow(prrGraph, maxIndex, node.index());
-        restore();
     }
-}
\ No newline at end of file
+    return prrGraph.centerNode().state;
+}
+
+NodeState calculateCenterStateBoosted(PRRGraph&                       prrGraph,
+                                      const SeedSet&                  seeds,
+                                      const NodeStateContext&         stateCtx,
+                                      const std::vector<std::size_t>& boostedRank,
+                                      std::size_t                     k)
+{
+    auto kernel = perf::ScopedKernel(perf::Kernel::Simulation);
+    return stateCtx.visitPriority([&](auto priority) {
+        return _calculateCenterStateBoosted(priority, prrGraph, seeds, boostedRank, k);
+    });
+}
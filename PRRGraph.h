@@ -16,32 +16,40 @@
  *
  * @param graph The whole graph
  * @param seeds The seed set
+ * @param stateCtx The node state priority and gain
  * @param center The center node of current PRR-sketch
  * @return The PRR-sketch object.
  */
-PRRGraph samplePRRSketch(const IMMGraph& graph, const SeedSet& seeds, std::size_t center);
+PRRGraph samplePRRSketch(const IMMGraph& graph, const SeedSet& seeds, const NodeStateContext& stateCtx,
+                         std::size_t center);
 
 /*!
  * @brief Creates a sample of PRR-sketch on the given object, with given seed set and center as initial node.
  *
  * The result will be written to prrGraph object, with old contents cleared.
  * The destination prrGraph object must be preserved before calling, with the following arguments:
- *   - "nodes" = |V|
- *   - "links" = |E|
  *   - "maxIndex" = |V|
+ *   - "nodes" and "links" (optional): initial sizes, which grow as needed.
+ *     Reusing the object for multiple samples, its buffers grow to the largest sketch
+ *     so that it's not necessary to reserve for the worst case |V| and |E|.
  *
  * WARNING on multithreading cases: different prrGraph objects for different threads.
  * The result will be incorrect or the program may crash
  * if multiple threads attempt to write to the same PRR-sketch object.
  *
- * See samplePRRSketch(graph, seeds, center) for details.
+ * See samplePRRSketch(graph, seeds, stateCtx, center) for details.
  *
  * @param graph The whole graph
  * @param prrGraph The destination PRR-sketch object
  * @param seeds The seed set
+ * @param stateCtx The node state priority and gain
  * @param center The center node of current PRR-sketch
  */
-void samplePRRSketch(const IMMGraph& graph, PRRGraph& prrGraph, const SeedSet& seeds, std::size_t center);
+void samplePRRSketch(const IMMGraph&         graph,
+                     PRRGraph&               prrGraph,
+                     const SeedSet&          seeds,
+                     const NodeStateContext& stateCtx,
+                     std::size_t             center);
 
 /*!
  * @brief Creates a sample of PRR-sketch on the given object, with given seed set, center and link state object.
@@ -53,19 +61,21 @@ void samplePRRSketch(const IMMGraph& graph, PRRGraph& prrGraph, const SeedSet& s
  * The result will be incorrect or the program may crash
  * if multiple threads attempt to write to the same linkStates object.
  *
- * See samplePRRSketch(graph, prrGraph, seeds, center) for details.
+ * See samplePRRSketch(graph, prrGraph, seeds, stateCtx, center) for details.
  *
  * @param graph The whole graph
  * @param prrGraph The destination PRR-sketch object
  * @param linkStates The already-initialized link states object
  * @param seeds The seed set
+ * @param stateCtx The node state priority and gain
  * @param center The center node of current PRR-sketch
  */
-void samplePRRSketch(const IMMGraph&        graph,
-                     IMMLinkStateSamples&   linkStates,
-                     PRRGraph&              prrGraph,
-                     const SeedSet&         seeds,
-                     std::size_t            center);
+void samplePRRSketch(const IMMGraph&         graph,
+                     IMMLinkStateSamples&    linkStates,
+                     PRRGraph&               prrGraph,
+                     const SeedSet&          seeds,
+                     const NodeStateContext& stateCtx,
+                     std::size_t             center);
 
 /*!
  * @brief Calculates gain(v; prrGraph) for each v in prrGraph. FOR MONOTONE & SUB-MODULAR CASES ONLY.
@@ -89,8 +99,9 @@ void samplePRRSketch(const IMMGraph&        graph,
  * if multiple threads attempt to write to the same PRR-sketch object.
  *
  * @param prrGraph The PRR-sketch object.
+ * @param stateCtx The node state priority and gain
  */
-void calculateCenterStateToFast(PRRGraph& prrGraph);
+void calculateCenterStateToFast(PRRGraph& prrGraph, const NodeStateContext& stateCtx);
 
 /*!
  * @brief Calculates gain(v; prrGraph) for each v in prrGraph.
@@ -107,7 +118,36 @@ void calculateCenterStateToFast(PRRGraph& prrGraph);
  * if multiple threads attempt to write to the same PRR-sketch object.
  *
  * @param prrGraph The PRR-sketch object
+ * @param stateCtx The node state priority and gain
  */
-void calculateCenterStateToSlow(PRRGraph& prrGraph);
+void calculateCenterStateToSlow(PRRGraph& prrGraph, const NodeStateContext& stateCtx);
+
+/*!
+ * @brief Calculates the state of the center node with a given boosted node set.
+ *
+ * Forward simulation is performed inside the PRR-sketch from the seeds in it,
+ * with the same rules as the forward simulation on the whole graph.
+ * Since all the paths that may affect the center node lie in the PRR-sketch,
+ * the result equals the state of the center node in the world where the PRR-sketch is sampled.
+ *
+ * The boosted node set is given by ranks: node v is boosted iff boostedRank[v] < k,
+ * thus the prefixes of the same boosted node list are evaluated without rebuilding the set.
+ *
+ * Time complexity: O(V_r + E_r) where V_r, E_r = number of nodes and links in the PRR-sketch
+ *
+ * WARNING: dist and state of each node in the PRR-sketch are overwritten.
+ *
+ * @param prrGraph The PRR-sketch object
+ * @param seeds The seed set
+ * @param stateCtx The node state priority and gain
+ * @param boostedRank boostedRank[v] = position of v in the boosted node list, or +inf if not in it
+ * @param k The first k nodes in the list are boosted
+ * @return The state of the center node with the boosted nodes.
+ */
+NodeState calculateCenterStateBoosted(PRRGraph&                       prrGraph,
+                                      const SeedSet&                  seeds,
+                                      const NodeStateContext&         stateCtx,
+                                      const std::vector<std::size_t>& boostedRank,
+                                      std::size_t                     k);
 
 #endif 
\ No newline at end of file
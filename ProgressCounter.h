@@ -6,39 +6,111 @@
 #define DAWNSEEKER_PROGRESSCOUNTER_H
 
 #include <algorithm>
-#include <Logger.h>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include "Logger.h"
 #include "utils/Timer.h"
 
+/*!
+ * @brief Thread-safe progress counter, logging the progress every logPerPercentage percent
+ * with throughput and the estimated time remaining.
+ *
+ * increment() takes one relaxed atomic addition and one relaxed load on the fast path.
+ * Only the threads whose increments cross a logging threshold take the lock,
+ * and each of them logs unless its count has been covered by the log of another one meanwhile.
+ * Thus the last threshold (i.e. 100%) is always logged.
+ * Callers in very hot loops may increment in batches to reduce cache line traffic further.
+ *
+ * Time is measured with a monotonic clock.
+ * The estimated time remaining is based on the exponential moving average of the rate between two logs,
+ * thus it adapts to the change of speed, e.g. sketches getting larger as sampling goes.
+ */
 class ProgressCounter {
-    std::string     name;
-
-    std::uint64_t   finished;
-    std::uint64_t   total;
-
-    double          logPerPercentage;
-    utils::Timer    timer;
-
 public:
+    // Weight of the latest interval in the moving average of rates
+    static constexpr double movingAverageWeight = 0.3;
+
     explicit ProgressCounter(std::uint64_t total, double logPerPercentage = 5.0):
-    finished(0), total(total), logPerPercentage(logPerPercentage) {}
+    ProgressCounter("", total, logPerPercentage) {}
 
     ProgressCounter(std::string name, std::uint64_t total, double logPerPercentage = 5.0):
-    name(std::move(name)), finished(0), total(total), logPerPercentage(logPerPercentage) {}
+    name(std::move(name)), total(total), logPerPercentage(logPerPercentage) {
+        nextLogAt = thresholdAfter(0);
+    }
 
+    ProgressCounter(const ProgressCounter&) = delete;
+
+    /*!
+     * @brief Adds n finished items. Safe to be called from any thread.
+     * @return Whether the progress is logged by this call.
+     */
     bool increment(std::uint64_t n = 1) {
-        auto before = finished;
-        finished = std::min(finished + n, total);
+        auto after = finished.fetch_add(n, std::memory_order_relaxed) + n;
+        if (after < nextLogAt.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        return report(after);
+    }
 
-        auto r0 = 100.0 * (double)before   / (double)total;
-        auto r1 = 100.0 * (double)finished / (double)total;
-        auto triggered = std::floor(r0 / logPerPercentage) != std::floor(r1 / logPerPercentage);
+    /*!
+     * @brief Number of finished items so far.
+     */
+    [[nodiscard]] std::uint64_t count() const {
+        return std::min(finished.load(std::memory_order_relaxed), total);
+    }
 
-        if (triggered) {
-            LOG_INFO(format("{}{:.1f}% finished. Time elapsed = {:.3f} sec.",
-                            name.empty() ? "" : name + ": ", r1 + 1e-6, timer.elapsed().count()));
+private:
+    // The smallest count whose percentage lies in the next logging interval after count k
+    [[nodiscard]] std::uint64_t thresholdAfter(std::uint64_t k) const {
+        if (total == 0 || k >= total) {
+            return std::numeric_limits<std::uint64_t>::max();
         }
-        return triggered;
+        auto step = std::floor(100.0 * (double)k / (double)total / logPerPercentage) + 1.0;
+        auto res = (std::uint64_t)std::ceil(step * logPerPercentage / 100.0 * (double)total);
+        return std::clamp<std::uint64_t>(res, k + 1, total);
     }
+
+    bool report(std::uint64_t after) {
+        // Waits for the thread logging currently, whose count may be older than this one.
+        // Logging is asynchronous (see logger::AsyncWriter), thus the lock is held only briefly.
+        auto lock = std::scoped_lock(mtx);
+        if (after < nextLogAt.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        after = std::min(after, total);
+        nextLogAt.store(thresholdAfter(after), std::memory_order_relaxed);
+
+        auto t = timer.elapsed().count();
+        auto rate = t > 0.0 ? (double)after / t : 0.0;
+        auto intervalRate = t > lastTime ? (double)(after - lastCount) / (t - lastTime) : rate;
+        movingRate = lastCount == 0 ? intervalRate
+                                    : movingAverageWeight * intervalRate + (1.0 - movingAverageWeight) * movingRate;
+        lastTime = t;
+        lastCount = after;
+
+        auto eta = movingRate > 0.0 ? (double)(total - after) / movingRate : 0.0;
+        LOG_INFO(format("{}{:.1f}% finished ({} / {}). Time elapsed = {:.3f} sec., "
+                        "{:.4g} per sec. (moving average {:.4g} per sec.), ETA = {:.3f} sec.",
+                        name.empty() ? "" : name + ": ", 100.0 * (double)after / (double)total + 1e-6,
+                        after, total, t, rate, movingRate, eta));
+        return true;
+    }
+
+    std::string                 name;
+    std::uint64_t               total;
+    double                      logPerPercentage;
+    utils::Timer                timer;
+
+    std::atomic<std::uint64_t>  finished = 0;
+    // Count at which the next log is written
+    std::atomic<std::uint64_t>  nextLogAt = 0;
+
+    // Members below are guarded by mtx
+    std::mutex                  mtx;
+    double                      lastTime = 0.0;
+    std::uint64_t               lastCount = 0;
+    double                      movingRate = 0.0;
 };
 
 #endif //DAWNSEEKER_PROGRESSCOUNTER_H
@@ -2,6 +2,7 @@
 // Created by Onlynagesha on 2022/4/6.
 //
 
+#include <set>
 #include "args-v2.h"
 #include "args/argparse.h"
 #include "immbasic.h"
@@ -87,12 +88,118 @@ ProgramArgs makeProgramArgs() {
             "How many times to test each boosted node set by forward simulation"_desc,
             10000
         },
+        {
+            {"sim-mode",           "simMode"},
+            "cis"_expects,
+            "How to simulate the results of all the k's: 'independent' (freshly sampled worlds for each k), "
+                "'paired' (all the k's evaluated on the same sampled worlds), "
+                "or 'sketch' (estimated by freshly sampled PRR-sketches)"_desc,
+            "independent"
+        },
+        {
+            {"sim-rel-error",      "simRelError"},
+            "f"_expects,
+            "Target relative error of simulation. Simulation stops once the confidence interval of total gain "
+                "is narrow enough, with test-times as the upper limit. 0 if disabled"_desc,
+            0.0
+        },
+        {
+            {"sim-confidence",     "simConfidence"},
+            "f"_expects,
+            "Confidence level of the confidence intervals of simulation results"_desc,
+            0.99
+        },
+        {
+            {"time-budget",        "timeBudget"},
+            "f"_expects,
+            "Wall-clock time budget in seconds, counted since the algorithm starts, i.e. per query. "
+                "Once exceeded, sampling stops "
+                "and the result is selected with the samples collected so far. 0 if disabled"_desc,
+            0.0
+        },
+        {
+            {"memory-budget",      "memoryBudget"},
+            "f"_expects,
+            "Memory budget in MebiBytes, per query. Once the bytes allocated by the algorithm exceed it "
+                "(or the resident set size without the counting allocator), sampling stops "
+                "and the result is selected with the samples collected so far. 0 if disabled"_desc,
+            0.0
+        },
+        {
+            {"result-path",        "resultPath"},
+            "s"_expects,
+            "Path of the file where the best-so-far result is rewritten after each sampling round. "
+                "Empty if disabled"_desc,
+            ""
+        },
+        {
+            {"report-path",        "reportPath"},
+            "s"_expects,
+            "Path of the JSON run report with per-phase timers and performance counters. Empty if disabled"_desc,
+            ""
+        },
+        {
+            {"perf-counters",      "perfCounters"},
+            "u"_expects,
+            "Samples hardware performance counters (cycles, instructions, LLC, branch and dTLB misses) "
+                "around the major kernels if 1. Requires perf_event_open permitted"_desc,
+            0
+        },
+        {
+            {"trace-path",         "tracePath"},
+            "s"_expects,
+            "Path of the Chrome / Perfetto trace-event JSON of worker activity. Empty if disabled"_desc,
+            ""
+        },
+        {
+            {"batch-path",         "batchPath"},
+            "s"_expects,
+            "Path of the query file of batch mode, each line as the arguments overriding the ones of command line. "
+                "Empty if disabled"_desc,
+            ""
+        },
+        {
+            {"batch-output-path",  "batchOutputPath"},
+            "s"_expects,
+            "Path of the JSON lines file where the result record of each query in batch mode is written. "
+                "Empty if disabled"_desc,
+            ""
+        },
+        {
+            {"batch-jobs",         "batchJobs"},
+            "u"_expects,
+            "How many queries of batch mode run concurrently, with n-threads split between them. "
+                "0 for n-threads / 4 (at least 1)"_desc,
+            0
+        },
+        {
+            "serve",
+            "s"_expects,
+            "Runs as a service answering the queries from stdin if \"stdin\", "
+                "or from the Unix domain socket of the given path otherwise. Empty if disabled"_desc,
+            ""
+        },
+        {
+            {"cache-memory",       "cacheMemory"},
+            "f"_expects,
+            "Capacity in MebiBytes of the PRR-sketch collections kept warm in service mode. 0 if disabled. "
+                "Cached PRR-sketches are reused only by the queries with fixed sample sizes "
+                "no smaller than the cached count"_desc,
+            1024.0
+        },
         {
             {"greedy-test-times",  "greedyTestTimes"},
             "u"_expects,
             "How many times to test each node in greedy algorithm"_desc,
             1000
         },
+        {
+            {"greedy-world-bank",  "greedyWorldBank"},
+            "u"_expects,
+            "Number of worlds sampled in advance on which all the nodes are tested in greedy algorithm. "
+                "0 if disabled (greedy-test-times fresh worlds for each node instead)"_desc,
+            0
+        },
         {
             {"log-per-percentage", "logPerPercentage"},
             "f"_expects,
@@ -148,6 +255,44 @@ ProgramArgs prepareProgramArgs(int argc, char** argv) {
     return argSet;
 }
 
+ProgramArgs prepareQueryArgs(int argc, char** argv, const std::vector<std::string>& queryTokens) {
+    auto argSet = makeProgramArgs();
+    // Gets the canonical name of an option token (e.g. "-j" -> "j", "--nThreads" -> "j"), or empty if not an option
+    auto canonicalName = [&](const std::string& token) {
+        auto nDashes = token.starts_with("--") ? 2 : token.starts_with('-') ? 1 : 0;
+        auto name = token.substr(nDashes);
+        if (nDashes == 0 || !argSet.contains(name)) {
+            return std::string{};
+        }
+        return utils::string_traits_cast<std::string>(argSet.get(name.c_str())->labels()[0]);
+    };
+
+    auto overridden = std::set<std::string>{};
+    for (const auto& token: queryTokens) {
+        if (auto name = canonicalName(token); !name.empty()) {
+            if (name == "graph-path" || name == "batch-path" || name == "batch-output-path" || name == "batch-jobs"
+                || name == "serve" || name == "cache-memory") {
+                throw std::invalid_argument(format("'{}' can not be overridden by a query", token));
+            }
+            overridden.insert(std::move(name));
+        }
+    }
+    // Each option takes exactly one value, thus an overridden option is dropped together with the token after it
+    auto tokens = std::vector<std::string>{argv[0]};
+    for (int i = 1; i < argc; i++) {
+        if (overridden.contains(canonicalName(argv[i]))) {
+            i += 1;
+        } else {
+            tokens.emplace_back(argv[i]);
+        }
+    }
+    tokens.insert(tokens.end(), queryTokens.begin(), queryTokens.end());
+
+    auto argParser = makeArgParser(argSet);
+    args::parse(argSet, argParser, tokens);
+    return argSet;
+}
+
 AlgorithmArgsPtr getAlgorithmArgs(std::size_t n, const ProgramArgs& args) {
     auto algo = getAlgorithmLabel(args);
 
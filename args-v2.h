@@ -50,6 +50,60 @@ inline std::string toString(AlgorithmLabel label) {
     }
 }
 
+enum class SimulationMode {
+    Independent,
+    Paired,
+    Sketch
+};
+
+/*!
+ * @brief Converts a <code>SimulationMode</code> to its corresponding name as <code>std::string</code>.
+ * @param mode
+ * @return A <code>std::string</code> object as its name.
+ */
+inline std::string toString(SimulationMode mode) {
+    switch (mode) {
+    case SimulationMode::Independent:
+        return "Independent";
+    case SimulationMode::Paired:
+        return "Paired";
+    case SimulationMode::Sketch:
+        return "Sketch";
+    default:
+        return "(ERROR)";
+    }
+}
+
+/*!
+ * @brief Gets the simulation mode by its name.
+ *
+ * Mode name is case-insensitive. Valid mode names are:
+ * <ul>
+ *   <li> <code>independent</code>: The result without boosted nodes and the result of each k
+ *          are simulated independently, each with freshly sampled worlds
+ *   <li> <code>paired</code>: Each world is sampled once, and the result without boosted nodes
+ *          and the results of all the k's are evaluated on the same world (common random numbers)
+ *   <li> <code>sketch</code>: Results are estimated by the center states of freshly sampled PRR-sketches
+ *          instead of forward simulation over the whole graph, with all the k's on the same sketches
+ * </ul>
+ *
+ * @param mode Case-insensitive string as the mode name.
+ * @return The corresponding <code>SimulationMode</code>
+ * @throw std::invalid_argument if no valid simulation mode is matched.
+ */
+inline SimulationMode getSimulationMode(const utils::ci_string& mode) {
+    if (mode == "independent") {
+        return SimulationMode::Independent;
+    }
+    if (mode == "paired") {
+        return SimulationMode::Paired;
+    }
+    if (mode == "sketch") {
+        return SimulationMode::Sketch;
+    }
+    throw std::invalid_argument("No matching simulation mode");
+}
+
 /*!
  * @brief Gets the algorithm label by algorithm name and/or node state priority.
  * 
@@ -255,6 +309,71 @@ struct BasicArgs {
      * @brief Default value of <code>testTimes</code>
      */
     static constexpr std::uint64_t  testTimesDefault = 10000;
+    /*!
+     * @brief How to simulate the results of all the k's, independently or with common random numbers.
+     */
+    SimulationMode                  simMode;
+    /*!
+     * @brief Target relative error of simulation. 0 if disabled.
+     * <p>If enabled, simulations stop once the half-width of the confidence interval of total gain
+     * is no more than <code>simRelError</code> x |estimated total gain|,
+     * and <code>testTimes</code> is taken as the upper limit.
+     */
+    double                          simRelError;
+    /*!
+     * @brief Confidence level of the confidence intervals of simulation results
+     */
+    double                          simConfidence;
+    /*!
+     * @brief Wall-clock time budget in seconds, counted since the algorithm starts, i.e. per query. 0 if disabled.
+     * <p>Once exceeded, sampling stops and the result is selected with the samples collected so far.
+     */
+    double                          timeBudget;
+    /*!
+     * @brief Memory budget in bytes, per query. 0 if disabled.
+     * <p>Once the bytes allocated by the algorithm exceed it (see memory::currentBytes),
+     * sampling stops as <code>timeBudget</code>.
+     */
+    std::size_t                     memoryBudget;
+    /*!
+     * @brief Path of the file where the best-so-far result is written after each round. Empty if disabled.
+     */
+    std::string                     resultPath;
+    /*!
+     * @brief Path of the JSON report with per-phase timers and performance counters. Empty if disabled.
+     */
+    std::string                     reportPath;
+    /*!
+     * @brief Whether hardware performance counters are sampled around the major kernels (see perf.h).
+     */
+    bool                            perfCounters;
+    /*!
+     * @brief Path of the Chrome / Perfetto trace-event JSON of worker activity (see trace.h). Empty if disabled.
+     */
+    std::string                     tracePath;
+    /*!
+     * @brief Path of the query file of batch mode. Empty if disabled.
+     * <p>Each line contains the arguments of a query, overriding the ones of the command line.
+     */
+    std::string                     batchPath;
+    /*!
+     * @brief Path of the JSON lines file where the result record of each query is written in batch mode.
+     *        Empty if disabled.
+     */
+    std::string                     batchOutputPath;
+    /*!
+     * @brief How many queries of batch mode run concurrently, with nThreads split between them.
+     */
+    std::size_t                     batchJobs;
+    /*!
+     * @brief Where the queries of service mode are read from: "stdin", or the path of a Unix domain socket.
+     *        Empty if disabled.
+     */
+    std::string                     serve;
+    /*!
+     * @brief Capacity in bytes of the PRR-sketch collections kept warm in service mode. 0 if disabled.
+     */
+    std::size_t                     cacheMemory;
 
     /*!
      * @brief (Derived arg) log2(n)
@@ -288,6 +407,34 @@ struct BasicArgs {
      *                                              how many threads to use at most, 1 by default
      *   <li> (Optional) <code>args["test-times"]</code> as unsigned integer,
      *                                              how many times to simulate for each boosted node set and k
+     *   <li> (Optional) <code>args["sim-mode"]</code> as case-insensitive string,
+     *                                              simulation mode. <code>independent</code> by default
+     *   <li> (Optional) <code>args["sim-rel-error"]</code> as floating point,
+     *                                              target relative error of simulation. 0 (disabled) by default
+     *   <li> (Optional) <code>args["sim-confidence"]</code> as floating point,
+     *                                              confidence level of simulation results. 0.99 by default
+     *   <li> (Optional) <code>args["time-budget"]</code> as floating point,
+     *                                              time budget in seconds. 0 (disabled) by default
+     *   <li> (Optional) <code>args["memory-budget"]</code> as floating point,
+     *                                              memory budget in MebiBytes. 0 (disabled) by default
+     *   <li> (Optional) <code>args["result-path"]</code> as string,
+     *                                              where the best-so-far result is written. Empty (disabled) by default
+     *   <li> (Optional) <code>args["report-path"]</code> as string,
+     *                                              where the JSON run report is written. Empty (disabled) by default
+     *   <li> (Optional) <code>args["perf-counters"]</code> as unsigned integer,
+     *                                              whether to sample hardware performance counters. 0 by default
+     *   <li> (Optional) <code>args["trace-path"]</code> as string,
+     *                                              where the trace of worker activity is written. Empty (disabled) by default
+     *   <li> (Optional) <code>args["batch-path"]</code> as string,
+     *                                              path of the query file of batch mode. Empty (disabled) by default
+     *   <li> (Optional) <code>args["batch-output-path"]</code> as string,
+     *                                              where the result records of batch mode are written. Empty (disabled) by default
+     *   <li> (Optional) <code>args["batch-jobs"]</code> as unsigned integer,
+     *                                              how many queries of batch mode run concurrently. nThreads / 4 by default
+     *   <li> (Optional) <code>args["serve"]</code> as string,
+     *                                              "stdin" or the socket path of service mode. Empty (disabled) by default
+     *   <li> (Optional) <code>args["cache-memory"]</code> as floating point,
+     *                                              capacity of the sketch cache in MebiBytes. 1024 by default
      * </ul>
      *
      * For the arguments that support lists, the list is given as a string
@@ -355,6 +502,47 @@ struct BasicArgs {
             LOG_WARNING(format("testTimes >= 1 is not satisfied. Sets to {}.", testTimesDefault));
         }
 
+        simMode = getSimulationMode(args.getValueOr("sim-mode", utils::ci_string("independent")));
+
+        simRelError = args.getValueOr("sim-rel-error", 0.0);
+        if (simRelError < 0.0) {
+            throw std::out_of_range("simRelError >= 0 is not satisfied");
+        }
+        simConfidence = args.getValueOr("sim-confidence", 0.99);
+        if (simConfidence <= 0.0 || simConfidence >= 1.0) {
+            throw std::out_of_range("0 < simConfidence < 1 is not satisfied");
+        }
+
+        timeBudget = args.getValueOr("time-budget", 0.0);
+        if (timeBudget < 0.0) {
+            throw std::out_of_range("timeBudget >= 0 is not satisfied");
+        }
+        auto memoryBudgetMiB = args.getValueOr("memory-budget", 0.0);
+        if (memoryBudgetMiB < 0.0) {
+            throw std::out_of_range("memoryBudget >= 0 is not satisfied");
+        }
+        memoryBudget = (std::size_t)(memoryBudgetMiB * 1024.0 * 1024.0);
+        resultPath = args.getValueOr("result-path", std::string{});
+        reportPath = args.getValueOr("report-path", std::string{});
+        perfCounters = args.getValueOr("perf-counters", std::size_t{0}) != 0;
+        tracePath = args.getValueOr("trace-path", std::string{});
+        batchPath = args.getValueOr("batch-path", std::string{});
+        batchOutputPath = args.getValueOr("batch-output-path", std::string{});
+        batchJobs = args.getValueOr("batch-jobs", std::size_t{0});
+        if (batchJobs == 0) {
+            batchJobs = std::max<std::size_t>(1, nThreads / 4);
+        }
+        if (batchJobs > nThreads) {
+            batchJobs = nThreads;
+            LOG_WARNING(format("batchJobs <= nThreads is not satisfied. Sets to {}.", nThreads));
+        }
+        serve = args.getValueOr("serve", std::string{});
+        auto cacheMemoryMiB = args.getValueOr("cache-memory", 1024.0);
+        if (cacheMemoryMiB < 0.0) {
+            throw std::out_of_range("cacheMemory >= 0 is not satisfied");
+        }
+        cacheMemory = (std::size_t)(cacheMemoryMiB * 1024.0 * 1024.0);
+
         log2N = std::log2(n);
         lnN = std::log(n);
 
@@ -370,17 +558,13 @@ struct BasicArgs {
     virtual ~BasicArgs() = default;
 
     /*!
-     * @brief Sets global experiment environment.
+     * @brief Gets the node state context of the experiment, with the node state priority and the gains by lambda.
      *
-     * Changes the following global values:
-     * <ul>
-     *   <li> Global weight parameter <i>lambda</i>
-     *   <li> Global node state priority
-     * </ul>
+     * The context is passed to the sampling, selection and simulation routines explicitly,
+     * thus experiments with different arguments can run concurrently.
      */
-    virtual void setEnv() const {
-        setNodeStateGain(lambda);
-        setNodeStatePriority(priority.array);
+    [[nodiscard]] NodeStateContext nodeStateContext() const {
+        return NodeStateContext::of(priority.array, lambda);
     }
 
     /*!
@@ -399,6 +583,20 @@ struct BasicArgs {
         res     += format("logPerPercentage = {}\n", logPerPercentage);
         res     += format("        nThreads = {}\n", nThreads);
         res     += format("       testTimes = {} (default = {})\n", testTimes, testTimesDefault);
+        res     += format("         simMode = {}\n", simMode);
+        res     += format("     simRelError = {}\n", simRelError);
+        res     += format("   simConfidence = {}\n", simConfidence);
+        res     += format("      timeBudget = {} sec.\n", timeBudget);
+        res     += format("    memoryBudget = {}\n", utils::totalBytesUsedToString(memoryBudget));
+        res     += format("      resultPath = {}\n", resultPath.empty() ? "(disabled)" : resultPath);
+        res     += format("      reportPath = {}\n", reportPath.empty() ? "(disabled)" : reportPath);
+        res     += format("    perfCounters = {}\n", perfCounters);
+        res     += format("       tracePath = {}\n", tracePath.empty() ? "(disabled)" : tracePath);
+        res     += format("       batchPath = {}\n", batchPath.empty() ? "(disabled)" : batchPath);
+        res     += format(" batchOutputPath = {}\n", batchOutputPath.empty() ? "(disabled)" : batchOutputPath);
+        res     += format("       batchJobs = {}\n", batchJobs);
+        res     += format("           serve = {}\n", serve.empty() ? "(disabled)" : serve);
+        res     += format("     cacheMemory = {}\n", utils::totalBytesUsedToString(cacheMemory));
         
         res     += format("Node state priority: \n{}", priority.dump());
         return res;
@@ -956,6 +1154,12 @@ struct GreedyArgs: BasicArgs {
      * @brief Default value of <code>greedyTestTimes</code>
      */
     static constexpr std::uint64_t  greedyTestTimesDefault = 1000;
+    /*!
+     * @brief Number of pre-sampled worlds R in the world bank. 0 if disabled.
+     * <p>If enabled, all the candidates are evaluated on the same R worlds sampled in advance,
+     * instead of <code>greedyTestTimes</code> freshly sampled worlds for each.
+     */
+    std::uint64_t                   greedyWorldBank;
 
     /*!
      * @brief Constructs with given graph size and argument collection.
@@ -972,11 +1176,13 @@ struct GreedyArgs: BasicArgs {
             greedyTestTimes = greedyTestTimesDefault;
             LOG_WARNING(format("greedyTestTimes >= 1 is not satisfied. Sets to {}.", greedyTestTimesDefault));
         }
+        greedyWorldBank = args.getValueOr("greedy-world-bank", std::uint64_t{0});
     }
 
     [[nodiscard]] std::string dump() const override {
         auto res = BasicArgs::dump() + dumpDelimiter;
-        res += format("greedyTestTimes = {} (default = {})", greedyTestTimes, greedyTestTimesDefault);
+        res += format("greedyTestTimes = {} (default = {})\n", greedyTestTimes, greedyTestTimesDefault);
+        res += format("greedyWorldBank = {}", greedyWorldBank);
         return res;
     }
 };
@@ -991,6 +1197,22 @@ using AlgorithmArgsPtr = std::unique_ptr<BasicArgs>;
  */
 ProgramArgs prepareProgramArgs(int argc, char** argv);
 
+/*!
+ * @brief Generates a <code>ProgramArgs</code> object for a query of batch mode.
+ *
+ * Options in queryTokens override the ones of the same argument (aliases included) in (argc, argv),
+ * and the others are taken from (argc, argv).
+ * The graph and the arguments of batch mode and service mode can not be overridden,
+ * since they are shared by all the queries.
+ *
+ * @param argc
+ * @param argv
+ * @param queryTokens Tokens of the query, e.g. <code>{"-k", "10", "-priority", "Ca+ Cr- Cr Ca"}</code>
+ * @return The <code>ProgramArgs</code> object that wraps all the arguments of the query.
+ * @throw std::invalid_argument if the query attempts to override the graph, batch mode or service mode arguments
+ */
+ProgramArgs prepareQueryArgs(int argc, char** argv, const std::vector<std::string>& queryTokens);
+
 /*!
  * @brief Generates a algorithm argument object with given graph size |V| and program args.
  *
@@ -5,6 +5,7 @@
 #ifndef DAWNSEEKER_GRAPH_ELEMENT_H
 #define DAWNSEEKER_GRAPH_ELEMENT_H
 
+#include <utility>
 #include <variant>
 #include "basic.h"
 #include "exception.h"
@@ -0,0 +1,350 @@
+//
+// Created by Onlynagesha on 2022/5/22.
+//
+
+/*!
+ * @file bench/bench.cpp
+ * @brief Microbenchmarks of the sampling, selection and simulation kernels.
+ *
+ * Each kernel is run on synthetic graphs of each combination of
+ * graph size, degree distribution and probability model,
+ * and reported as ns/op and items/s, where "items" depends on the kernel (listed in the output).
+ *
+ * Usage: bench [--filter <substring>] [--sizes <n1,n2,...>] [--min-time <seconds>]
+ */
+
+#include <iostream>
+#include <sstream>
+#include "generators.h"
+#include "greedyselect.h"
+#include "input.h"
+#include "simulate.h"
+
+namespace {
+    // Degree distribution of synthetic graphs
+    enum class Degree { Uniform, PowerLaw };
+
+    constexpr const char* toString(Degree d) {
+        return d == Degree::Uniform ? "uniform" : "power-law";
+    }
+
+    constexpr const char* toString(gen::ProbabilityModel m) {
+        return m == gen::ProbabilityModel::Uniform ? "uniform" : "wc";
+    }
+
+    // Average out-degree of synthetic graphs
+    constexpr std::size_t avgDegree = 8;
+    // Number of seeds of each kind
+    constexpr std::size_t nSeedsEach = 10;
+    // Number of boosted nodes to select or simulate with
+    constexpr std::size_t kBoosted = 10;
+
+    /*!
+     * @brief Generates a synthetic graph deterministically.
+     *
+     *   - Uniform: Erdős–Rényi graph with avgDegree * n links;
+     *   - PowerLaw: Barabási–Albert graph, each new node links to and from avgDegree / 2 existing nodes.
+     *
+     * Probability models: p = 0.1, pBoost = 0.2 for Uniform, and pBoost = 2p for WeightedCascade.
+     */
+    gen::EdgeList<std::uint32_t> makeEdges(std::size_t n, Degree degree, std::uint64_t seed, std::size_t nThreads) {
+        return degree == Degree::Uniform
+            ? gen::erdosRenyiEdges<std::uint32_t>(n, n * avgDegree, seed, nThreads)
+            : gen::barabasiAlbertEdges<std::uint32_t>(n, avgDegree / 2, seed, nThreads);
+    }
+
+    IMMGraph makeGraph(std::size_t n, Degree degree, gen::ProbabilityModel probModel, std::uint64_t seed) {
+        auto prob = gen::ProbabilityArgs{.model = probModel};
+        return gen::buildGraph(n, makeEdges(n, degree, seed, 1), prob, seed, 1);
+    }
+
+    /*!
+     * @brief Stopwatch that excludes the time of setup work between pause() and resume().
+     */
+    class Stopwatch {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        void pause() {
+            total += Clock::now() - start;
+        }
+
+        void resume() {
+            start = Clock::now();
+        }
+
+        [[nodiscard]] double seconds() const {
+            return std::chrono::duration<double>(total).count();
+        }
+
+    private:
+        Clock::time_point   start = Clock::now();
+        Clock::duration     total{};
+    };
+
+    struct Options {
+        std::string                 filter;
+        std::vector<std::size_t>    sizes = {1000, 10000};
+        double                      minTime = 0.2;
+    };
+
+    /*!
+     * @brief Runs a benchmark with increasing number of iterations until it takes at least minTime.
+     *
+     * The body func(nIters, stopwatch) runs the kernel nIters times and returns the number of items processed.
+     * The stopwatch is running when func is called, and should be paused before returning.
+     */
+    template <class Func>
+    void runBench(const Options& opt, std::string_view name, std::string_view config,
+                  std::string_view itemName, Func&& func) {
+        if (!opt.filter.empty() && name.find(opt.filter) == std::string_view::npos) {
+            return;
+        }
+        auto nIters = std::uint64_t{1};
+        for (;; nIters *= 2) {
+            auto sw = Stopwatch{};
+            auto nItems = func(nIters, sw);
+            auto t = sw.seconds();
+            if (t >= opt.minTime || nIters >= (std::uint64_t{1} << 40)) {
+                std::cout << format("{:<36} {:<28} {:>14.1f} ns/op {:>14.4g} {}/s\n",
+                                    name, config, 1e9 * t / (double)nIters, (double)nItems / t, itemName);
+                return;
+            }
+        }
+    }
+
+    void benchGraph(const Options& opt, std::size_t n, Degree degree, gen::ProbabilityModel probModel) {
+        auto graph = makeGraph(n, degree, probModel, 42);
+        auto seeds = gen::makeSeedSet(graph, nSeedsEach, nSeedsEach, gen::SeedPick::Uniform, 43);
+        // A monotonic & submodular priority, as required by the fast kernels
+        auto stateCtx = NodeStateContext::of(NodePriorityProperty::of("Ca+ Cr- Cr Ca").array, 0.5);
+        auto config = format("n={} {} {}", n, toString(degree), toString(probModel));
+        auto rng = std::mt19937_64(44);
+        auto randomNode = [&]() {
+            return std::uniform_int_distribution<std::size_t>(0, n - 1)(rng);
+        };
+
+        runBench(opt, "getRandomState", config, "states", [&](std::uint64_t nIters, Stopwatch& sw) {
+            auto nActive = std::uint64_t{0};
+            auto links = graph.links();
+            for (std::uint64_t i = 0; i != nIters; i++) {
+                const auto& e = links[i % links.size()];
+                nActive += getRandomState(e.p, e.pBoost) == LinkState::Active;
+            }
+            sw.pause();
+            // Prevents the loop from being optimized out
+            volatile auto sink = nActive;
+            (void)sink;
+            return nIters;
+        });
+
+        auto prrGraph = PRRGraph({{"maxIndex", n}});
+        auto linkStates = IMMLinkStateSamples(graph.nLinks());
+        runBench(opt, "samplePRRSketch", config, "sketch-nodes", [&](std::uint64_t nIters, Stopwatch& sw) {
+            auto nItems = std::uint64_t{0};
+            for (std::uint64_t i = 0; i != nIters; i++) {
+                samplePRRSketch(graph, linkStates, prrGraph, seeds, stateCtx, randomNode());
+                nItems += prrGraph.nNodes();
+            }
+            sw.pause();
+            return nItems;
+        });
+
+        // A pool of pre-sampled sketches, on which the per-sketch kernels run repeatedly
+        constexpr std::size_t poolSize = 64;
+        auto pool = std::vector<PRRGraph>{};
+        for (std::size_t i = 0; i != poolSize; i++) {
+            samplePRRSketch(graph, linkStates, prrGraph, seeds, stateCtx, randomNode());
+            pool.push_back(prrGraph);
+        }
+        runBench(opt, "calculateCenterStateToFast", config, "sketch-nodes", [&](std::uint64_t nIters, Stopwatch& sw) {
+            auto nItems = std::uint64_t{0};
+            for (std::uint64_t i = 0; i != nIters; i++) {
+                auto& G = pool[i % poolSize];
+                calculateCenterStateToFast(G, stateCtx);
+                nItems += G.nNodes();
+            }
+            sw.pause();
+            return nItems;
+        });
+        runBench(opt, "calculateCenterStateToSlow", config, "sketch-nodes", [&](std::uint64_t nIters, Stopwatch& sw) {
+            auto nItems = std::uint64_t{0};
+            for (std::uint64_t i = 0; i != nIters; i++) {
+                auto& G = pool[i % poolSize];
+                calculateCenterStateToSlow(G, stateCtx);
+                nItems += G.nNodes();
+            }
+            sw.pause();
+            return nItems;
+        });
+        for (auto& G: pool) {
+            calculateCenterStateToFast(G, stateCtx);
+        }
+
+        runBench(opt, "PRRGraphCollection::add", config, "sketches", [&](std::uint64_t nIters, Stopwatch& sw) {
+            auto collection = PRRGraphCollection(n, seeds, stateCtx);
+            for (std::uint64_t i = 0; i != nIters; i++) {
+                collection.add(pool[i % poolSize]);
+            }
+            sw.pause();
+            return nIters;
+        });
+
+        // Fragments of fragmentSize sketches each, merged into one collection
+        constexpr std::size_t fragmentSize = 256;
+        auto fragment = PRRGraphCollection(n, seeds, stateCtx);
+        for (std::size_t i = 0; i != fragmentSize; i++) {
+            fragment.add(pool[i % poolSize]);
+        }
+        runBench(opt, "PRRGraphCollection::merge", config, "sketches", [&](std::uint64_t nIters, Stopwatch& sw) {
+            sw.pause();
+            auto collection = PRRGraphCollection(n, seeds, stateCtx);
+            for (std::uint64_t i = 0; i != nIters; i++) {
+                auto copy = fragment;
+                sw.resume();
+                collection.merge(copy);
+                sw.pause();
+            }
+            return nIters * fragmentSize;
+        });
+
+        // Selection on a collection of n sketches
+        auto collection = PRRGraphCollection(n, seeds, stateCtx);
+        for (std::size_t i = 0; i != n; i++) {
+            samplePRRSketch(graph, linkStates, prrGraph, seeds, stateCtx, randomNode());
+            calculateCenterStateToFast(prrGraph, stateCtx);
+            collection.add(prrGraph);
+        }
+        runBench(opt, "PRRGraphCollection::select", config, "sketches", [&](std::uint64_t nIters, Stopwatch& sw) {
+            auto res = 0.0;
+            for (std::uint64_t i = 0; i != nIters; i++) {
+                res += collection.select(kBoosted, nullptr);
+            }
+            sw.pause();
+            volatile auto sink = res;
+            (void)sink;
+            return nIters * collection.prrGraph.size();
+        });
+
+        // Gains of each boosted node to a center, as produced by one SA-IMM sample
+        auto gainsPool = std::vector<std::pair<std::size_t, std::vector<double>>>{};
+        for (std::size_t i = 0; i != poolSize; i++) {
+            auto& G = pool[i];
+            auto& [center, gains] = gainsPool.emplace_back(G.center, std::vector<double>(n, 0.0));
+            calculateCenterStateToSlow(G, stateCtx);
+            for (const auto& node: G.nodes()) {
+                gains[index(node)] += stateCtx.gain(node.centerStateTo) - stateCtx.gain(G.centerState);
+            }
+        }
+        runBench(opt, "PRRGraphCollectionSA::add", config, "samples", [&](std::uint64_t nIters, Stopwatch& sw) {
+            auto collectionSA = PRRGraphCollectionSA(n, 0.0, seeds);
+            for (std::uint64_t i = 0; i != nIters; i++) {
+                const auto& [center, gains] = gainsPool[i % poolSize];
+                collectionSA.add(center, 1, gains);
+            }
+            sw.pause();
+            return nIters;
+        });
+
+        auto collectionSA = PRRGraphCollectionSA(n, 0.0, seeds);
+        for (std::size_t i = 0; i != n; i++) {
+            const auto& [center, gains] = gainsPool[i % poolSize];
+            collectionSA.add(randomNode(), 1, gains);
+        }
+        runBench(opt, "PRRGraphCollectionSA::select", config, "centers", [&](std::uint64_t nIters, Stopwatch& sw) {
+            auto res = 0.0;
+            for (std::uint64_t i = 0; i != nIters; i++) {
+                res += collectionSA.select(kBoosted, nullptr);
+            }
+            sw.pause();
+            volatile auto sink = res;
+            (void)sink;
+            return nIters * n;
+        });
+
+        auto boostedNodes = std::vector<std::size_t>{};
+        collection.select(kBoosted, std::back_inserter(boostedNodes));
+        auto nodeStates = NodeSimStates{};
+        runBench(opt, "simulateBoostedOnce", config, "simulations", [&](std::uint64_t nIters, Stopwatch& sw) {
+            auto res = SimResultItem{};
+            for (std::uint64_t i = 0; i != nIters; i++) {
+                res += simulateBoostedOnce(graph, linkStates, nodeStates, seeds, stateCtx, boostedNodes);
+            }
+            sw.pause();
+            volatile auto sink = res.totalGain;
+            (void)sink;
+            return nIters;
+        });
+
+        // Generation with all the hardware threads, as used for large graphs without I/O
+        auto nThreads = std::size_t{std::thread::hardware_concurrency()};
+        runBench(opt, "generateGraph", config, "links", [&](std::uint64_t nIters, Stopwatch& sw) {
+            auto nItems = std::uint64_t{0};
+            for (std::uint64_t i = 0; i != nIters; i++) {
+                nItems += gen::buildGraph(n, makeEdges(n, degree, i, nThreads), {.model = probModel}, i, nThreads)
+                        .nLinks();
+            }
+            sw.pause();
+            return nItems;
+        });
+
+        // The graph as text in the input format of readGraph
+        auto text = std::ostringstream{};
+        text << format("{} {}\n", graph.nNodes(), graph.nLinks());
+        for (const auto& e: graph.links()) {
+            text << format("{} {} {} {}\n", e.from(), e.to(), e.p, e.pBoost);
+        }
+        auto textStr = text.str();
+        runBench(opt, "readGraph", config, "links", [&](std::uint64_t nIters, Stopwatch& sw) {
+            auto nItems = std::uint64_t{0};
+            for (std::uint64_t i = 0; i != nIters; i++) {
+                sw.pause();
+                auto in = std::istringstream(textStr);
+                sw.resume();
+                nItems += readGraph(in).nLinks();
+            }
+            sw.pause();
+            return nItems;
+        });
+    }
+
+    Options parseOptions(int argc, char** argv) {
+        auto opt = Options{};
+        for (int i = 1; i < argc; i++) {
+            auto arg = std::string_view(argv[i]);
+            if (i + 1 == argc) {
+                throw std::invalid_argument(format("Missing value of argument '{}'", arg));
+            }
+            if (arg == "--filter") {
+                opt.filter = argv[++i];
+            } else if (arg == "--sizes") {
+                auto str = std::string_view(argv[++i]);
+                opt.sizes.clear();
+                utils::cstr::splitByEither(str.data(), str.length(), ",; ", [&](std::string_view token) {
+                    opt.sizes.push_back(utils::fromString<std::size_t>(token));
+                });
+            } else if (arg == "--min-time") {
+                opt.minTime = utils::fromString<double>(argv[++i]);
+            } else {
+                throw std::invalid_argument(format("Unknown argument '{}'", arg));
+            }
+        }
+        return opt;
+    }
+}
+
+int main(int argc, char** argv) try {
+    auto opt = parseOptions(argc, argv);
+
+    for (auto n: opt.sizes) {
+        for (auto degree: {Degree::Uniform, Degree::PowerLaw}) {
+            for (auto probModel: {gen::ProbabilityModel::Uniform, gen::ProbabilityModel::WeightedCascade}) {
+                benchGraph(opt, n, degree, probModel);
+            }
+        }
+    }
+    return 0;
+} catch (std::exception& e) {
+    std::cerr << "Exception caught: " << e.what() << std::endl;
+    return -1;
+}
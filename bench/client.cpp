@@ -0,0 +1,136 @@
+//
+// Created by Onlynagesha on 2022/5/30.
+//
+
+/*!
+ * @file bench/client.cpp
+ * @brief Client of service mode (see service.h) over a Unix domain socket, also used as its test harness.
+ *
+ * Each query (or command) is sent as a line, and the response line is written to the standard output,
+ * with the latency of each query written to the standard error.
+ * Empty lines and the ones starting with '#' are skipped.
+ * A summary of latencies is written at the end.
+ *
+ * The program exits with code 1 if it fails to connect, or any response is missing or records an error.
+ *
+ * Usage: client <socket path> [query file], where queries are read from the standard input if no file is given.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "global.h"
+
+namespace {
+    bool sendLine(int fd, std::string line) {
+        line += '\n';
+        for (auto p = line.data(), end = p + line.length(); p != end; ) {
+            auto n = ::send(fd, p, end - p, MSG_NOSIGNAL);
+            if (n <= 0) {
+                return false;
+            }
+            p += n;
+        }
+        return true;
+    }
+
+    bool receiveLine(int fd, std::string& buffer, std::string& line) {
+        for (;;) {
+            if (auto pos = buffer.find('\n'); pos != std::string::npos) {
+                line.assign(buffer, 0, pos);
+                buffer.erase(0, pos + 1);
+                return true;
+            }
+            char chunk[4096];
+            auto n = ::recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) {
+                return false;
+            }
+            buffer.append(chunk, (std::size_t)n);
+        }
+    }
+
+    int connectTo(const std::string& path) {
+        auto addr = sockaddr_un{};
+        if (path.length() >= sizeof(addr.sun_path)) {
+            throw std::invalid_argument(format("Socket path '{}' is too long", path));
+        }
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+        auto fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || ::connect(fd, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+            throw std::runtime_error(format("Failed to connect to '{}': {}", path, std::strerror(errno)));
+        }
+        return fd;
+    }
+}
+
+int main(int argc, char** argv) try {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <socket path> [query file]" << std::endl;
+        return 1;
+    }
+    auto fin = std::ifstream{};
+    if (argc >= 3) {
+        fin.open(argv[2]);
+        if (!fin.is_open()) {
+            throw std::invalid_argument(format("Query file '{}' not found", argv[2]));
+        }
+    }
+    auto& in = argc >= 3 ? static_cast<std::istream&>(fin) : std::cin;
+    auto fd = connectTo(argv[1]);
+
+    auto latencies = std::vector<double>{};
+    auto nFailed = std::size_t{0};
+    auto buffer = std::string{};
+    for (auto line = std::string{}, response = std::string{}; std::getline(in, line); ) {
+        if (auto pos = line.find_first_not_of(" \t\r"); pos == std::string::npos || line[pos] == '#') {
+            continue;
+        }
+        if (!sendLine(fd, line)) {
+            std::cerr << "Failed to send the query. The service may be stopped." << std::endl;
+            nFailed += 1;
+            break;
+        }
+        // No response to the commands closing the connection or stopping the service
+        if (line == "quit" || line == "shutdown") {
+            break;
+        }
+        auto start = std::chrono::steady_clock::now();
+        if (!receiveLine(fd, buffer, response)) {
+            std::cerr << "Missing response. The service may be stopped." << std::endl;
+            nFailed += 1;
+            break;
+        }
+        auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        latencies.push_back(ms);
+        nFailed += response.find("\"error\":") != std::string::npos ? 1 : 0;
+        std::cout << response << std::endl;
+        std::cerr << format("#{}: {:.3f} ms\n", latencies.size(), ms);
+    }
+    ::close(fd);
+
+    if (!latencies.empty()) {
+        auto sorted = latencies;
+        rs::sort(sorted);
+        auto mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) / (double)sorted.size();
+        std::cerr << format("{} responses, latency: mean = {:.3f} ms, median = {:.3f} ms, max = {:.3f} ms\n",
+                            sorted.size(), mean, sorted[sorted.size() / 2], sorted.back());
+    }
+    if (nFailed != 0) {
+        std::cerr << format("{} queries failed\n", nFailed);
+        return 1;
+    }
+    return 0;
+} catch (std::exception& e) {
+    std::cerr << "Exception caught: " << e.what() << std::endl;
+    return 1;
+}
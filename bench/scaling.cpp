@@ -0,0 +1,440 @@
+//
+// Created by Onlynagesha on 2022/5/24.
+//
+
+/*!
+ * @file bench/scaling.cpp
+ * @brief End-to-end strong / weak scaling harness of PR-IMM, SA-IMM and simulation.
+ *
+ * For each graph, algorithm, sample size scale and thread count, the algorithm is run through
+ * the same dispatch as the main program (see dispatch.h), and the following are recorded:
+ *   - throughput: PRR-sketches sampled per second for PR-IMM and SA-IMM,
+ *     or simulations (with boosted nodes) per second for simulation;
+ *   - parallel efficiency: throughput / (nThreads * throughput with the fewest threads) of the same configuration;
+ *   - peak resident set size during the run, or unavailable if it can not be reset before the run
+ *     (see resetPeakResidentMemory), since the peak of the previous runs would be taken otherwise.
+ *
+ * In strong scaling mode, sample sizes are fixed for all the thread counts;
+ * in weak scaling mode, sample sizes are multiplied by the number of threads.
+ *
+ * Records can be written as a JSON file and used as the baseline of later runs.
+ * The program exits with code 1 if any record regresses beyond the threshold compared with the baseline,
+ * i.e. lower throughput, lower efficiency or higher peak memory.
+ *
+ * Usage: scaling [options], see parseOptions for details.
+ */
+
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <thread>
+#include "budget.h"
+#include "dispatch.h"
+#include "generators.h"
+#include "input.h"
+#include "Logger.h"
+#include "memory.h"
+
+namespace {
+    struct Options {
+        // Graph paths or generator specifications
+        std::vector<std::string>    graphs = {"gen:rmat:scale=12,degree=8,seed=1"};
+        std::string                 seeds = "gen:na=10,nr=10,pick=degree";
+        std::vector<std::string>    algos = {"PR-IMM", "SA-IMM", "simulation"};
+        std::vector<std::size_t>    threads;
+        // Multipliers of the base sample sizes below
+        std::vector<std::size_t>    scales = {1};
+        bool                        weak = false;
+        std::size_t                 nSamples = 20000;
+        std::size_t                 nSamplesSA = 2;
+        std::size_t                 testTimes = 2000;
+        std::string                 k = "10";
+        std::string                 priority = "Ca+ Cr- Cr Ca";
+        std::string                 outputPath;
+        std::string                 baselinePath;
+        double                      threshold = 0.2;
+        bool                        verbose = false;
+    };
+
+    // A measurement of one configuration
+    struct Record {
+        std::string     mode;
+        std::string     graph;
+        std::string     algo;
+        std::size_t     nThreads{};
+        std::size_t     scale{};
+        std::size_t     nSamples{};
+        double          seconds{};
+        double          throughput{};
+        std::string     unit{};
+        double          efficiency = 1.0;
+        // std::nullopt if unavailable
+        std::optional<std::size_t> peakMemoryBytes{};
+
+        [[nodiscard]] std::string key() const {
+            return format("{} | {} | {} | scale={} | threads={}", mode, graph, algo, scale, nThreads);
+        }
+    };
+
+    std::string toJson(const Record& r) {
+        return format("{{ \"mode\": {}, \"graph\": {}, \"algo\": {}, \"nThreads\": {}, \"scale\": {}, \"nSamples\": {}, "
+                      "\"seconds\": {}, \"throughput\": {}, \"unit\": {}, \"efficiency\": {}, \"peakMemoryBytes\": {} }}",
+                      metrics::jsonString(r.mode), metrics::jsonString(r.graph), metrics::jsonString(r.algo), r.nThreads, r.scale, r.nSamples,
+                      metrics::jsonNumber(r.seconds), metrics::jsonNumber(r.throughput), metrics::jsonString(r.unit),
+                      metrics::jsonNumber(r.efficiency),
+                      r.peakMemoryBytes ? std::to_string(*r.peakMemoryBytes) : std::string{"null"});
+    }
+
+    /*!
+     * @brief Parses a JSON object with string or number values only, as written by toJson(Record).
+     *
+     * Escape sequences in strings are not translated except \" and \\.
+     * Returns an empty map if the line is not such an object.
+     */
+    std::map<std::string, std::string> parseFlatObject(std::string_view line) {
+        auto res = std::map<std::string, std::string>{};
+        auto pos = line.find('{');
+        if (pos == std::string_view::npos) {
+            return {};
+        }
+        auto skipSpaces = [&]() {
+            while (pos < line.size() && std::isspace(line[pos])) {
+                pos += 1;
+            }
+        };
+        auto readString = [&]() {
+            auto str = std::string{};
+            for (pos += 1; pos < line.size() && line[pos] != '"'; pos++) {
+                if (line[pos] == '\\' && pos + 1 < line.size()) {
+                    pos += 1;
+                }
+                str += line[pos];
+            }
+            pos += 1;
+            return str;
+        };
+        for (pos += 1; ; ) {
+            skipSpaces();
+            if (pos >= line.size() || line[pos] != '"') {
+                return res;
+            }
+            auto key = readString();
+            skipSpaces();
+            if (pos >= line.size() || line[pos] != ':') {
+                return {};
+            }
+            pos += 1;
+            skipSpaces();
+            if (pos < line.size() && line[pos] == '"') {
+                res[key] = readString();
+            } else {
+                auto end = line.find_first_of(",}", pos);
+                auto value = line.substr(pos, end - pos);
+                while (!value.empty() && std::isspace(value.back())) {
+                    value.remove_suffix(1);
+                }
+                res[key] = std::string(value);
+                pos = end;
+            }
+            skipSpaces();
+            if (pos >= line.size() || line[pos] != ',') {
+                return res;
+            }
+            pos += 1;
+        }
+    }
+
+    std::map<std::string, Record> readBaseline(const std::string& path) {
+        auto fin = std::ifstream(path);
+        if (!fin.is_open()) {
+            throw std::invalid_argument(format("Baseline file '{}' not found", path));
+        }
+        auto res = std::map<std::string, Record>{};
+        for (std::string line; std::getline(fin, line); ) {
+            auto obj = parseFlatObject(line);
+            if (!obj.contains("graph") || !obj.contains("throughput")) {
+                continue;
+            }
+            auto number = [&](const std::string& key) {
+                return obj[key] == "null" || obj[key].empty() ? NAN : utils::fromString<double>(obj[key]);
+            };
+            auto r = Record{
+                .mode = obj["mode"],
+                .graph = obj["graph"],
+                .algo = obj["algo"],
+                .nThreads = (std::size_t)number("nThreads"),
+                .scale = (std::size_t)number("scale"),
+                .nSamples = (std::size_t)number("nSamples"),
+                .seconds = number("seconds"),
+                .throughput = number("throughput"),
+                .unit = obj["unit"],
+                .efficiency = number("efficiency"),
+            };
+            if (auto peak = number("peakMemoryBytes"); std::isfinite(peak)) {
+                r.peakMemoryBytes = (std::size_t)peak;
+            }
+            res[r.key()] = r;
+        }
+        return res;
+    }
+
+    /*!
+     * @brief Generates the algorithm arguments in the same way as the main program.
+     */
+    AlgorithmArgsPtr makeArgs(std::size_t n, const std::vector<std::string>& tokens) {
+        auto argv = std::vector<char*>{};
+        auto name = std::string{"scaling"};
+        argv.push_back(name.data());
+        for (const auto& token: tokens) {
+            argv.push_back(const_cast<char*>(token.c_str()));
+        }
+        return getAlgorithmArgs(n, prepareProgramArgs((int)argv.size(), argv.data()));
+    }
+
+    /*!
+     * @brief Runs one configuration and measures it.
+     */
+    Record runOnce(IMMGraph& graph, const SeedSet& seeds, const Options& opt,
+                   const std::string& graphName, const std::string& algo, std::size_t nThreads, std::size_t scale) {
+        auto factor = scale * (opt.weak ? nThreads : 1);
+        auto tokens = std::vector<std::string>{
+            "-graph-path", graphName, "-seed-set-path", opt.seeds, "-k", opt.k, "-priority", opt.priority, "-n-threads", std::to_string(nThreads),
+            "-test-times", std::to_string(opt.testTimes * factor)
+        };
+        auto record = Record{.mode = opt.weak ? "weak" : "strong", .graph = graphName, .algo = algo, .scale = scale};
+        // Whether the peak resident set size is reset right before the run
+        auto peakReset = false;
+
+        if (algo == "simulation") {
+            // Boosted nodes to simulate with, chosen cheaply
+            auto selectTokens = tokens;
+            selectTokens.insert(selectTokens.end(), {"-algo", "MaxDegree"});
+            auto selectArgs = makeArgs(graph.nNodes(), selectTokens);
+            auto boostedNodes = runAlgorithm(graph, seeds, *selectArgs).front().item.boostedNodes;
+
+            auto args = makeArgs(graph.nNodes(), tokens);
+            peakReset = resetPeakResidentMemory();
+            auto start = std::chrono::steady_clock::now();
+            auto simRes = doSimulation(graph, seeds, boostedNodes, *args);
+            record.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            for (const auto& r: simRes) {
+                record.nSamples += r.sampleCount;
+            }
+            record.nThreads = args->nThreads;
+            record.unit = "simulations/s";
+        } else {
+            tokens.insert(tokens.end(), {"-algo", algo, "-n-samples", std::to_string(opt.nSamples * factor)});
+            if (algo != "PR-IMM") {
+                tokens.insert(tokens.end(), {"-n-samples-sa", std::to_string(opt.nSamplesSA * factor)});
+            }
+            auto args = makeArgs(graph.nNodes(), tokens);
+            peakReset = resetPeakResidentMemory();
+            auto before = metrics::snapshot()[metrics::Counter::SketchesSampled];
+            auto start = std::chrono::steady_clock::now();
+            auto results = runAlgorithm(graph, seeds, *args);
+            record.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            record.nSamples = metrics::snapshot()[metrics::Counter::SketchesSampled] - before;
+            record.nThreads = args->nThreads;
+            record.unit = "sketches/s";
+            for (const auto& res: results) {
+                LOG_INFO(format("{} result '{}' with {} samples: time used by the algorithm = {:.3f} sec.",
+                                algo, res.label, res.nSamples, res.item.timeUsed));
+            }
+        }
+        record.throughput = record.seconds > 0.0 ? (double)record.nSamples / record.seconds : 0.0;
+        if (peakReset) {
+            record.peakMemoryBytes = peakResidentMemoryBytes();
+        } else {
+            LOG_WARNING("Failed to reset the peak resident set size, thus the peak memory of the run is unavailable");
+        }
+        return record;
+    }
+
+    std::vector<std::string> splitList(std::string_view str, const char* delims) {
+        auto res = std::vector<std::string>{};
+        utils::cstr::splitByEither(str.data(), str.length(), delims, [&](std::string_view token) {
+            res.emplace_back(token);
+        });
+        return res;
+    }
+
+    std::vector<std::size_t> splitSizes(std::string_view str) {
+        auto res = std::vector<std::size_t>{};
+        for (const auto& token: splitList(str, ",; ")) {
+            res.push_back(utils::fromString<std::size_t>(token));
+        }
+        return res;
+    }
+
+    /*!
+     * @brief Parses the options.
+     *
+     *   --graphs <g1;g2;...>       Graph paths or generator specifications, separated by semicolons
+     *   --seeds <path>             Seed set path or generator specification, shared by all the graphs
+     *   --algos <a1,a2,...>        Any of PR-IMM, SA-IMM, SA-RG-IMM and simulation
+     *   --threads <t1,t2,...>      Thread counts [default: powers of 2 up to hardware concurrency]
+     *   --scales <s1,s2,...>       Multipliers of the sample sizes
+     *   --mode <strong|weak>       Scaling mode
+     *   --n-samples <n>            PRR-sketches of PR-IMM and the upper bound of SA-IMM with scale 1
+     *   --n-samples-sa <n>         PRR-sketches per center of SA-IMM with scale 1
+     *   --test-times <n>           Simulations with scale 1
+     *   --k, --priority            Same as the main program
+     *   --output <path>            Where to write the records as JSON
+     *   --baseline <path>          Records of a previous run to compare with
+     *   --threshold <r>            Maximum relative regression allowed
+     *   --verbose <0|1>            Whether to log the details of the algorithms
+     */
+    Options parseOptions(int argc, char** argv) {
+        auto opt = Options{};
+        for (int i = 1; i < argc; i++) {
+            auto arg = std::string_view(argv[i]);
+            if (i + 1 == argc) {
+                throw std::invalid_argument(format("Missing value of argument '{}'", arg));
+            }
+            auto value = std::string(argv[++i]);
+            if (arg == "--graphs") {
+                opt.graphs = splitList(value, ";");
+            } else if (arg == "--seeds") {
+                opt.seeds = value;
+            } else if (arg == "--algos") {
+                opt.algos = splitList(value, ",; ");
+            } else if (arg == "--threads") {
+                opt.threads = splitSizes(value);
+            } else if (arg == "--scales") {
+                opt.scales = splitSizes(value);
+            } else if (arg == "--mode") {
+                if (value != "strong" && value != "weak") {
+                    throw std::invalid_argument(format("Unknown scaling mode '{}'", value));
+                }
+                opt.weak = value == "weak";
+            } else if (arg == "--n-samples") {
+                opt.nSamples = utils::fromString<std::size_t>(value);
+            } else if (arg == "--n-samples-sa") {
+                opt.nSamplesSA = utils::fromString<std::size_t>(value);
+            } else if (arg == "--test-times") {
+                opt.testTimes = utils::fromString<std::size_t>(value);
+            } else if (arg == "--k") {
+                opt.k = value;
+            } else if (arg == "--priority") {
+                opt.priority = value;
+            } else if (arg == "--output") {
+                opt.outputPath = value;
+            } else if (arg == "--baseline") {
+                opt.baselinePath = value;
+            } else if (arg == "--threshold") {
+                opt.threshold = utils::fromString<double>(value);
+            } else if (arg == "--verbose") {
+                opt.verbose = value != "0";
+            } else {
+                throw std::invalid_argument(format("Unknown argument '{}'", arg));
+            }
+        }
+        auto nThreadsMax = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+        if (opt.threads.empty()) {
+            for (std::size_t t = 1; t <= nThreadsMax; t *= 2) {
+                opt.threads.push_back(t);
+            }
+        }
+        // Thread counts are clamped the same way as the algorithm arguments, thus duplicates are removed
+        for (auto& t: opt.threads) {
+            t = std::clamp<std::size_t>(t, 1, nThreadsMax);
+        }
+        rs::sort(opt.threads);
+        opt.threads.erase(std::unique(opt.threads.begin(), opt.threads.end()), opt.threads.end());
+        return opt;
+    }
+
+    /*!
+     * @brief Compares the records with the baseline.
+     * @return Number of regressions.
+     */
+    std::size_t compareWithBaseline(const std::vector<Record>& records, const std::map<std::string, Record>& baseline,
+                                    double threshold) {
+        auto nRegressions = std::size_t{0};
+        for (const auto& r: records) {
+            auto it = baseline.find(r.key());
+            if (it == baseline.end()) {
+                std::cout << format("[missing]    {}: not found in the baseline\n", r.key());
+                continue;
+            }
+            const auto& b = it->second;
+            auto check = [&](std::string_view what, double current, double base, bool higherIsBetter) {
+                if (!std::isfinite(base) || base <= 0.0) {
+                    return;
+                }
+                auto change = (current - base) / base;
+                auto regressed = higherIsBetter ? change < -threshold : change > threshold;
+                std::cout << format("{:<12} {}: {} {:.4g} -> {:.4g} ({:+.1f}%)\n",
+                                    regressed ? "[REGRESSION]" : "[ok]", r.key(), what, base, current, 100.0 * change);
+                nRegressions += regressed;
+            };
+            check("throughput", r.throughput, b.throughput, true);
+            check("efficiency", r.efficiency, b.efficiency, true);
+            if (r.peakMemoryBytes && b.peakMemoryBytes) {
+                check("peakMemoryBytes", (double)*r.peakMemoryBytes, (double)*b.peakMemoryBytes, false);
+            }
+        }
+        return nRegressions;
+    }
+}
+
+int main(int argc, char** argv) try {
+    auto opt = parseOptions(argc, argv);
+    auto level = opt.verbose ? logger::LogLevel::Debug : logger::LogLevel::Warning;
+    logger::Loggers::add(std::make_shared<logger::Logger>("output", std::cerr, level));
+
+    auto records = std::vector<Record>{};
+    auto nThreadsMax = opt.threads.back();
+    for (const auto& graphName: opt.graphs) {
+        auto graph = gen::isGeneratorSpec(graphName) ? gen::generateGraph(graphName, nThreadsMax) : readGraph(graphName);
+        auto seeds = gen::isGeneratorSpec(opt.seeds) ? gen::generateSeedSet(graph, opt.seeds) : readSeedSet(opt.seeds);
+        std::cout << format("Graph {}: |V| = {}, |E| = {}\n", graphName, graph.nNodes(), graph.nLinks());
+
+        for (const auto& algo: opt.algos) {
+            for (auto scale: opt.scales) {
+                auto first = records.size();
+                for (auto nThreads: opt.threads) {
+                    auto& r = records.emplace_back(runOnce(graph, seeds, opt, graphName, algo, nThreads, scale));
+                    const auto& r0 = records[first];
+                    r.efficiency = r0.throughput > 0.0
+                        ? r.throughput * (double)r0.nThreads / ((double)r.nThreads * r0.throughput) : NAN;
+                    std::cout << format("{:<12} threads={:<3} scale={:<3} samples={:<10} {:>9.3f} sec. "
+                                        "{:>12.4g} {:<14} efficiency={:.3f} peak={}\n",
+                                        algo, r.nThreads, scale, r.nSamples, r.seconds, r.throughput, r.unit,
+                                        r.efficiency, r.peakMemoryBytes ? utils::totalBytesUsedToString(*r.peakMemoryBytes)
+                                                                        : std::string{"unavailable"});
+                }
+            }
+        }
+    }
+
+    if (!opt.outputPath.empty()) {
+        auto fout = std::ofstream(opt.outputPath);
+        fout << "{\n";
+        fout << format("  \"hardwareConcurrency\": {},\n", std::thread::hardware_concurrency());
+        fout << "  \"records\": [";
+        for (std::size_t i = 0; i != records.size(); i++) {
+            fout << (i == 0 ? "\n    " : ",\n    ") << toJson(records[i]);
+        }
+        fout << "\n  ]\n}\n";
+        if (!fout) {
+            throw std::runtime_error(format("Failed to write the records to '{}'", opt.outputPath));
+        }
+        std::cout << format("Records written to '{}'\n", opt.outputPath);
+    }
+
+    if (!opt.baselinePath.empty()) {
+        auto nRegressions = compareWithBaseline(records, readBaseline(opt.baselinePath), opt.threshold);
+        if (nRegressions != 0) {
+            std::cout << format("{} regression(s) beyond {:.1f}% found.\n", nRegressions, 100.0 * opt.threshold);
+            return 1;
+        }
+        std::cout << "No regression found.\n";
+    }
+    return 0;
+} catch (std::exception& e) {
+    std::cerr << "Exception caught: " << e.what() << std::endl;
+    return -1;
+}
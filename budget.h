@@ -0,0 +1,134 @@
+//
+// Created by Onlynagesha on 2022/5/20.
+//
+
+#ifndef DAWNSEEKER_BUDGET_H
+#define DAWNSEEKER_BUDGET_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include "global.h"
+#include "memory.h"
+#include "utils/misc.h"
+
+/*!
+ * @brief Wall-clock and memory budget of a run, checked cooperatively by time-consuming algorithms.
+ *
+ * Time is counted since the budget is constructed, i.e. since the algorithm starts,
+ * thus each query of batch mode and service mode has a budget of its own.
+ * Memory is taken as the bytes counted in the memory account of the constructing thread
+ * (see memory::currentBytes), i.e. of the query in batch mode and service mode,
+ * or the estimation provided by the caller, whichever is larger.
+ * A limit with value 0 is disabled.
+ *
+ * Once a limit is exceeded, the budget stays exhausted. All the methods are thread-safe.
+ */
+class ResourceBudget {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Status {
+        Available, TimeExceeded, MemoryExceeded
+    };
+
+    /*!
+     * @brief Constructs with the limits.
+     * @param timeLimit Time limit in seconds, 0 if disabled
+     * @param memoryLimit Memory limit in bytes, 0 if disabled
+     */
+    ResourceBudget(double timeLimit, std::size_t memoryLimit):
+    startTime(Clock::now()), account(memory::currentAccount()), timeLimit(timeLimit), memoryLimit(memoryLimit) {}
+
+    /*!
+     * @brief Whether any of the limits is enabled.
+     */
+    [[nodiscard]] bool enabled() const {
+        return timeLimit > 0.0 || memoryLimit > 0;
+    }
+
+    /*!
+     * @brief Time elapsed since the budget is constructed, in seconds.
+     */
+    [[nodiscard]] double elapsed() const {
+        return std::chrono::duration<double>(Clock::now() - startTime).count();
+    }
+
+    /*!
+     * @brief Time elapsed since the program starts, in seconds.
+     */
+    [[nodiscard]] static double sinceProgramStart() {
+        return std::chrono::duration<double>(Clock::now() - programStartTime).count();
+    }
+
+    /*!
+     * @brief Checks both limits, and marks the budget exhausted if either is exceeded.
+     *
+     * Without the counting allocator, reading resident set size takes a system call,
+     * thus it should not be called too frequently.
+     *
+     * @param memoryUsed Estimation of memory used by the caller in bytes
+     * @return true if the budget is exhausted.
+     */
+    bool check(std::size_t memoryUsed = 0) {
+        if (exhausted()) {
+            return true;
+        }
+        if (timeLimit > 0.0 && elapsed() >= timeLimit) {
+            mark(Status::TimeExceeded);
+        } else if (memoryLimit > 0 && std::max(memoryUsed, memory::currentBytes(account)) >= memoryLimit) {
+            mark(Status::MemoryExceeded);
+        }
+        return exhausted();
+    }
+
+    /*!
+     * @brief Checks the time limit only, which is cheap enough to be called for each sample.
+     * @return true if the budget is exhausted.
+     */
+    bool checkTime() {
+        if (!exhausted() && timeLimit > 0.0 && elapsed() >= timeLimit) {
+            mark(Status::TimeExceeded);
+        }
+        return exhausted();
+    }
+
+    /*!
+     * @brief Whether the budget has been found exhausted by the previous checks.
+     */
+    [[nodiscard]] bool exhausted() const {
+        return status.load(std::memory_order_relaxed) != Status::Available;
+    }
+
+    /*!
+     * @brief Gets the description why the budget is exhausted, or an empty string if not exhausted.
+     */
+    [[nodiscard]] std::string reason() const {
+        switch (status.load(std::memory_order_relaxed)) {
+        case Status::TimeExceeded:
+            return format("time budget {:.3f} sec. exceeded", timeLimit);
+        case Status::MemoryExceeded:
+            return format("memory budget {} exceeded", utils::totalBytesUsedToString(memoryLimit));
+        default:
+            return "";
+        }
+    }
+
+private:
+    void mark(Status s) {
+        auto expected = Status::Available;
+        status.compare_exchange_strong(expected, s);
+    }
+
+    // Initialized before main() starts
+    static inline const Clock::time_point programStartTime = Clock::now();
+
+    Clock::time_point       startTime;
+    // Memory account of the algorithm, whose counted bytes are checked
+    memory::AccountTag      account;
+    double                  timeLimit;
+    std::size_t             memoryLimit;
+    std::atomic<Status>     status = Status::Available;
+};
+
+#endif //DAWNSEEKER_BUDGET_H
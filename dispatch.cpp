@@ -0,0 +1,380 @@
+//
+// Created by Onlynagesha on 2022/5/24.
+//
+
+#include <fstream>
+#include <map>
+#include <optional>
+#include <thread>
+#include "budget.h"
+#include "dispatch.h"
+#include "input.h"
+#include "Logger.h"
+#include "memory.h"
+#include "metrics.h"
+#include "perf.h"
+#include "thread.h"
+#include "trace.h"
+
+std::vector<LabeledResult> runAlgorithm(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args,
+                                        SketchCache* cache, const std::vector<double>* pageRankScores) {
+    auto results = std::vector<LabeledResult>{};
+    auto append = [&](const std::string& label, const IMMResult& res) {
+        for (const auto& [nSamples, resItem]: res.items) {
+            results.push_back({.label = label, .sampled = true, .nSamples = nSamples, .item = resItem});
+        }
+    };
+
+    if (args.algo == AlgorithmLabel::PR_IMM) {
+        append("", PR_IMM(graph, seeds, args, cache));
+    } else if (args.algo == AlgorithmLabel::SA_IMM || args.algo == AlgorithmLabel::SA_RG_IMM) {
+        auto res = SA_IMM(graph, seeds, args, cache);
+        for (auto i: {0, 1}) {
+            append(res.labels[i], res[i]);
+        }
+    } else {
+        auto res = GreedyResult{};
+        if (args.algo == AlgorithmLabel::Greedy) {
+            res = greedy(graph, seeds, args);
+        } else if (args.algo == AlgorithmLabel::MaxDegree) {
+            res = maxDegree(graph, seeds, args);
+        } else if (args.algo == AlgorithmLabel::PageRank) {
+            res = pageRank(graph, seeds, args, pageRankScores);
+        } else {
+            throw std::logic_error("Unexpected case of algorithm selection: unimplemented or wrong logic");
+        }
+        LOG_INFO(format("Result of {} algorithm: {}", args.algo, utils::join(res.boostedNodes, ", ", "[", "]")));
+        auto& back = results.emplace_back();
+        back.item.boostedNodes = std::move(res.boostedNodes);
+    }
+    LOG_INFO("Memory usage after the algorithm:\n" + memory::toString(memory::snapshot()));
+    return results;
+}
+
+std::vector<SimResult> doSimulation(
+        IMMGraph&                       graph,
+        const SeedSet&                  seeds,
+        const std::vector<std::size_t>& boostedNodes,
+        const BasicArgs&                args) {
+    auto phase = metrics::ScopedPhase(metrics::Phase::Simulation);
+    auto scope = memory::ScopedSubsystem(memory::Subsystem::Simulation);
+    auto precision = SimPrecision{.relError = args.simRelError, .confidence = args.simConfidence};
+    auto stateCtx = args.nodeStateContext();
+    // Independent simulation runs T times for each k and once more without boosted nodes,
+    //  while the others share each world or sketch among all the k's.
+    //  With the precision target, simulation may stop before 100% is reached.
+    auto nTotal = args.simMode == SimulationMode::Independent
+                  ? args.testTimes * (args.kList.size() + 1) : args.testTimes;
+    auto progress = ProgressCounter("Simulation", nTotal, args.logPerPercentage);
+    auto simRes = std::vector<SimResult>{};
+    switch (args.simMode) {
+    case SimulationMode::Paired:
+        simRes = simulatePaired(graph, seeds, stateCtx, boostedNodes, args.kList,
+                                args.testTimes, args.nThreads, precision, &progress);
+        break;
+    case SimulationMode::Sketch:
+        simRes = simulateBySketches(graph, seeds, stateCtx, boostedNodes, args.kList,
+                                    args.testTimes, args.nThreads, precision, &progress);
+        break;
+    default:
+        simRes = simulate(graph, seeds, stateCtx, boostedNodes, args.kList,
+                          args.testTimes, args.nThreads, precision, &progress);
+        break;
+    }
+    for (std::size_t i = 0; i != args.kList.size(); i++) {
+        LOG_INFO(format("Simulation results with k = {}: {}",
+                        args.kList[i], toString(simRes[i], true)));
+    }
+    return simRes;
+}
+
+std::vector<std::vector<SimResult>> doSimulation(IMMGraph& graph, const SeedSet& seeds,
+                                                 const std::vector<LabeledResult>& results, const BasicArgs& args) {
+    auto simResults = std::vector<std::vector<SimResult>>{};
+    for (const auto& [label, sampled, nSamples, resItem]: results) {
+        if (!label.empty()) {
+            LOG_INFO(format("Starts simulation for the result of label '{}' with {} samples:", label, nSamples));
+        } else if (sampled) {
+            LOG_INFO(format("Starts simulation for result with {} samples:", nSamples));
+        }
+        simResults.push_back(doSimulation(graph, seeds, resItem.boostedNodes, args));
+    }
+    LOG_INFO("Memory usage after simulation:\n" + memory::toString(memory::snapshot()));
+    return simResults;
+}
+
+void logPerformanceSummary() {
+    auto s = metrics::snapshot();
+    auto info = std::string{"Phase timers:"};
+    for (std::size_t i = 0; i != metrics::nPhases; i++) {
+        info += format("\n    {:<16} {:.3f} sec. in {} calls", metrics::phaseNames[i], s.phaseSeconds[i], s.phaseCalls[i]);
+    }
+    LOG_INFO(info);
+    if (auto p = perf::snapshot(); p.enabled) {
+        LOG_INFO("Hardware performance counters:\n" + perf::toString(p));
+        if (std::ranges::any_of(p.total.unscheduledCalls, [](std::uint64_t n) { return n != 0; })) {
+            LOG_WARNING("Some kernel calls are not counted since the hardware performance counters are never "
+                        "scheduled during them. Try with fewer events or without the NMI watchdog.");
+        }
+    }
+}
+
+std::string resultToJson(const LabeledResult& res) {
+    const auto& item = res.item;
+    if (!res.sampled) {
+        return format("{{ \"label\": {}, \"boostedNodes\": {} }}",
+                      metrics::jsonString(res.label), join(item.boostedNodes, ", ", "[", "]"));
+    }
+    return format("{{ \"label\": {}, \"nSamples\": {}, \"totalGain\": {}, \"timeUsed\": {}, "
+                  "\"memoryUsage\": {}, \"peakMemoryUsage\": {}, \"budgetExhausted\": {}, \"epsilonAchieved\": {}, "
+                  "\"boostedNodes\": {} }}",
+                  metrics::jsonString(res.label), res.nSamples,
+                  metrics::jsonNumber(item.totalGain <= halfMin<double> ? NAN : item.totalGain),
+                  metrics::jsonNumber(item.timeUsed), item.memoryUsage, item.peakMemoryUsage, item.budgetExhausted,
+                  metrics::jsonNumber(item.epsilonAchieved >= halfMax<double> ? NAN : item.epsilonAchieved),
+                  join(item.boostedNodes, ", ", "[", "]"));
+}
+
+void writeReport(const IMMGraph& graph, const BasicArgs& args, const std::vector<LabeledResult>& results) {
+    writeReport(graph, args, results, ResourceBudget::sinceProgramStart(), peakResidentMemoryBytes());
+}
+
+void writeReport(const IMMGraph& graph, const BasicArgs& args, const std::vector<LabeledResult>& results,
+                 double seconds, std::size_t peakMemoryBytes) {
+    if (args.reportPath.empty()) {
+        return;
+    }
+    auto fout = std::ofstream(args.reportPath);
+    fout << "{\n";
+    fout << format("  \"algo\": {},\n", metrics::jsonString(format("{}", args.algo)));
+    fout << format("  \"graph\": {{ \"nNodes\": {}, \"nLinks\": {} }},\n", graph.nNodes(), graph.nLinks());
+    fout << format("  \"args\": {{ \"kList\": {}, \"lambda\": {}, \"nThreads\": {}, \"testTimes\": {}, "
+                   "\"simMode\": {} }},\n",
+                   join(args.kList, ", ", "[", "]"), args.lambda, args.nThreads, args.testTimes,
+                   metrics::jsonString(format("{}", args.simMode)));
+    fout << format("  \"totalSeconds\": {},\n", metrics::jsonNumber(seconds));
+    fout << format("  \"peakMemoryBytes\": {},\n", peakMemoryBytes);
+    fout << format("  \"memory\": {},\n", memory::toJson(memory::snapshot(), 2));
+    fout << format("  \"metrics\": {},\n", metrics::toJson(metrics::snapshot(), 2));
+    fout << format("  \"perf\": {},\n", perf::toJson(perf::snapshot(), 2));
+    fout << "  \"results\": [";
+    for (std::size_t i = 0; i != results.size(); i++) {
+        fout << (i == 0 ? "\n    " : ",\n    ") << resultToJson(results[i]);
+    }
+    fout << "\n  ]\n}\n";
+
+    if (!fout) {
+        LOG_WARNING(format("Failed to write the report to '{}'", args.reportPath));
+    } else {
+        LOG_INFO(format("Report written to '{}'", args.reportPath));
+    }
+}
+
+void writeTrace(const BasicArgs& args) {
+    if (args.tracePath.empty()) {
+        return;
+    }
+    auto [ok, nWritten, nDropped] = trace::dump(args.tracePath);
+    if (!ok) {
+        LOG_WARNING(format("Failed to write the trace to '{}'", args.tracePath));
+    } else {
+        LOG_INFO(format("Trace written to '{}' with {} events ({} oldest events dropped)",
+                        args.tracePath, nWritten, nDropped));
+    }
+}
+
+namespace {
+    // Splits a query line by white spaces. A token may be quoted by double quotes to contain spaces.
+    std::vector<std::string> splitQueryLine(const std::string& line) {
+        auto tokens = std::vector<std::string>{};
+        auto token = std::string{};
+        auto quoted = false;
+        auto inToken = false;
+        for (char c: line) {
+            if (c == '"') {
+                quoted = !quoted;
+                inToken = true;
+            } else if (!quoted && std::isspace((unsigned char)c)) {
+                if (inToken) {
+                    tokens.push_back(std::move(token));
+                    token.clear();
+                    inToken = false;
+                }
+            } else {
+                token += c;
+                inToken = true;
+            }
+        }
+        if (quoted) {
+            throw std::invalid_argument("Unmatched double quote in the query");
+        }
+        if (inToken) {
+            tokens.push_back(std::move(token));
+        }
+        return tokens;
+    }
+
+    std::string simResultsToJson(const BasicArgs& args, const std::vector<SimResult>& simRes) {
+        auto items = std::vector<std::string>{};
+        for (std::size_t i = 0; i != simRes.size(); i++) {
+            items.push_back(format("{{ \"k\": {}, \"totalGainDiff\": {}, \"halfWidth\": {}, \"sampleCount\": {} }}",
+                                   args.kList[i], metrics::jsonNumber(simRes[i].diff.totalGain),
+                                   metrics::jsonNumber(simRes[i].diffHalfWidth.totalGain), simRes[i].sampleCount));
+        }
+        return join(items, ", ", "[", "]");
+    }
+}
+
+QueryRunner::QueryRunner(IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args,
+                         int argc, char** argv, SketchCache* cache):
+graph(graph), args(args), argc(argc), argv(argv), cache(cache) {
+    // Seed sets are shared among the queries with the same path, starting with the one of command line
+    seedSets.emplace(prepareQueryArgs(argc, argv, {}).s["seed-set-path"], seeds);
+}
+
+QueryRunner::Record QueryRunner::run(const std::string& query, std::size_t lineNo, std::size_t maxThreads) {
+    auto queryId = nQueries.fetch_add(1) + 1;
+    auto where = lineNo == 0 ? std::string{} : format(" (line {})", lineNo);
+    LOG_INFO(format("Starts query #{}{}: {}", queryId, where, query));
+    auto timer = utils::Timer{};
+    // Peak memory, phase timers and counters of this query only
+    auto account = memory::Account{};
+    auto registry = metrics::Registry{};
+    auto context = ScopedThreadContext(ThreadContext{.account = account.tag(), .registry = &registry});
+
+    auto record = format("{{ \"query\": {}, ", queryId);
+    if (lineNo != 0) {
+        record += format("\"line\": {}, ", lineNo);
+    }
+    record += format("\"args\": {}, ", metrics::jsonString(query));
+    auto ok = true;
+    try {
+        auto argSet = prepareQueryArgs(argc, argv, splitQueryLine(query));
+        auto queryArgs = getAlgorithmArgs(graph.nNodes(), argSet);
+        if (maxThreads != 0 && queryArgs->nThreads > maxThreads) {
+            queryArgs->nThreads = maxThreads;
+        }
+        LOG_INFO(format("Arguments of query #{}:\n{}", queryId, queryArgs->dump()));
+
+        const auto& querySeeds = [&]() -> const SeedSet& {
+            auto seedSetPath = std::string{argSet.s["seed-set-path"]};
+            auto lock = std::scoped_lock(seedSetsMtx);
+            auto it = seedSets.find(seedSetPath);
+            if (it == seedSets.end()) {
+                // Loaded outside any account, since it's shared by the queries afterwards
+                auto scope = memory::ScopedAccount({});
+                it = seedSets.emplace(seedSetPath, loadSeedSet(graph, seedSetPath)).first;
+            }
+            return it->second;
+        }();
+
+        auto scores = static_cast<const std::vector<double>*>(nullptr);
+        if (queryArgs->algo == AlgorithmLabel::PageRank) {
+            std::call_once(pageRankOnce, [&]() {
+                LOG_INFO("PageRank: computes the scores shared by the queries");
+                auto scope = memory::ScopedAccount({});
+                pageRankScores = ::pageRankScores(graph);
+            });
+            scores = &pageRankScores;
+        }
+        auto results = runAlgorithm(graph, querySeeds, *queryArgs, cache, scores);
+        auto simResults = doSimulation(graph, querySeeds, results, *queryArgs);
+        // The report of the command line is written by the caller
+        if (queryArgs->reportPath != args.reportPath) {
+            writeReport(graph, *queryArgs, results, timer.elapsed().count(), account.peakBytes());
+        }
+
+        auto resultItems = std::vector<std::string>{};
+        for (std::size_t i = 0; i != results.size(); i++) {
+            // Appends the simulation results to the JSON object, whose last two characters are " }"
+            auto json = resultToJson(results[i]);
+            json.resize(json.length() - 2);
+            resultItems.push_back(json + format(", \"simulation\": {} }}", simResultsToJson(*queryArgs, simResults[i])));
+        }
+        record += format("\"algo\": {}, \"seconds\": {}, \"peakMemoryUsage\": {}, \"results\": {} }}",
+                         metrics::jsonString(format("{}", queryArgs->algo)),
+                         metrics::jsonNumber(timer.elapsed().count()), account.peakBytes(),
+                         join(resultItems, ", ", "[", "]"));
+    } catch (std::exception& e) {
+        LOG_ERROR(format("Query #{}{} failed: {}", queryId, where, e.what()));
+        record += format("\"error\": {} }}", metrics::jsonString(e.what()));
+        ok = false;
+    }
+    // Metrics of the query are added to the process-wide ones, whether it succeeds or not
+    metrics::Registry::global().absorb(registry.snapshot());
+    if (ok) {
+        LOG_INFO(format("Result record of query #{}: {}", queryId, record));
+    }
+    return {.json = std::move(record), .ok = ok};
+}
+
+std::size_t runBatch(IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args, int argc, char** argv) {
+    auto fin = std::ifstream(args.batchPath);
+    if (!fin.is_open()) {
+        throw std::invalid_argument("Batch query file not found!");
+    }
+    auto fout = std::ofstream{};
+    if (!args.batchOutputPath.empty()) {
+        fout.open(args.batchOutputPath);
+        if (!fout.is_open()) {
+            throw std::invalid_argument(format("Failed to open the batch output file '{}'", args.batchOutputPath));
+        }
+    }
+
+    // Query lines with their line numbers
+    auto queries = std::vector<std::pair<std::string, std::size_t>>{};
+    auto lineNo = std::size_t{0};
+    for (auto line = std::string{}; std::getline(fin, line); ) {
+        lineNo += 1;
+        // Skips empty lines and comments
+        if (auto pos = line.find_first_not_of(" \t\r"); pos == std::string::npos || line[pos] == '#') {
+            continue;
+        }
+        queries.emplace_back(std::move(line), lineNo);
+    }
+
+    auto nJobs = std::clamp<std::size_t>(queries.size(), 1, args.batchJobs);
+    LOG_INFO(format("Batch starts: {} queries, {} of them at a time", queries.size(), nJobs));
+    auto runner = QueryRunner(graph, seeds, args, argc, argv);
+    auto nextQuery = std::atomic<std::size_t>{0};
+    // Records finished, written in the order of the queries (guarded by mtx)
+    auto mtx = std::mutex{};
+    auto records = std::vector<std::optional<QueryRunner::Record>>(queries.size());
+    auto nWritten = std::size_t{0};
+    auto nFailed = std::size_t{0};
+
+    auto runJob = [&](std::size_t jobId) {
+        // Threads are split evenly, with the remainder given to the first jobs
+        auto nThreads = args.nThreads / nJobs + (jobId < args.nThreads % nJobs ? 1 : 0);
+        for (auto i = nextQuery.fetch_add(1); i < queries.size(); i = nextQuery.fetch_add(1)) {
+            auto record = runner.run(queries[i].first, queries[i].second, nThreads);
+            auto lock = std::scoped_lock(mtx);
+            nFailed += record.ok ? 0 : 1;
+            records[i] = std::move(record);
+            for (; nWritten != records.size() && records[nWritten].has_value(); nWritten++) {
+                if (fout.is_open()) {
+                    // Flushed per query, so that the records finished are kept if the batch is killed
+                    fout << records[nWritten]->json << std::endl;
+                }
+                records[nWritten].reset();
+            }
+        }
+    };
+    auto jobs = std::vector<std::thread>{};
+    for (std::size_t j = 1; j < nJobs; j++) {
+        jobs.emplace_back([&, j]() {
+            trace::setThreadName(format("batch job #{}", j));
+            runJob(j);
+        });
+    }
+    runJob(0);
+    for (auto& t: jobs) {
+        t.join();
+    }
+
+    LOG_INFO(format("Batch finished: {} queries, {} failed", runner.queryCount(), nFailed));
+    if (fout.is_open() && !fout) {
+        LOG_WARNING(format("Failed to write the batch output to '{}'", args.batchOutputPath));
+    }
+    return nFailed;
+}
@@ -0,0 +1,182 @@
+//
+// Created by Onlynagesha on 2022/5/24.
+//
+
+#ifndef DAWNSEEKER_DISPATCH_H
+#define DAWNSEEKER_DISPATCH_H
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include "imm.h"
+#include "simulate.h"
+
+/*!
+ * @brief A result of the algorithm with its label and sample size.
+ *
+ * Label is empty except for SA-(RG-)IMM, where results of the upper and lower bounds are distinguished.
+ * For the algorithms without sampling (e.g. Greedy), sampled = false and only item.boostedNodes is valid.
+ * A sampling result may have nSamples = 0 if the budget is exhausted before any sample is complete.
+ */
+struct LabeledResult {
+    std::string     label;
+    // Whether the result comes from sampling, i.e. PR-IMM, SA-IMM or SA-RG-IMM
+    bool            sampled = false;
+    std::uint64_t   nSamples = 0;
+    IMMResultItem   item{};
+};
+
+/*!
+ * @brief Runs the algorithm selected by args.algo.
+ *
+ * @param cache The sketch cache used by PR-IMM and the upper bound of SA-IMM, or nullptr if disabled
+ * @param pageRankScores PageRank scores of the graph computed before, or nullptr to compute if required
+ * @return All the results, in the order of labels and then sample sizes.
+ */
+std::vector<LabeledResult> runAlgorithm(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args,
+                                        SketchCache* cache = nullptr,
+                                        const std::vector<double>* pageRankScores = nullptr);
+
+/*!
+ * @brief Simulates the boosted nodes with all the k's in args.kList, by the mode args.simMode.
+ * @return Simulation results of each k.
+ */
+std::vector<SimResult> doSimulation(
+        IMMGraph&                       graph,
+        const SeedSet&                  seeds,
+        const std::vector<std::size_t>& boostedNodes,
+        const BasicArgs&                args);
+
+/*!
+ * @brief Simulates each of the results.
+ * @return Simulation results of each result and each k.
+ */
+std::vector<std::vector<SimResult>> doSimulation(IMMGraph& graph, const SeedSet& seeds,
+                                                 const std::vector<LabeledResult>& results, const BasicArgs& args);
+
+/*!
+ * @brief Logs the wall-clock time of each phase, and the hardware performance counters of each kernel if enabled.
+ */
+void logPerformanceSummary();
+
+/*!
+ * @brief Dumps a result as a JSON object in a single line.
+ *
+ * Results without sampling have label and boostedNodes only.
+ * Sampling results have nSamples, budgetExhausted, epsilonAchieved etc. as well, even if nSamples = 0.
+ */
+std::string resultToJson(const LabeledResult& res);
+
+/*!
+ * @brief Writes the JSON run report to args.reportPath. Does nothing if disabled.
+ *
+ * The report contains the graph size, main arguments, total time, peak memory with its breakdown (see memory.h),
+ * per-phase timers and performance counters (see metrics::toJson),
+ * hardware performance counters (see perf::toJson), and all the results.
+ *
+ * @param graph The whole graph
+ * @param args Arguments of the algorithm
+ * @param results All the results
+ * @param seconds Total time of the run, e.g. of a query in batch mode
+ * @param peakMemoryBytes Peak memory of the run, e.g. counted in the account of a query (see memory::Account)
+ */
+void writeReport(const IMMGraph& graph, const BasicArgs& args, const std::vector<LabeledResult>& results,
+                 double seconds, std::size_t peakMemoryBytes);
+
+/*!
+ * @brief Writes the JSON run report of the whole program to args.reportPath. Does nothing if disabled.
+ *
+ * Total time is counted since the program starts, and peak memory is the peak resident set size.
+ */
+void writeReport(const IMMGraph& graph, const BasicArgs& args, const std::vector<LabeledResult>& results);
+
+/*!
+ * @brief Runs queries on the graph loaded once, for batch mode and service mode.
+ *
+ * A query is a line of arguments overriding the ones of the command line (see prepareQueryArgs),
+ * e.g. <code>-seed-set-path seeds-1.txt -k 10 -priority "Ca+ Cr- Cr Ca" -lambda 0.5</code>.
+ * Seed sets are loaded once per path, and PageRank scores of the graph are computed once and kept by the runner.
+ *
+ * run() may be called from multiple threads, with the workers of each query capped by its caller.
+ * The node state priority and gain of each query are carried by its own NodeStateContext
+ * (see BasicArgs::nodeStateContext), thus no global state is shared by the queries.
+ * Each query has its own memory account (see memory::Account) and metrics registry (see metrics::ScopedRegistry),
+ * thus its peak memory, phase timers and counters are measured apart from the concurrent ones.
+ * The metrics of a finished query are absorbed into the process-wide registry.
+ *
+ * A result record of each query is logged and returned as JSON in a single line:
+ *
+ *      { "query": 1, "line": 3, "args": "-k 10", "algo": "PR-IMM", "seconds": 1.5, "peakMemoryUsage": 1048576,
+ *        "results": [ { (see resultToJson), "simulation": [ { "k": 10, "totalGainDiff": 12.5, ... } ] } ] }
+ *
+ * or <code>{ "query": 1, "args": "-k", "error": "..." }</code> if the query fails.
+ */
+class QueryRunner {
+public:
+    struct Record {
+        std::string json;
+        bool        ok;
+    };
+
+    /*!
+     * @param graph The whole graph
+     * @param seeds The seed set of the command line
+     * @param args Arguments of the command line
+     * @param argc
+     * @param argv
+     * @param cache The sketch cache, or nullptr if disabled
+     */
+    QueryRunner(IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args,
+                int argc, char** argv, SketchCache* cache = nullptr);
+
+    /*!
+     * @brief Runs a query. Exceptions are caught and recorded. Safe to be called from multiple threads.
+     * @param query The query line
+     * @param lineNo Line number of the query in the file (recorded as "line"), or 0 if not from a file
+     * @param maxThreads Maximum number of workers of the query, or 0 for no limit
+     */
+    Record run(const std::string& query, std::size_t lineNo = 0, std::size_t maxThreads = 0);
+
+    [[nodiscard]] std::size_t queryCount() const {
+        return nQueries.load();
+    }
+
+private:
+    IMMGraph&                       graph;
+    const BasicArgs&                args;
+    int                             argc;
+    char**                          argv;
+    SketchCache*                    cache;
+    // Seed sets by path, guarded by seedSetsMtx. Elements of std::map are never moved.
+    std::mutex                      seedSetsMtx;
+    std::map<std::string, SeedSet>  seedSets;
+    // PageRank scores of the graph, computed by the first query of PageRank algorithm
+    std::once_flag                  pageRankOnce;
+    std::vector<double>             pageRankScores;
+    std::atomic<std::size_t>        nQueries = 0;
+};
+
+/*!
+ * @brief Runs each query in args.batchPath on the graph loaded once (batch mode), see QueryRunner.
+ *
+ * Each non-empty line of the query file, except the ones starting with '#', is a query.
+ * Up to args.batchJobs queries run concurrently, with args.nThreads workers split evenly between them.
+ * A failed query is recorded with its error, and the batch continues.
+ * The result record of each query is written as a line to args.batchOutputPath if enabled,
+ * in the order of the file as soon as the records of all the previous queries are written.
+ *
+ * @param graph The whole graph
+ * @param seeds The seed set of the command line
+ * @param args Arguments of the command line
+ * @param argc
+ * @param argv
+ * @return Number of failed queries
+ */
+std::size_t runBatch(IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args, int argc, char** argv);
+
+/*!
+ * @brief Writes the trace of worker activity to args.tracePath (see trace::dump). Does nothing if disabled.
+ */
+void writeTrace(const BasicArgs& args);
+
+#endif //DAWNSEEKER_DISPATCH_H
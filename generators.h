@@ -0,0 +1,530 @@
+//
+// Created by Onlynagesha on 2022/5/23.
+//
+
+#ifndef DAWNSEEKER_GENERATORS_H
+#define DAWNSEEKER_GENERATORS_H
+
+#include <atomic>
+#include <bit>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <unordered_set>
+#include "global.h"
+#include "graphbasic.h"
+#include "thread.h"
+#include "utils/cstring.h"
+#include "utils/string.h"
+
+/*!
+ * @brief In-process synthetic graph generators, producing IMMGraph objects without file I/O.
+ *
+ * All the randomness is drawn from counter-based streams, i.e. the random values of each link
+ * depend only on (seed, link index). Thus links are generated in parallel,
+ * and the result is identical for the same seed regardless of the number of threads.
+ *
+ * Generators produce edge lists first, then buildGraph assigns (p, pBoost) to each link.
+ * Self-loops in the edge lists are dropped by buildGraph.
+ * Node indices in the edge lists are of type Index, 32-bit if |V| <= 2^32 to halve their memory.
+ */
+namespace gen {
+    template <std::unsigned_integral Index>
+    using Edge = std::pair<Index, Index>;
+    template <std::unsigned_integral Index>
+    using EdgeList = std::vector<Edge<Index>>;
+
+    /*!
+     * @brief The mixing function of SplitMix64.
+     */
+    constexpr std::uint64_t mix64(std::uint64_t x) {
+        x += 0x9e3779b97f4a7c15;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+        return x ^ (x >> 31);
+    }
+
+    /*!
+     * @brief Random stream determined by (seed, stream index), as SplitMix64 started from a hashed state.
+     *
+     * Cheap enough to be constructed per link.
+     */
+    class StreamRng {
+    public:
+        StreamRng(std::uint64_t seed, std::uint64_t stream): state(mix64(seed ^ mix64(stream))) {}
+
+        std::uint64_t operator () () {
+            return mix64(state += 0x9e3779b97f4a7c15);
+        }
+
+        // Uniform in [0, 1)
+        double uniform() {
+            return (double)((*this)() >> 11) * 0x1.0p-53;
+        }
+
+        // Uniform in [0, bound) by multiply-shift, whose bias is negligible for bound << 2^64
+        std::size_t below(std::size_t bound) {
+            return (std::size_t)(((unsigned __int128)(*this)() * bound) >> 64);
+        }
+
+    private:
+        std::uint64_t state;
+    };
+
+    // Salts to make the streams of different purposes independent with the same seed
+    enum class Salt : std::uint64_t {
+        Links = 1, Probabilities = 2, Seeds = 3
+    };
+
+    constexpr std::uint64_t salted(std::uint64_t seed, Salt salt) {
+        return mix64(seed + 0x632be59bd9b4e019 * static_cast<std::uint64_t>(salt));
+    }
+
+    /*!
+     * @brief R-MAT (recursive matrix, i.e. stochastic Kronecker) graph with 2^scale nodes and nLinks directed links.
+     *
+     * Each link picks one of the 4 quadrants of the adjacency matrix recursively with probabilities a, b, c, 1-a-b-c.
+     * Node indices are scrambled by a bijection so that high-degree nodes do not gather at small indices.
+     * Defaults (0.57, 0.19, 0.19) are from Graph500.
+     */
+    template <std::unsigned_integral Index>
+    EdgeList<Index> rmatEdges(std::size_t scale, std::size_t nLinks, std::uint64_t seed, std::size_t nThreads,
+                              double a = 0.57, double b = 0.19, double c = 0.19) {
+        if (scale == 0 || scale >= 48) {
+            throw std::out_of_range("R-MAT scale in [1, 47] is not satisfied");
+        }
+        if (a < 0.0 || b < 0.0 || c < 0.0 || a + b + c > 1.0) {
+            throw std::out_of_range("R-MAT probabilities a, b, c >= 0 and a + b + c <= 1 is not satisfied");
+        }
+        auto mask = (std::uint64_t{1} << scale) - 1;
+        auto shift = (scale + 1) / 2;
+        auto mul1 = salted(seed, Salt::Links) | 1;
+        auto mul2 = mix64(mul1) | 1;
+        auto add = mix64(mul2);
+        auto scramble = [&](std::uint64_t x) {
+            x = (x * mul1 + add) & mask;
+            x ^= x >> shift;
+            x = (x * mul2) & mask;
+            return x ^ (x >> shift);
+        };
+
+        auto edges = EdgeList<Index>(nLinks);
+        parallelForIndex(nThreads, nLinks, [&](std::size_t, std::size_t i) {
+            auto rng = StreamRng(seed, i);
+            auto u = std::uint64_t{0};
+            auto v = std::uint64_t{0};
+            for (std::size_t level = 0; level != scale; level++) {
+                auto r = rng.uniform();
+                u = (u << 1) | (r >= a + b);
+                v = (v << 1) | ((r >= a && r < a + b) || r >= a + b + c);
+            }
+            edges[i] = {(Index)scramble(u), (Index)scramble(v)};
+        });
+        return edges;
+    }
+
+    /*!
+     * @brief Erdős–Rényi graph G(n, M) with n nodes and nLinks directed links chosen uniformly (with replacement).
+     */
+    template <std::unsigned_integral Index>
+    EdgeList<Index> erdosRenyiEdges(std::size_t n, std::size_t nLinks, std::uint64_t seed, std::size_t nThreads) {
+        if (n < 2) {
+            throw std::out_of_range("n >= 2 is not satisfied");
+        }
+        auto edges = EdgeList<Index>(nLinks);
+        parallelForIndex(nThreads, nLinks, [&](std::size_t, std::size_t i) {
+            auto rng = StreamRng(seed, i);
+            auto u = rng.below(n);
+            auto v = rng.below(n - 1);
+            edges[i] = {(Index)u, (Index)(v < u ? v : v + 1)};
+        });
+        return edges;
+    }
+
+    /*!
+     * @brief Barabási–Albert graph with n nodes, each new node attaching to m existing nodes,
+     * with probability proportional to their degrees. Each attachment produces links of both directions.
+     *
+     * Attachments are resolved in parallel as described by Sanders & Schulz:
+     * the endpoints of all the attachments form a virtual array [0, src(0), dst(0), src(1), dst(1), ...],
+     * where src(j) = j / m + 1 is known directly, and dst(j) copies a uniformly random earlier entry of the array.
+     * Since dst(j) depends only on random values of attachments before j, it is computed without shared state.
+     */
+    template <std::unsigned_integral Index>
+    EdgeList<Index> barabasiAlbertEdges(std::size_t n, std::size_t m, std::uint64_t seed, std::size_t nThreads) {
+        if (n < 2 || m == 0) {
+            throw std::out_of_range("n >= 2 and m >= 1 is not satisfied");
+        }
+        auto nAttachments = (n - 1) * m;
+        auto edges = EdgeList<Index>(2 * nAttachments);
+        parallelForIndex(nThreads, nAttachments, [&](std::size_t, std::size_t j) {
+            auto source = j / m + 1;
+            auto target = std::size_t{0};
+            // dst(j) copies an entry in positions [0, 2j], i.e. the ones before src(j)
+            for (auto k = j, pos = StreamRng(seed, j).below(2 * j + 1); pos != 0; ) {
+                if (pos % 2 == 1) {
+                    target = (pos - 1) / 2 / m + 1;
+                    break;
+                }
+                k = (pos - 2) / 2;
+                pos = StreamRng(seed, k).below(2 * k + 1);
+            }
+            edges[2 * j] = {(Index)source, (Index)target};
+            edges[2 * j + 1] = {(Index)target, (Index)source};
+        });
+        return edges;
+    }
+
+    /*!
+     * @brief Grid graph with rows * cols nodes like a road network,
+     * where node (r, c) links with (r, c+1) and (r+1, c) in both directions.
+     *
+     * Besides, each node has a long-range shortcut to a uniformly random node (in both directions)
+     * with probability shortcutRate.
+     */
+    template <std::unsigned_integral Index>
+    EdgeList<Index> gridEdges(std::size_t rows, std::size_t cols, double shortcutRate,
+                              std::uint64_t seed, std::size_t nThreads) {
+        if (rows == 0 || cols == 0 || rows * cols < 2) {
+            throw std::out_of_range("rows * cols >= 2 is not satisfied");
+        }
+        auto n = rows * cols;
+        // 6 slots per node: right, down and shortcut, in both directions. Unused slots are self-loops.
+        auto edges = EdgeList<Index>(6 * n);
+        parallelForIndex(nThreads, n, [&](std::size_t, std::size_t u) {
+            auto slot = edges.begin() + (std::ptrdiff_t)(6 * u);
+            auto setPair = [&](std::size_t offset, std::size_t v) {
+                slot[offset] = {(Index)u, (Index)v};
+                slot[offset + 1] = {(Index)v, (Index)u};
+            };
+            auto r = u / cols;
+            auto c = u % cols;
+            setPair(0, c + 1 < cols ? u + 1 : u);
+            setPair(2, r + 1 < rows ? u + cols : u);
+            auto rng = StreamRng(seed, u);
+            setPair(4, rng.uniform() < shortcutRate ? rng.below(n) : u);
+        });
+        return edges;
+    }
+
+    // How (p, pBoost) of each link is assigned
+    enum class ProbabilityModel {
+        // p = 1 / in-degree of the target
+        WeightedCascade,
+        // p chosen uniformly from {0.1, 0.01, 0.001}
+        Trivalency,
+        // Constant p and pBoost for all the links
+        Uniform
+    };
+
+    struct ProbabilityArgs {
+        ProbabilityModel    model = ProbabilityModel::WeightedCascade;
+        // p and pBoost of Uniform model
+        double              p = 0.1;
+        double              pBoost = 0.2;
+        // pBoost = min(1, boostFactor * p) for WeightedCascade and Trivalency models
+        double              boostFactor = 2.0;
+    };
+
+    /*!
+     * @brief Builds the graph with n nodes from the edge list, dropping the self-loops.
+     *
+     * Links are indexed in the order of the edge list. All the steps run in parallel,
+     * and the edge list is released once the links are created, before the adjacency lists are filled.
+     *
+     * @param n Number of nodes. All the node indices in the edge list should be in [0, n)
+     * @param edges The edge list
+     * @param prob How (p, pBoost) of each link is assigned
+     * @param seed Random seed, used by Trivalency model only
+     * @param nThreads Number of threads
+     */
+    template <std::unsigned_integral Index>
+    IMMGraph buildGraph(std::size_t n, EdgeList<Index> edges, const ProbabilityArgs& prob,
+                        std::uint64_t seed, std::size_t nThreads) {
+        // Edges are processed in blocks, so that the link index of each edge is known from the prefix sum
+        //  of non-self-loop edges in the blocks before
+        constexpr std::size_t blockSize = 65536;
+        auto nBlocks = (edges.size() + blockSize - 1) / blockSize;
+        auto firstIndex = std::vector<std::size_t>(nBlocks + 1, 0);
+        auto inDegree = std::vector<std::size_t>(n, 0);
+        parallelForIndex(nThreads, nBlocks, [&](std::size_t, std::size_t b) {
+            for (auto i = b * blockSize, last = std::min(i + blockSize, edges.size()); i != last; i++) {
+                auto [u, v] = edges[i];
+                if (u >= n || v >= n) {
+                    throw std::out_of_range("invalid node index: from >= V or to >= V");
+                }
+                if (u != v) {
+                    firstIndex[b + 1] += 1;
+                    std::atomic_ref(inDegree[v]).fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        });
+        std::partial_sum(firstIndex.begin(), firstIndex.end(), firstIndex.begin());
+
+        auto probSeed = salted(seed, Salt::Probabilities);
+        auto links = std::vector<IMMLink>(firstIndex.back());
+        parallelForIndex(nThreads, nBlocks, [&](std::size_t, std::size_t b) {
+            auto index = firstIndex[b];
+            for (auto i = b * blockSize, last = std::min(i + blockSize, edges.size()); i != last; i++) {
+                auto [u, v] = edges[i];
+                if (u == v) {
+                    continue;
+                }
+                auto p = prob.p;
+                auto pBoost = prob.pBoost;
+                if (prob.model != ProbabilityModel::Uniform) {
+                    constexpr double trivalency[3] = {0.1, 0.01, 0.001};
+                    p = prob.model == ProbabilityModel::WeightedCascade
+                        ? 1.0 / (double)inDegree[v]
+                        : trivalency[StreamRng(probSeed, i).below(3)];
+                    pBoost = std::min(1.0, prob.boostFactor * p);
+                }
+                links[index] = IMMLink(u, v, index, p, pBoost);
+                index += 1;
+            }
+        });
+        edges = {};
+        inDegree = {};
+
+        auto graph = IMMGraph(graph::tags::reservesLater);
+        graph.reserve({{"nodes", n}});
+        for (std::size_t i = 0; i != n; i++) {
+            graph.fastAddNode(IMMNode(i));
+        }
+        graph.fastAddLinks(std::move(links), [&](std::size_t count, auto&& func) {
+            parallelForIndex(nThreads, count, [&](std::size_t, std::size_t i) {
+                func(i);
+            });
+        });
+        return graph;
+    }
+
+    // How the seed nodes are picked
+    enum class SeedPick {
+        // Uniformly random nodes without duplication
+        Uniform,
+        // Nodes with the highest out-degree, alternately to Sa and Sr
+        MaxDegree
+    };
+
+    /*!
+     * @brief Generates a seed set with nSa positive seeds and nSr negative seeds without duplication.
+     */
+    inline SeedSet makeSeedSet(const IMMGraph& graph, std::size_t nSa, std::size_t nSr,
+                               SeedPick pick, std::uint64_t seed) {
+        auto n = graph.nNodes();
+        if (nSa == 0 || nSr == 0 || nSa + nSr > n) {
+            throw std::out_of_range("nSa >= 1, nSr >= 1 and nSa + nSr <= |V| is not satisfied");
+        }
+        auto nodes = std::vector<std::size_t>{};
+        if (pick == SeedPick::Uniform) {
+            auto rng = StreamRng(salted(seed, Salt::Seeds), 0);
+            auto picked = std::unordered_set<std::size_t>{};
+            while (nodes.size() != nSa + nSr) {
+                if (auto v = rng.below(n); picked.insert(v).second) {
+                    nodes.push_back(v);
+                }
+            }
+        } else {
+            auto outDegree = std::vector<std::size_t>(n, 0);
+            for (const auto& e: graph.links()) {
+                outDegree[e.from()] += 1;
+            }
+            nodes.resize(n);
+            std::iota(nodes.begin(), nodes.end(), 0);
+            std::stable_sort(nodes.begin(), nodes.end(), [&](std::size_t a, std::size_t b) {
+                return outDegree[a] > outDegree[b];
+            });
+            // Alternately, so that Sa and Sr are similarly influential
+            auto Sa = std::vector<std::size_t>{};
+            auto Sr = std::vector<std::size_t>{};
+            for (auto v: nodes) {
+                auto toSa = Sr.size() == nSr || (Sa.size() != nSa && Sa.size() <= Sr.size());
+                (toSa ? Sa : Sr).push_back(v);
+                if (Sa.size() == nSa && Sr.size() == nSr) {
+                    break;
+                }
+            }
+            return {std::move(Sa), std::move(Sr)};
+        }
+        return {
+            std::vector<std::size_t>(nodes.begin(), nodes.begin() + (std::ptrdiff_t)nSa),
+            std::vector<std::size_t>(nodes.begin() + (std::ptrdiff_t)nSa, nodes.end())
+        };
+    }
+
+    // Prefix of the graph or seed set path indicating a generator specification instead of a file
+    constexpr std::string_view specPrefix = "gen:";
+
+    /*!
+     * @brief Whether the graph or seed set path is a generator specification.
+     */
+    inline bool isGeneratorSpec(std::string_view path) {
+        return path.starts_with(specPrefix);
+    }
+
+    /*!
+     * @brief Key-value options of a generator specification, e.g. "scale=20,degree=16".
+     *
+     * Each option should be read exactly once. Unused options are reported as errors by checkAllUsed().
+     */
+    class SpecOptions {
+    public:
+        explicit SpecOptions(std::string_view str) {
+            utils::cstr::splitByEither(str.data(), str.length(), ",; ", [&](std::string_view token) {
+                auto eq = token.find('=');
+                if (eq == std::string_view::npos) {
+                    throw std::invalid_argument(format("Missing value of generator option '{}'", token));
+                }
+                options[std::string(token.substr(0, eq))] = std::string(token.substr(eq + 1));
+            });
+        }
+
+        template <class T>
+        T get(const std::string& key, std::optional<T> alternative = std::nullopt) {
+            auto it = options.find(key);
+            if (it == options.end()) {
+                if (!alternative) {
+                    throw std::invalid_argument(format("Missing generator option '{}'", key));
+                }
+                return *alternative;
+            }
+            auto value = it->second;
+            options.erase(it);
+            if constexpr (std::is_same_v<T, utils::ci_string>) {
+                return T(value.data(), value.size());
+            } else {
+                return utils::fromString<T>(value);
+            }
+        }
+
+        void checkAllUsed() const {
+            if (!options.empty()) {
+                throw std::invalid_argument(format("Unknown generator option '{}'", options.begin()->first));
+            }
+        }
+
+    private:
+        std::map<std::string, std::string> options;
+    };
+
+    /*!
+     * @brief Generates a graph from the specification "gen:<kind>:<key>=<value>,...".
+     *
+     * Kinds and options (with default values):
+     *   - rmat (or kronecker): scale, degree = 16, a = 0.57, b = 0.19, c = 0.19.
+     *     2^scale nodes and 2^scale * degree links;
+     *   - er: n, degree = 16. n * degree links;
+     *   - ba: n, m = 8. 2 * (n-1) * m links;
+     *   - grid: rows, cols, shortcuts = 0. Shortcut rate per node.
+     *
+     * Common options: prob = wc | trivalency | uniform (default wc),
+     * p = 0.1 and pboost = 0.2 (uniform model only), boost = 2 (pBoost / p of the other models), seed = 0.
+     *
+     * e.g. "gen:rmat:scale=20,degree=16,prob=trivalency,seed=1"
+     *
+     * @param spec The specification
+     * @param nThreads Number of threads
+     */
+    inline IMMGraph generateGraph(std::string_view spec, std::size_t nThreads) {
+        if (isGeneratorSpec(spec)) {
+            spec.remove_prefix(specPrefix.length());
+        }
+        auto colon = spec.find(':');
+        auto kindStr = spec.substr(0, colon);
+        auto kind = utils::ci_string(kindStr.data(), kindStr.size());
+        auto opt = SpecOptions(colon == std::string_view::npos ? std::string_view{} : spec.substr(colon + 1));
+
+        auto seed = opt.get<std::uint64_t>("seed", 0);
+        auto prob = ProbabilityArgs{};
+        auto model = opt.get<utils::ci_string>("prob", "wc");
+        if (model == "wc") {
+            prob.model = ProbabilityModel::WeightedCascade;
+        } else if (model == "trivalency") {
+            prob.model = ProbabilityModel::Trivalency;
+        } else if (model == "uniform") {
+            prob.model = ProbabilityModel::Uniform;
+        } else {
+            throw std::invalid_argument(format("Unknown probability model '{}'", std::string_view(model.data(), model.size())));
+        }
+        prob.p = opt.get<double>("p", prob.p);
+        prob.pBoost = opt.get<double>("pboost", prob.pBoost);
+        prob.boostFactor = opt.get<double>("boost", prob.boostFactor);
+
+        auto n = std::size_t{};
+        auto linkSeed = salted(seed, Salt::Links);
+        // makeEdges(Index{}) generates the edge list with node indices of type Index
+        auto build = [&](auto&& makeEdges) {
+            opt.checkAllUsed();
+            if (n <= (std::size_t{1} << 32)) {
+                return buildGraph(n, makeEdges(std::uint32_t{}), prob, seed, nThreads);
+            }
+            return buildGraph(n, makeEdges(std::uint64_t{}), prob, seed, nThreads);
+        };
+        if (kind == "rmat" || kind == "kronecker") {
+            auto scale = opt.get<std::size_t>("scale");
+            auto degree = opt.get<std::size_t>("degree", 16);
+            auto a = opt.get<double>("a", 0.57);
+            auto b = opt.get<double>("b", 0.19);
+            auto c = opt.get<double>("c", 0.19);
+            n = std::size_t{1} << scale;
+            return build([&]<class Index>(Index) {
+                return rmatEdges<Index>(scale, n * degree, linkSeed, nThreads, a, b, c);
+            });
+        }
+        if (kind == "er") {
+            n = opt.get<std::size_t>("n");
+            auto degree = opt.get<std::size_t>("degree", 16);
+            return build([&]<class Index>(Index) {
+                return erdosRenyiEdges<Index>(n, n * degree, linkSeed, nThreads);
+            });
+        }
+        if (kind == "ba") {
+            n = opt.get<std::size_t>("n");
+            auto m = opt.get<std::size_t>("m", 8);
+            return build([&]<class Index>(Index) {
+                return barabasiAlbertEdges<Index>(n, m, linkSeed, nThreads);
+            });
+        }
+        if (kind == "grid") {
+            auto rows = opt.get<std::size_t>("rows");
+            auto cols = opt.get<std::size_t>("cols");
+            auto shortcuts = opt.get<double>("shortcuts", 0.0);
+            n = rows * cols;
+            return build([&]<class Index>(Index) {
+                return gridEdges<Index>(rows, cols, shortcuts, linkSeed, nThreads);
+            });
+        }
+        throw std::invalid_argument(format("Unknown graph generator '{}'", kindStr));
+    }
+
+    /*!
+     * @brief Generates a seed set from the specification "gen:<key>=<value>,...".
+     *
+     * Options (with default values): na = 10, nr = 10, pick = uniform | degree (default uniform), seed = 0.
+     *
+     * e.g. "gen:na=20,nr=20,pick=degree"
+     *
+     * @param graph The graph
+     * @param spec The specification
+     */
+    inline SeedSet generateSeedSet(const IMMGraph& graph, std::string_view spec) {
+        if (isGeneratorSpec(spec)) {
+            spec.remove_prefix(specPrefix.length());
+        }
+        auto opt = SpecOptions(spec);
+        auto nSa = opt.get<std::size_t>("na", 10);
+        auto nSr = opt.get<std::size_t>("nr", 10);
+        auto pickStr = opt.get<utils::ci_string>("pick", "uniform");
+        auto seed = opt.get<std::uint64_t>("seed", 0);
+        opt.checkAllUsed();
+
+        if (pickStr != "uniform" && pickStr != "degree") {
+            throw std::invalid_argument(format("Unknown seed picking strategy '{}'", std::string_view(pickStr.data(), pickStr.size())));
+        }
+        auto pick = pickStr == "uniform" ? SeedPick::Uniform : SeedPick::MaxDegree;
+        return makeSeedSet(graph, nSa, nSr, pick, seed);
+    }
+}
+
+#endif //DAWNSEEKER_GENERATORS_H
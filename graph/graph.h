@@ -5,7 +5,11 @@
 #ifndef DAWNSEEKER_GRAPH_GRAPH_H
 #define DAWNSEEKER_GRAPH_GRAPH_H
 
+#include <algorithm>
+#include <atomic>
+#include <iterator>
 #include <ranges>
+#include <vector>
 #include "basic.h"
 #include "indexmap.h"
 
@@ -139,6 +143,12 @@ namespace graph {
                 // If checking is disabled, it assumes that the node has never been added before
                 //  so that a new index is always assigned.
                 _fastSet(node, mappedIndex);
+                // Adjacency lists grow on demand if fewer nodes are reserved,
+                //  thus the reservation can be sized by the typical case rather than the worst case
+                if (mappedIndex >= _adjList.size()) {
+                    _adjList.resize(mappedIndex + 1);
+                    _invAdjList.resize(mappedIndex + 1);
+                }
             }
             // Returns a pointer to the node added
             return (_nodes.push_back(std::move(node)), _nodes.data() + mappedIndex);
@@ -290,18 +300,20 @@ namespace graph {
 
         // Resets the graph, memory space preserved
         // The last .reserve(args) call still works.
+        // Time complexity is O(|V| + |E|) of the current graph rather than the reserved size.
         void reserveClear() {
-            _nodes.clear();
-            _links.clear();
-            for (auto& e: _adjList) {
-                e.clear();
-            }
-            for (auto& e: _invAdjList) {
-                e.clear();
+            // Only the adjacency lists of added nodes may be non-empty
+            for (std::size_t i = 0; i != _nodes.size(); i++) {
+                _adjList[i].clear();
+                _invAdjList[i].clear();
             }
-            if constexpr (requires { _indexMap.reserveClear(); }) {
+            if constexpr (requires { _indexMap.reserveClear(_nodes); }) {
+                _indexMap.reserveClear(_nodes);
+            } else if constexpr (requires { _indexMap.reserveClear(); }) {
                 _indexMap.reserveClear();
             }
+            _nodes.clear();
+            _links.clear();
         }
 
     public:
@@ -389,6 +401,59 @@ namespace graph {
             );
         }
 
+        // Adds directed links in bulk, assuming the same as fastAddLink for each of them.
+        // The i-th link gets link index |E| + i, and the result is identical to adding them one by one,
+        //  while the adjacency lists are filled by parallelFor(count, func),
+        //  which calls func(i) for each i in [0, count), possibly concurrently.
+        // Not supported with fast access enabled.
+        template <class ParallelFor>
+        requires (!enablesFastRefLink)
+        void fastAddLinks(std::vector<Link> links, ParallelFor&& parallelFor) {
+            auto base = _links.size();
+            if (base == 0) {
+                _links = std::move(links);
+            } else {
+                _links.insert(_links.end(),
+                              std::make_move_iterator(links.begin()), std::make_move_iterator(links.end()));
+                links = {};
+            }
+            auto count = _links.size() - base;
+            auto n = _adjList.size();
+
+            // Counts the links from and to each node first
+            auto outPos = std::vector<std::size_t>(n, 0);
+            auto inPos = std::vector<std::size_t>(n, 0);
+            parallelFor(count, [&](std::size_t i) {
+                const auto& link = _links[base + i];
+                std::atomic_ref(outPos[_fastGet1(link)]).fetch_add(1, std::memory_order_relaxed);
+                std::atomic_ref(inPos[_fastGet2(link)]).fetch_add(1, std::memory_order_relaxed);
+            });
+            // Then each list is extended, and the counters turn to the positions of the next items to fill
+            parallelFor(n, [&](std::size_t u) {
+                auto outOld = _adjList[u].size();
+                _adjList[u].resize(outOld + outPos[u]);
+                outPos[u] = outOld;
+                auto inOld = _invAdjList[u].size();
+                _invAdjList[u].resize(inOld + inPos[u]);
+                inPos[u] = inOld;
+            });
+            parallelFor(count, [&](std::size_t i) {
+                auto idx = base + i;
+                auto u = _fastGet1(_links[idx]);
+                auto v = _fastGet2(_links[idx]);
+                _adjList[u][std::atomic_ref(outPos[u]).fetch_add(1, std::memory_order_relaxed)] = _makeRefLink(v, idx);
+                _invAdjList[v][std::atomic_ref(inPos[v]).fetch_add(1, std::memory_order_relaxed)] = _makeRefLink(u, idx);
+            });
+            // Items are filled in arbitrary order, thus the new ones (with link index >= base) in each list
+            //  are sorted by link index, i.e. the order of adding one by one
+            parallelFor(n, [&](std::size_t u) {
+                for (auto* list: {&_adjList[u], &_invAdjList[u]}) {
+                    auto first = std::ranges::partition_point(*list, [&](const auto& e) { return e.link < base; });
+                    std::sort(first, list->end(), [](const auto& a, const auto& b) { return a.link < b.link; });
+                }
+            });
+        }
+
         // Number of nodes
         [[nodiscard]] std::size_t nNodes() const {
             return _nodes.size();
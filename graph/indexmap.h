@@ -45,6 +45,8 @@ namespace graph {
      * .clear() clears the index map to initial state
      * .reserveClear() clears the index map, with the last reservation still works,
      *  which typically implies that no memory is deallocated
+     * .reserveClear(nodes) is the same as .reserveClear(), given all the nodes currently in the map
+     *  so that it's not necessary to visit the whole reserved space
      */
 
     /*
@@ -126,6 +128,15 @@ namespace graph {
             std::ranges::fill(_map, null);
         }
 
+        // Resets the index map, with _map still reserved by the maxIndex,
+        //  given all the nodes that have been set. Only their entries are reset.
+        template <std::ranges::range NodeRange>
+        void reserveClear(const NodeRange& nodes) {
+            for (const auto& node: nodes) {
+                _map[index(node)] = null;
+            }
+        }
+
     private:
         // Internal helper function to allocate and get a mapped index
         std::size_t _get(std::size_t id) {
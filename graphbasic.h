@@ -6,6 +6,7 @@
 #define DAWNSEEKER_GRAPHBASIC_H
 
 #include "immbasic.h"
+#include "thread.h"
 
 /*!
  * @brief Node type of the graph, which simply contains the index as an unsigned integer in the range [0, |V|-1]
@@ -151,6 +152,8 @@ class IMMLinkStateSamples {
     unsigned                globalTimestamp;
     std::vector<unsigned>   timestamps;
     std::vector<LinkState>  linkStates;
+    // Total number of link states sampled, for performance counters
+    std::uint64_t           sampledCount = 0;
 
 public:
     /*!
@@ -205,6 +208,7 @@ public:
         if (timestamps[link.index] != globalTimestamp) {
             timestamps[link.index] = globalTimestamp;
             linkStates[link.index] = getRandomState(link.p, link.pBoost);
+            sampledCount += 1;
         }
         return linkStates[link.index];
     }
@@ -231,6 +235,13 @@ public:
         globalTimestamp += 1;
     }
 
+    /*!
+     * @brief Gets the total number of link states sampled by this object since constructed.
+     */
+    [[nodiscard]] std::uint64_t nSampled() const {
+        return sampledCount;
+    }
+
     /*!
      * @brief Gets the number of links in this state collection object.
      * @return Graph size |E| in this object.
@@ -240,4 +251,95 @@ public:
     }
 };
 
+/*!
+ * @brief Concept of link state sources used during propagation,
+ *  e.g. IMMLinkStateSamples (sampled lazily) or IMMWorldBank::World (pre-sampled).
+ */
+template <class T>
+concept LinkStateSource = requires(T& states, const IMMLink& link) {
+    { states.get(link) } -> std::same_as<LinkState>;
+};
+
+/*!
+ * @brief A bank of pre-sampled worlds, i.e. the link states of all the links in each world.
+ *
+ * Each link state is stored compactly with 2 bits (Blocked = 1, Active = 2, Boosted = 3),
+ * thus R worlds take about R * |E| / 4 bytes in total.
+ * Evaluating different boosted node sets on the same bank uses common random numbers,
+ * and no sampling cost is paid during evaluation.
+ */
+class IMMWorldBank {
+    static constexpr std::size_t statesPerWord = 32;
+
+    std::size_t                 nWorlds_ = 0;
+    // Number of 64-bit words per world
+    std::size_t                 wordsPerWorld = 0;
+    std::vector<std::uint64_t>  words;
+
+public:
+    /*!
+     * @brief Read-only view of a single world in the bank.
+     */
+    class World {
+        const std::uint64_t* words;
+
+    public:
+        explicit World(const std::uint64_t* words): words(words) {}
+
+        [[nodiscard]] LinkState get(const IMMLink& link) const {
+            auto w = words[link.index / statesPerWord];
+            return static_cast<LinkState>((w >> (link.index % statesPerWord * 2)) & 3);
+        }
+    };
+
+    IMMWorldBank() = default;
+
+    /*!
+     * @brief Samples R worlds of the graph.
+     *
+     * Each world is sampled with its own random generator, thus sampling is distributed to multiple threads.
+     *
+     * @param graph The whole graph
+     * @param nWorlds R, Number of worlds to sample
+     * @param nThreads How many threads used for sampling
+     */
+    IMMWorldBank(const IMMGraph& graph, std::size_t nWorlds, std::size_t nThreads = 1):
+    nWorlds_(nWorlds), wordsPerWorld((graph.nLinks() + statesPerWord - 1) / statesPerWord),
+    words(nWorlds * wordsPerWorld, 0) {
+        auto seeds = std::vector<unsigned>(nWorlds);
+        auto seedGen = createMT19937Generator();
+        rs::generate(seeds, [&]() { return (unsigned)seedGen() | 1u; });
+
+        parallelForIndex(nThreads, nWorlds, [&](std::size_t, std::size_t r) {
+            auto gen = createMT19937Generator(seeds[r]);
+            auto* dest = words.data() + r * wordsPerWorld;
+            for (const auto& link: graph.links()) {
+                auto state = static_cast<std::uint64_t>(getRandomState(gen, link.p, link.pBoost));
+                dest[link.index / statesPerWord] |= state << (link.index % statesPerWord * 2);
+            }
+        });
+    }
+
+    /*!
+     * @brief Gets the r-th world in the bank.
+     */
+    [[nodiscard]] World world(std::size_t r) const {
+        return World(words.data() + r * wordsPerWorld);
+    }
+
+    /*!
+     * @brief Gets the number of worlds R.
+     */
+    [[nodiscard]] std::size_t nWorlds() const {
+        return nWorlds_;
+    }
+
+    /*!
+     * @brief Gets the total bytes used by the bank.
+     */
+    [[nodiscard]] std::size_t totalBytesUsed() const {
+        return sizeof(IMMWorldBank) + words.size() * sizeof(std::uint64_t);
+    }
+};
+
 #endif //DAWNSEEKER_GRAPHBASIC_H
@@ -9,7 +9,11 @@
 
 #include "immbasic.h"
 #include "Logger.h"
+#include "memory.h"
+#include "metrics.h"
+#include "perf.h"
 #include "PRRGraph.h"
+#include "trace.h"
 
 namespace {
     auto fineTunedSelect(const std::vector<double>& values) {
@@ -54,12 +58,18 @@ struct PRRGraphCollection {
     struct SimplifiedPRRGraph {
         NodeState           centerState;
         std::vector<Node>   items;
+
+        [[nodiscard]] std::size_t totalBytesUsed() const {
+            return sizeof(SimplifiedPRRGraph) - sizeof(items) + utils::totalBytesUsed(items);
+        }
     };
 
     // Number of nodes in the graph, i.e. |V|
     std::size_t n{};
     // Seed set
     SeedSet seeds;
+    // Node state priority and gain with which the PRR-sketches are evaluated
+    NodeStateContext stateCtx;
     // prrGraph[i] = the i-th PRR-sketch
     std::vector<SimplifiedPRRGraph> prrGraph;
     // contrib[v] = All the PRR-sketches where boosted node v changes the center node's state
@@ -69,6 +79,8 @@ struct PRRGraphCollection {
     std::vector<std::vector<Node>> contrib;
     // totalGain[v] = total gain of the node v
     std::vector<double> totalGain;
+    // All the nodes v with contrib[v] non-empty, i.e. with non-zero totalGain[v]
+    std::vector<std::size_t> touchedNodes;
 
     /*!
      * @brief Default construction. Initialization must be done later
@@ -76,45 +88,69 @@ struct PRRGraphCollection {
     PRRGraphCollection() = default;
 
     /*!
-     * @brief Constructs with graph size |V| and the seed set. Equivalent to init(n, seeds).
+     * @brief Constructs with graph size |V|, the seed set and the node state context.
+     *        Equivalent to init(n, seeds, stateCtx).
      * @param n The graph size |V|
      * @param seeds The seed set object.
+     * @param stateCtx The node state priority and gain
      */
-    explicit PRRGraphCollection(std::size_t n, SeedSet seeds) :
-            n(n), seeds(std::move(seeds)), contrib(n), totalGain(n, 0.0) {
+    explicit PRRGraphCollection(std::size_t n, SeedSet seeds, const NodeStateContext& stateCtx) :
+            n(n), seeds(std::move(seeds)), stateCtx(stateCtx), contrib(n), totalGain(n, 0.0) {
     }
 
     // Initializes with |V| and the seed set
 
     /*!
-     * @brief Initializes with graph size |V| and the seed set.
+     * @brief Initializes with graph size |V|, the seed set and the node state context.
      * @param n The graph size |V|
      * @param seeds The seed set object.
+     * @param stateCtx The node state priority and gain
      */
-    void init(std::size_t _n, SeedSet _seeds) {
+    void init(std::size_t _n, SeedSet _seeds, const NodeStateContext& _stateCtx) {
         this->n = _n;
         this->seeds = std::move(_seeds);
+        this->stateCtx = _stateCtx;
         contrib.clear();
         contrib.resize(_n);
         totalGain.resize(_n, 0.0);
+        touchedNodes.clear();
+    }
+
+    /*!
+     * @brief Removes all the PRR-sketches, with |V|, the seed set and the node state context kept.
+     *
+     * Time complexity is linear to the contents removed rather than |V|,
+     * thus a collection can be reused as a fragment of multiple rounds cheaply.
+     */
+    void clearSketches() {
+        prrGraph.clear();
+        for (auto v: touchedNodes) {
+            contrib[v] = {};
+            totalGain[v] = 0.0;
+        }
+        touchedNodes.clear();
     }
 
     /*!
      * @brief Adds a PRR-sketch.
      * @param G The prr-sketch graph object.
+     * @return false if the PRR-sketch is skipped since no node makes positive gain, true otherwise.
      */
-    void add(const PRRGraph& G) {
+    bool add(const PRRGraph& G) {
         auto prrList = std::vector<Node>();
         // Index of the PRR-sketch to be added
         auto prrListId = prrGraph.size();
 
         for (const auto& node: G.nodes()) {
-            double nodeGain = gain(node.centerStateTo) - gain(G.centerState);
+            double nodeGain = stateCtx.gain(node.centerStateTo) - stateCtx.gain(G.centerState);
             // Zero-gain nodes are skipped to save memory usage
             if (nodeGain <= 0.0) {
                 continue;
             }
             auto v = node.index();
+            if (contrib[v].empty()) {
+                touchedNodes.push_back(v);
+            }
             // Boosted node v, and the state changes the center node will change to
             prrList.push_back(Node{.index = v, .centerStateTo = node.centerStateTo});
             // Boosted node v has influence on current PRR-sketch
@@ -123,44 +159,86 @@ struct PRRGraphCollection {
         }
 
         // Empty PRR-sketch (if no node makes positive gain) is also skipped to same memory usage
-        if (!prrList.empty()) {
-            prrGraph.push_back(
-                SimplifiedPRRGraph{
-                    .centerState = G.centerState,
-                    .items = std::move(prrList)
-                }
-            );
+        if (prrList.empty()) {
+            return false;
+        }
+        prrGraph.push_back(
+            SimplifiedPRRGraph{
+                .centerState = G.centerState,
+                .items = std::move(prrList)
+            }
+        );
+        return true;
+    }
+
+    /*!
+     * @brief Replaces the node state context, and recomputes the total gain of each node with its gains.
+     *
+     * Nodes making zero gain are skipped when a PRR-sketch is added,
+     * thus the result equals adding all the PRR-sketches again only if the sign of each gain difference is unchanged,
+     * e.g. for lambda in (0, 1) both before and after.
+     * The priority shall be unchanged since the PRR-sketches depend on it.
+     *
+     * @param _stateCtx The new node state context
+     */
+    void recomputeGains(const NodeStateContext& _stateCtx) {
+        this->stateCtx = _stateCtx;
+        for (auto v: touchedNodes) {
+            totalGain[v] = 0.0;
+        }
+        for (const auto& [centerState, items]: prrGraph) {
+            for (auto [v, centerStateTo]: items) {
+                totalGain[v] += stateCtx.gain(centerStateTo) - stateCtx.gain(centerState);
+            }
         }
     }
 
     /*!
      * @brief Merges two PRR-sketch collections by appending the given one to this.
+     *
+     * Both shall be evaluated with the same node state context.
+     * PRR-sketches are moved from the given one, which is cleared afterwards (see clearSketches).
+     * Time complexity is linear to the contents of the given one rather than |V|.
+     *
      * @param other The PRR-sketch collection to be appended.
      */
-    void merge(const PRRGraphCollection& other) {
+    void merge(PRRGraphCollection& other) {
+        auto phase = metrics::ScopedPhase(metrics::Phase::Merge);
+        auto scope = memory::ScopedSubsystem(memory::Subsystem::Sketches);
+        auto kernel = perf::ScopedKernel(perf::Kernel::Merge);
+        auto event = trace::ScopedEvent("merge");
         // Let R1 = Size of this->prrGraph, R2 = Size of other.prrGraph
         // for each [i, centerStateTo] in each other.contrib[v],
         //  the PRR-sketch index should shift by R1, i.e. [i + R1, centerStateTo] added to this->contrib[v]
         auto offset = prrGraph.size();
         // Step 1: Moves all the PRR-sketch to this->prrGraph
         rs::move(other.prrGraph, std::back_inserter(prrGraph));
-        // Step 2: Merges contribution of each node v, with PRR-sketch index shifted by R1
-        for (std::size_t v = 0; v < n; v++) {
+        // Step 2: Merges contribution of each node v, with PRR-sketch index shifted by R1.
+        //  Only the nodes touched by the other one have any contribution.
+        for (auto v: other.touchedNodes) {
+            if (contrib[v].empty()) {
+                touchedNodes.push_back(v);
+            }
             for (auto [i, s]: other.contrib[v]) {
                 contrib[v].push_back(Node{.index = offset + i, .centerStateTo = s});
             }
-        }
-        // Step 3: Sums up total gain of each node v
-        for (std::size_t v = 0; v < n; v++) {
+            // Step 3: Sums up total gain of each node v
             totalGain[v] += other.totalGain[v];
         }
+        other.clearSketches();
     }
 
 private:
-    // Helper non-const function of greedy selection
-    template <class OutIter>
+    // Helper non-const function of greedy selection, with the node state priority fixed at compile time
+    template <class Priority, class OutIter>
     requires std::output_iterator<OutIter, std::size_t> || std::same_as<OutIter, std::nullptr_t>
-    double _select(std::size_t k, OutIter iter) const {
+    double _select(Priority, std::size_t k, OutIter iter) const {
+        auto phase = metrics::ScopedPhase(metrics::Phase::Selection);
+        auto scope = memory::ScopedSubsystem(memory::Subsystem::Selection);
+        auto kernel = perf::ScopedKernel(perf::Kernel::Select);
+        auto event = trace::ScopedEvent("select");
+        // Number of updates to totalGainCopy[], for performance counters
+        auto nUpdates = std::uint64_t{0};
         double res = 0.0;
         // Makes a copy of the totalGain[] to update values during selection
         auto totalGainCopy = totalGain;
@@ -194,24 +272,25 @@ private:
             // Impose influence to all the PRR-sketches by node v
             for (auto[prrId, centerStateTo]: contrib[v]) {
                 // Attempts to update the center state of current PRR-sketch...
-                auto cmp = centerStateTo <=> centerStateCopy[prrId];
                 // ...only if the update makes higher priority.
                 // (otherwise, the PRR-sketch may have been updated by other selected boosted nodes)
-                if (cmp != std::strong_ordering::greater) {
+                if (!Priority::higher(centerStateTo, centerStateCopy[prrId])) {
                     continue;
                 }
-                double curGain = gain(centerStateTo) - gain(centerStateCopy[prrId]);
+                double curGain = stateCtx.gain(centerStateTo) - stateCtx.gain(centerStateCopy[prrId]);
                 // After the center state of the prrId-th PRR-sketch changed from C0 to C1,
                 //  all other nodes that may change the same PRR-sketch will make lower gain,
                 //  from (C2 - C0) to (C2 - C1), diff = C1 - C0
                 for (const auto&[j, s]: prrGraph[prrId].items) {
                     totalGainCopy[j] -= curGain;
                 }
+                nUpdates += prrGraph[prrId].items.size();
                 // Updates state of the prrId-th PRR-sketch
                 centerStateCopy[prrId] = centerStateTo;
             }
         }
 
+        metrics::add(metrics::Counter::SelectionUpdates, nUpdates);
         return res;
     }
 
@@ -237,7 +316,9 @@ public:
     template <class OutIter>
     requires std::output_iterator<OutIter, std::size_t> || std::same_as<OutIter, std::nullptr_t>
     double select(std::size_t k, OutIter iter = nullptr) const {
-        return _select(k, iter);
+        return stateCtx.visitPriority([&](auto priority) {
+            return _select(priority, k, iter);
+        });
     }
 
     /*!
@@ -245,14 +326,16 @@ public:
      * @return Estimated total bytes used.
      */
     [[nodiscard]] std::size_t totalBytesUsed() const {
-        // n and seeds
-        auto bytes = sizeof(n) + seeds.totalBytesUsed();
+        // n, seeds and the node state context
+        auto bytes = sizeof(n) + seeds.totalBytesUsed() + sizeof(stateCtx);
         // Total bytes of prrGraph[][]
         bytes += utils::totalBytesUsed(prrGraph);
         // Total bytes of contrib[][]
         bytes += utils::totalBytesUsed(contrib);
         // Total bytes of totalGain[]
         bytes += utils::totalBytesUsed(totalGain);
+        // Total bytes of touchedNodes[]
+        bytes += utils::totalBytesUsed(touchedNodes);
 
         return bytes;
     }
@@ -420,8 +503,14 @@ private:
     template <HowToChoose how, class OutIter>
     requires (std::output_iterator<OutIter, std::size_t> || std::same_as<OutIter, std::nullptr_t>)
     double _select(std::size_t k, OutIter iter = nullptr) {
+        auto phase = metrics::ScopedPhase(metrics::Phase::Selection);
+        auto scope = memory::ScopedSubsystem(memory::Subsystem::Selection);
+        auto kernel = perf::ScopedKernel(perf::Kernel::Select);
+        auto event = trace::ScopedEvent("select");
         // First prepares gainsByBoosted[][]
         _prepareGainsByBoosted();
+        // Number of updates to totalGainsBy[], for performance counters
+        auto nUpdates = std::uint64_t{0};
 
         double res = 0.0;
         auto selected = std::vector<std::size_t>();
@@ -440,6 +529,7 @@ private:
                 for (const auto&[v, g]: gainsByBoosted[s]) {
                     totalGainsBy[s] += std::max(0.0, g - maxGainTo[v]);
                 }
+                nUpdates += gainsByBoosted[s].size();
             }
             // Seed nodes and previously selected nodes shall not be selected
             utils::ranges::concatForEach([&](std::size_t v) {
@@ -468,7 +558,7 @@ private:
                     }
                 );
                 // Picks one of the k candidates uniformly randomly
-                static auto gen = createMT19937Generator();
+                thread_local auto gen = createMT19937Generator();
                 auto dist = std::uniform_int_distribution<std::size_t>(0, nCandidates - 1);
                 cur = indices[dist(gen)];
             }
@@ -487,6 +577,7 @@ private:
             }
         }
 
+        metrics::add(metrics::Counter::SelectionUpdates, nUpdates);
         return res;
     }
 
@@ -2,21 +2,163 @@
 // Created by Onlynagesha on 2022/5/7.
 //
 
+#include <fstream>
 #include <future>
+#include <optional>
 #include <queue>
+#include "budget.h"
 #include "global.h"
 #include "graph/pagerank.h"
 #include "greedyselect.h"
 #include "imm.h"
+#include "memory.h"
+#include "metrics.h"
 #include "ProgressCounter.h"
 #include "simulate.h"
+#include "sketchcache.h"
 #include "thread.h"
+#include "trace.h"
 
 struct GenerateSamplesResult {
     PRRGraphCollection  prrCollection;
     std::uint64_t       prrCount{};
+    // Lower bound of OPT, 1 if the early-stop condition is never satisfied
+    double              LB{};
 };
 
+// How many samples a worker generates between two memory checks of the budget
+constexpr std::uint64_t budgetCheckInterval = 64;
+
+/*!
+ * @brief Checks the budget cooperatively inside a sampling task.
+ *
+ * The time limit is checked before each sample,
+ * and the memory limit once per budgetCheckInterval samples
+ * since reading the resident set size (without the counting allocator) is costlier.
+ *
+ * @param budget The budget object
+ * @param nDone Number of samples generated by the current worker
+ * @return true if the budget is exhausted, and then no more samples should be generated.
+ */
+bool budgetExhausted(ResourceBudget& budget, std::uint64_t nDone) {
+    return nDone % budgetCheckInterval == 0 ? budget.check() : budget.checkTime();
+}
+
+/*!
+ * @brief Gets the approximation error epsilon achieved by PR-IMM with R PRR-sketches.
+ *
+ * Solves R = 2n * (alpha + beta)^2 / (LB * epsilon^2) for epsilon, i.e. the inverse of final theta.
+ *
+ * @param args Arguments of the algorithm
+ * @param ell The algorithm parameter ell that alpha and beta depend on
+ * @param LB Lower bound of OPT
+ * @param prrCount R, number of PRR-sketches
+ * @return The epsilon value, or halfMax<double> if unknown.
+ */
+double achievedEpsilon_PR_IMM(const BasicArgs& args, double ell, double LB, std::uint64_t prrCount) {
+    if (LB <= 0.0 || prrCount == 0) {
+        return halfMax<double>;
+    }
+    auto alpha = BasicArgs::delta * std::sqrt(ell * args.lnN + ns::ln2);
+    auto beta = std::sqrt(BasicArgs::delta * (ell * args.lnN + args.lnCnk + ns::ln2));
+    return std::sqrt(2.0 * (double)args.n * std::pow(alpha + beta, 2.0) / LB / (double)prrCount);
+}
+
+/*!
+ * @brief Gets a lower bound of OPT established by R PRR-sketches of fixed sample size.
+ *
+ * Uses the same test as the doubling rounds of dynamic PR-IMM:
+ * if R >= (2 + 2/3 * eps') * (ln C(n, k) + ell * ln n) * n / (eps'^2 * x) and n * S >= (1 + eps') * x,
+ * then OPT >= x with probability at least 1 - n^(-ell), where S is the average gain of the greedy selection.
+ * The bias of S towards the sketches it is selected on is covered by the union bound over all the k-subsets,
+ * thus S can be taken on the same sketches.
+ * Let x = n * S / (1 + eps'), the smallest eps' satisfying the condition is solved by bisection.
+ *
+ * @param args Arguments of the algorithm
+ * @param ell The algorithm parameter ell
+ * @param S Average gain of the selected boosted nodes in all the PRR-sketches
+ * @param prrCount R, number of PRR-sketches
+ * @return The lower bound, or 0.0 if no lower bound can be established.
+ */
+double lowerBoundOfOPT_PR_IMM(const BasicArgs& args, double ell, double S, std::uint64_t prrCount) {
+    // (2 + 2/3 * eps') * (1 + eps') / eps'^2 is monotonically decreasing, towards 2/3 as eps' -> +inf
+    auto required = [&](double eps) {
+        return (2.0 + 2.0 * eps / 3.0) * (1.0 + eps) / std::pow(eps, 2.0) * (args.lnCnk + ell * args.lnN);
+    };
+    auto RS = (double)prrCount * S;
+    if (S <= 0.0 || RS <= required(1e9)) {
+        return 0.0;
+    }
+    // Bisection in logarithm scale
+    auto lo = 1e-9, hi = 1e9;
+    for (int i = 0; i < 200; i++) {
+        auto mid = std::sqrt(lo * hi);
+        (required(mid) > RS ? lo : hi) = mid;
+    }
+    return S * (double)args.n / (1.0 + hi);
+}
+
+/*!
+ * @brief Gets the approximation error epsilon achieved by SA-IMM-LB or SA-RG-IMM-LB with R samples per center.
+ *
+ * theta(kappa) in ArgsSampleSizeDynamic_SA_IMM_LB is monotonically decreasing,
+ * thus theta(kappa) = R is solved by bisection, and then epsilon = 2 * delta * kappa / (1 + kappa).
+ *
+ * @param args Arguments of the algorithm
+ * @param ell The algorithm parameter ell
+ * @param nSamples R, number of samples of every center node
+ * @return The epsilon value, or halfMax<double> if unknown.
+ */
+double achievedEpsilon_SA_IMM_LB(const BasicArgs& args, double ell, std::uint64_t nSamples) {
+    if (nSamples == 0) {
+        return halfMax<double>;
+    }
+    double deltaUsed = (args.algo == AlgorithmLabel::SA_RG_IMM) ? BasicArgs::deltaRG : BasicArgs::delta;
+    auto theta = [&](double kappa) {
+        return (2.0 + 2.0 * kappa / 3.0) *
+               (1.0 + deltaUsed + kappa) *
+               ((ell + 1.0) * args.lnN + ns::ln2) /
+               ((2.0 + deltaUsed) * std::pow(kappa, 3.0));
+    };
+    // Bisection in logarithm scale
+    auto lo = 1e-9, hi = 1e9;
+    for (int i = 0; i < 200; i++) {
+        auto mid = std::sqrt(lo * hi);
+        (theta(mid) > (double)nSamples ? lo : hi) = mid;
+    }
+    return 2.0 * deltaUsed * hi / (1.0 + hi);
+}
+
+/*!
+ * @brief Writes the best-so-far result to args.resultPath, replacing the old one. Does nothing if disabled.
+ *
+ * The file is written to a temporary one first and then renamed,
+ * so that the file is always complete even if the program is killed during writing.
+ *
+ * @param args Arguments of the algorithm
+ * @param nSamples Sample size of the result
+ * @param item The result item
+ */
+void writeBestSoFar(const BasicArgs& args, std::uint64_t nSamples, const IMMResultItem& item) {
+    if (args.resultPath.empty()) {
+        return;
+    }
+    auto tempPath = args.resultPath + ".tmp";
+    {
+        auto fout = std::ofstream(tempPath);
+        fout << format("algo = {}\nnSamples = {}\nresult = {}\n", args.algo, nSamples, toString(item));
+        if (!fout) {
+            LOG_WARNING(format("Failed to write the best-so-far result to '{}'", tempPath));
+            return;
+        }
+    }
+    auto ec = std::error_code{};
+    fs::rename(tempPath, args.resultPath, ec);
+    if (ec) {
+        LOG_WARNING(format("Failed to write the best-so-far result to '{}': {}", args.resultPath, ec.message()));
+    }
+}
+
 /*!
  * @brief Generates one PRR-sketch. For monotonic & submodular cases only.
  *
@@ -27,6 +169,7 @@ struct GenerateSamplesResult {
  * @param linkStates The link states object
  * @param prrGraph The PRR-sketch object where the result is written
  * @param seeds The seed set
+ * @param stateCtx The node state priority and gain
  * @param center The center node selected
  */
 void makeSketchFast(PRRGraphCollection&     prrCollection,
@@ -34,19 +177,67 @@ void makeSketchFast(PRRGraphCollection&     prrCollection,
                     IMMLinkStateSamples&    linkStates,
                     PRRGraph&               prrGraph,
                     const SeedSet&          seeds,
+                    const NodeStateContext& stateCtx,
                     std::size_t             center) {
+    auto event = trace::ScopedEvent("makeSketchFast");
     // Gets a PRR-sketch with the specified center
-    samplePRRSketch(graph, linkStates, prrGraph, seeds, center);
+    auto nSampledBefore = linkStates.nSampled();
+    samplePRRSketch(graph, linkStates, prrGraph, seeds, stateCtx, center);
+    metrics::recordSketch(prrGraph.nNodes(), prrGraph.nLinks(), linkStates.nSampled() - nSampledBefore);
     // For monotonic cases, boosting never improves the gain of center node
     //  if center is in Ca state (Ca has the highest gain already)
     if (prrGraph[center].state == NodeState::Ca) {
+        metrics::add(metrics::Counter::EmptySketches);
         return;
     }
     // Calculates each gain(v; prrGraph, center) for v in prrGraph
     // gain is implied as gain(v.centerStateTo) - gain(center.state)
-    calculateCenterStateToFast(prrGraph);
+    calculateCenterStateToFast(prrGraph, stateCtx);
     // Adds the PRR-sketch to the collection
-    prrCollection.add(prrGraph);
+    if (!prrCollection.add(prrGraph)) {
+        metrics::add(metrics::Counter::EmptySketches);
+    }
+}
+
+/*!
+ * @brief Sampling context of a worker, created once per run and reused by all the sampling rounds.
+ *
+ * The PRR-sketch object reserves only its index map (|V| + 1 entries) at first.
+ * Its node and link buffers grow to the largest sketch observed by this worker
+ * instead of being reserved for the worst case |V| and |E|,
+ * and clearing it before each sampling costs O(size of the last sketch).
+ */
+struct SamplingContext {
+    // PRR-sketch object for reusing
+    PRRGraph                prrGraph;
+    // Link state object for reusing
+    IMMLinkStateSamples     linkStates;
+    // Fragment of PR-IMM results, merged and cleared after each round
+    PRRGraphCollection      collection;
+    // Gains by each boosted node of SA-IMM
+    std::vector<double>     gainsByBoosted;
+
+    SamplingContext(const IMMGraph& graph, const SeedSet& seeds, const NodeStateContext& stateCtx):
+    prrGraph({{"maxIndex", graph.nNodes()}}), linkStates(graph.nLinks()), collection(graph.nNodes(), seeds, stateCtx) {}
+};
+
+/*!
+ * @brief Creates the sampling contexts of all the workers.
+ * @param graph The whole graph
+ * @param seeds The seed set
+ * @param stateCtx The node state priority and gain
+ * @param nThreads Number of threads to use
+ * @return A list of nThreads sampling contexts
+ */
+auto makeSamplingContexts(const IMMGraph& graph, const SeedSet& seeds, const NodeStateContext& stateCtx,
+                          std::size_t nThreads) {
+    auto scope = memory::ScopedSubsystem(memory::Subsystem::Workspace);
+    auto contexts = std::vector<SamplingContext>{};
+    contexts.reserve(nThreads);
+    for (std::size_t i = 0; i < nThreads; i++) {
+        contexts.emplace_back(graph, seeds, stateCtx);
+    }
+    return contexts;
 }
 
 /*!
@@ -55,95 +246,197 @@ void makeSketchFast(PRRGraphCollection&     prrCollection,
  * The results will be written to prrCollection object.
  *
  * @param prrCollection The PRR-sketch collection object where the results are written
+ * @param contexts The sampling contexts of each worker
  * @param graph The whole graph
  * @param seeds The seed set
+ * @param stateCtx The node state priority and gain
  * @param nSamples Number of samples to generate
- * @param nThreads Number of threads to use
+ * @param budget The budget object. Sampling stops early once it is exhausted.
+ * @param logPerPercentage Progress is logged every logPerPercentage percent of nSamples
+ * @return Number of samples actually generated, less than nSamples if the budget is exhausted.
  */
-void makeSketchesFast(PRRGraphCollection&   prrCollection,
-                      const IMMGraph&       graph,
-                      const SeedSet&        seeds,
-                      std::uint64_t         nSamples,
-                      std::size_t           nThreads) {
-    // PRR-sketch objects for reusing in each thread
-    auto prrGraphPool = std::vector<PRRGraph>{};
-    // Link state objects for reusing in each thread
-    auto linkStatesPool = std::vector<IMMLinkStateSamples>{};
-    // PRR-sketch collection objects for each thread
-    auto prrCollectionPool = std::vector<PRRGraphCollection>{};
-
-    for (std::size_t i = 0; i < nThreads; i++) {
-        // Reserves before calling
-        prrGraphPool.push_back(PRRGraph{{
-            {"nodes", graph.nNodes()},
-            {"links", graph.nLinks()},
-            {"maxIndex", graph.nNodes()}
-        }});
-        // Reserves before calling
-        linkStatesPool.emplace_back(graph.nLinks());
-        // Initializes before calling
-        prrCollectionPool.emplace_back(graph.nNodes(), seeds);
-    }
-
-    // Uniformly generates a center node in [0, n) each time
-    static auto gen = createMT19937Generator();
-    auto distCenter = std::uniform_int_distribution<std::size_t>(0, graph.nNodes() - 1);
-
-    runTaskGroup(vs::iota(std::size_t{0}, nThreads) | vs::transform([&](std::size_t tid) {
-        return [&, tid](std::size_t v) {
-            auto& linkState     = linkStatesPool[tid];
-            auto& prrGraph      = prrGraphPool[tid];
-            auto& collection    = prrCollectionPool[tid];
-            makeSketchFast(collection, graph, linkState, prrGraph, seeds, v);
-        };
-    }), vs::iota(std::uint64_t{0}, nSamples) | vs::transform([&](auto){return distCenter(gen);}));
+std::uint64_t makeSketchesFast(PRRGraphCollection&           prrCollection,
+                               std::vector<SamplingContext>& contexts,
+                               const IMMGraph&               graph,
+                               const SeedSet&                seeds,
+                               const NodeStateContext&       stateCtx,
+                               std::uint64_t                 nSamples,
+                               ResourceBudget&               budget,
+                               double                        logPerPercentage) {
+    // Each worker reports its progress per progressBatch samples to keep the shared counter cold
+    constexpr auto progressBatch = std::uint64_t{64};
+    auto progress = ProgressCounter("PR-IMM sampling", nSamples, logPerPercentage);
+    // counts[i] = Number of samples generated by worker #i
+    auto counts = std::vector<std::uint64_t>(contexts.size(), 0);
+    {
+        auto phase = metrics::ScopedPhase(metrics::Phase::Sampling);
+        auto scope = memory::ScopedSubsystem(memory::Subsystem::Sketches);
+        parallelForIndex(contexts.size(), nSamples, [&](std::size_t tid, std::size_t) {
+            if (budgetExhausted(budget, counts[tid])) {
+                return;
+            }
+            // Uniformly generates a center node in [0, n), with the random generator of each worker
+            auto v = std::uniform_int_distribution<std::size_t>(0, graph.nNodes() - 1)(
+                    threadLocalMT19937Generator());
+            auto& ctx = contexts[tid];
+            makeSketchFast(ctx.collection, graph, ctx.linkStates, ctx.prrGraph, seeds, stateCtx, v);
+            if (++counts[tid] % progressBatch == 0) {
+                progress.increment(progressBatch);
+            }
+        });
+    }
+    // Reports the remaining samples of each worker
+    auto nRemaining = std::uint64_t{0};
+    for (auto c: counts) {
+        nRemaining += c % progressBatch;
+    }
+    progress.increment(nRemaining);
 
     // Merges all the result fragments
-    for (std::size_t i = 0; i < nThreads; i++) {
-        prrCollection.merge(prrCollectionPool[i]);
+    for (auto& ctx: contexts) {
+        prrCollection.merge(ctx.collection);
     }
+    return std::accumulate(counts.begin(), counts.end(), std::uint64_t{0});
 }
 
-void makeSketchesFast(PRRGraphCollection&   prrCollection,
-                      const IMMGraph&       graph,
-                      const SeedSet&        seeds,
-                      rs::range auto&&      centerList,
-                      std::size_t           nThreads) {
-    // PRR-sketch objects for reusing in each thread
-    auto prrGraphPool = std::vector<PRRGraph>{};
-    // Link state objects for reusing in each thread
-    auto linkStatesPool = std::vector<IMMLinkStateSamples>{};
-    // PRR-sketch collection objects for each thread
-    auto prrCollectionPool = std::vector<PRRGraphCollection>{};
-
-    for (std::size_t i = 0; i < nThreads; i++) {
-        // Reserves before calling
-        prrGraphPool.push_back(PRRGraph{{
-                {"nodes", graph.nNodes()},
-                {"links", graph.nLinks()},
-                {"maxIndex", graph.nNodes()}
-        }});
-        // Reserves before calling
-        linkStatesPool.emplace_back(graph.nLinks());
-        // Initializes before calling
-        prrCollectionPool.emplace_back(graph.nNodes(), seeds);
-    }
-
-    runTaskGroup(vs::iota(std::size_t{0}, nThreads) | vs::transform([&](std::size_t tid) {
-        return [&, tid](std::size_t v) {
-            auto& linkState     = linkStatesPool[tid];
-            auto& prrGraph      = prrGraphPool[tid];
-            auto& collection    = prrCollectionPool[tid];
-            makeSketchFast(collection, graph, linkState, prrGraph, seeds, v);
-        };
-    }), centerList));
+void makeSketchesFast(PRRGraphCollection&               prrCollection,
+                      std::vector<SamplingContext>&     contexts,
+                      const IMMGraph&                   graph,
+                      const SeedSet&                    seeds,
+                      const NodeStateContext&           stateCtx,
+                      rs::random_access_range auto&&    centerList) {
+    auto scope = memory::ScopedSubsystem(memory::Subsystem::Sketches);
+    parallelForEach(contexts.size(), centerList, [&](std::size_t tid, std::size_t v) {
+        auto& ctx = contexts[tid];
+        makeSketchFast(ctx.collection, graph, ctx.linkStates, ctx.prrGraph, seeds, stateCtx, v);
+    });
 
     // Merges all the result fragments
-    for (std::size_t i = 0; i < nThreads; i++) {
-        prrCollection.merge(prrCollectionPool[i]);
+    for (auto& ctx: contexts) {
+        prrCollection.merge(ctx.collection);
     }
 }
 
+/*!
+ * @brief Pipelined PR-IMM sampler with double-buffered result fragments. For monotonic & submodular cases only.
+ *
+ * PRR-sketches of a round are generated in background by all the workers, each into its own fragment.
+ * Once a round finishes, the fragments are swapped with the spare ones in O(1),
+ * so that the next round can be started immediately while the coordinator thread
+ * merges the finished fragments and evaluates them.
+ * A round started in advance can be cancelled, and its results are then either merged or discarded.
+ * A round also stops early once the budget is exhausted.
+ */
+class PipelinedSampler {
+public:
+    PipelinedSampler(const IMMGraph& graph, const SeedSet& seeds, const NodeStateContext& stateCtx,
+                     std::size_t nThreads, ResourceBudget& budget):
+    graph(graph), seeds(seeds), stateCtx(stateCtx), budget(budget),
+    contexts(makeSamplingContexts(graph, seeds, stateCtx, nThreads)), counts(nThreads, 0) {
+        auto scope = memory::ScopedSubsystem(memory::Subsystem::Workspace);
+        spare.assign(nThreads, PRRGraphCollection(graph.nNodes(), seeds, stateCtx));
+    }
+
+    PipelinedSampler(const PipelinedSampler&) = delete;
+
+    ~PipelinedSampler() {
+        // The background round refers to this object, thus it must be stopped first
+        if (running.valid()) {
+            cancelled = true;
+            running.wait();
+        }
+    }
+
+    /*!
+     * @brief Starts generating R PRR-sketches in background.
+     *
+     * The last round must have been finished, and its fragments have been merged or discarded.
+     *
+     * @param nSamples R, number of samples to generate
+     */
+    void start(std::uint64_t nSamples) {
+        cancelled = false;
+        rs::fill(counts, 0);
+        running = std::async(std::launch::async, [this, nSamples, context = ThreadContext{}]() {
+            auto contextScope = ScopedThreadContext(context);
+            trace::setThreadName("sampler");
+            auto phase = metrics::ScopedPhase(metrics::Phase::Sampling);
+            auto scope = memory::ScopedSubsystem(memory::Subsystem::Sketches);
+            parallelForIndex(contexts.size(), nSamples, [this](std::size_t tid, std::size_t) {
+                if (cancelled.load(std::memory_order_relaxed) || budgetExhausted(budget, counts[tid])) {
+                    return;
+                }
+                // Uniformly generates a center node in [0, n), with the random generator of each worker
+                auto v = std::uniform_int_distribution<std::size_t>(0, graph.nNodes() - 1)(
+                        threadLocalMT19937Generator());
+                auto& ctx = contexts[tid];
+                makeSketchFast(ctx.collection, graph, ctx.linkStates, ctx.prrGraph, seeds, stateCtx, v);
+                counts[tid] += 1;
+            });
+        });
+    }
+
+    /*!
+     * @brief Waits until the current round finishes, and takes its fragments to be merged or discarded.
+     * @return Number of samples generated in this round.
+     */
+    std::uint64_t finish() {
+        running.get();
+        for (std::size_t i = 0; i != contexts.size(); i++) {
+            std::swap(contexts[i].collection, spare[i]);
+        }
+        return std::accumulate(counts.begin(), counts.end(), std::uint64_t{0});
+    }
+
+    /*!
+     * @brief Stops the current round as early as possible. See finish() for details.
+     * @return Number of samples generated in this round before cancelled.
+     */
+    std::uint64_t cancel() {
+        cancelled = true;
+        return finish();
+    }
+
+    /*!
+     * @brief Whether a round is started and not finished yet.
+     */
+    [[nodiscard]] bool isRunning() const {
+        return running.valid();
+    }
+
+    /*!
+     * @brief Merges the fragments of the last finished round to the given PRR-sketch collection.
+     */
+    void mergeTo(PRRGraphCollection& prrCollection) {
+        for (auto& fragment: spare) {
+            prrCollection.merge(fragment);
+        }
+    }
+
+    /*!
+     * @brief Discards the fragments of the last finished round.
+     */
+    void discard() {
+        for (auto& fragment: spare) {
+            fragment.clearSketches();
+        }
+    }
+
+private:
+    const IMMGraph&                 graph;
+    const SeedSet&                  seeds;
+    NodeStateContext                stateCtx;
+    ResourceBudget&                 budget;
+    // Sampling contexts of each worker, whose fragments are written by the current round
+    std::vector<SamplingContext>    contexts;
+    // Fragments of the last finished round
+    std::vector<PRRGraphCollection> spare;
+    // counts[i] = Number of samples generated by worker #i in the current round
+    std::vector<std::uint64_t>      counts;
+    std::atomic<bool>               cancelled = false;
+    std::future<void>               running;
+};
+
 /*!
  * @brief Generates one PRR-sketch.
  *
@@ -156,6 +449,7 @@ void makeSketchesFast(PRRGraphCollection&   prrCollection,
  * @param linkStates The link states object
  * @param prrGraph The PRR-sketch object where the result is written
  * @param seeds The seed set
+ * @param stateCtx The node state priority and gain
  * @param center The center node selected
  */
 void makeSketchSlow(
@@ -163,36 +457,53 @@ void makeSketchSlow(
         IMMLinkStateSamples&    linkStates,
         PRRGraph&               prrGraph,
         const SeedSet&          seeds,
+        const NodeStateContext& stateCtx,
         std::size_t             center) {
+    auto event = trace::ScopedEvent("makeSketchSlow");
     // Gets a PRR-sketch with the specified center
-    samplePRRSketch(graph, linkStates, prrGraph, seeds, center);
+    auto nSampledBefore = linkStates.nSampled();
+    samplePRRSketch(graph, linkStates, prrGraph, seeds, stateCtx, center);
+    metrics::recordSketch(prrGraph.nNodes(), prrGraph.nLinks(), linkStates.nSampled() - nSampledBefore);
     // Calculates each gain(v; prrGraph, center) for v in prrGraph
     // gain is implied as gain(v.centerStateTo) - gain(center.state)
-    calculateCenterStateToSlow(prrGraph);
+    calculateCenterStateToSlow(prrGraph, stateCtx);
 }
 
 // Generate PRR-sketches
-auto generateSamplesDynamic(const IMMGraph& graph, const SeedSet& seeds, const DynamicArgs_PR_IMM& args)
+// Sampling is pipelined: while the coordinator merges the sketches of round i and checks S >= minS with them,
+//  the workers generate the sketches of round i + 1 in advance.
+// Once the budget is exhausted, sampling stops and the sketches generated so far are returned.
+auto generateSamplesDynamic(const IMMGraph& graph, const SeedSet& seeds, const DynamicArgs_PR_IMM& args,
+                            ResourceBudget& budget)
 {
     auto LB = double{ 1.0 };
 
-    auto prrCollection = PRRGraphCollection(graph.nNodes(), seeds);
-    // Count of PRR-sketches already generated
+    auto stateCtx = args.nodeStateContext();
+    auto prrCollection = PRRGraphCollection(graph.nNodes(), seeds, stateCtx);
+    auto sampler = PipelinedSampler(graph, seeds, stateCtx, args.nThreads, budget);
+    // Count of PRR-sketches already generated and merged
     auto prrCount = std::uint64_t{ 0 };
+    // Target count of PRR-sketches with given theta
+    auto targetCount = [&](double theta) {
+        return (std::uint64_t)std::min(theta, (double)args.sampleLimit);
+    };
+    auto timer = Timer{};
 
-    double theta = args.theta0;
-    double minS = (1 + ns::sqrt2 * args.epsilon);
-
-    for (int i = 1; i < (int)args.log2N; i++) {
-        // theta(i) = 2^i * theta(0)
-        theta *= 2.0;
-        // minS(i) = minS(0) / 2^i
-        minS /= 2.0;
+    // theta(i) = 2^i * theta(0)
+    double theta = args.theta0 * 2.0;
+    // minS(i) = minS(0) / 2^i
+    double minS = (1 + ns::sqrt2 * args.epsilon) / 2.0;
 
-        auto nSamples = (std::uint64_t)std::min(theta, (double)args.sampleLimit) - prrCount;
-        // Generates with multi-threading support
-        makeSketchesFast(prrCollection, graph, seeds, nSamples, args.nThreads);
-        prrCount += nSamples;
+    if (1 < (int)args.log2N) {
+        sampler.start(targetCount(theta));
+    }
+    for (int i = 1; i < (int)args.log2N; i++, theta *= 2.0, minS /= 2.0) {
+        prrCount += sampler.finish();
+        // Round i + 1 is generated in background while round i is merged and checked
+        if (!budget.exhausted() && prrCount < args.sampleLimit && i + 1 < (int)args.log2N) {
+            sampler.start(targetCount(theta * 2.0) - prrCount);
+        }
+        sampler.mergeTo(prrCollection);
 
         // Stops early if reaches limit
         if (prrCount >= args.sampleLimit) {
@@ -201,95 +512,171 @@ auto generateSamplesDynamic(const IMMGraph& graph, const SeedSet& seeds, const D
         }
         // Check with a greedy selection,
         // S = gain of the selected boosted nodes in average of all PRR-sketches
-        double S = prrCollection.select(args.k, nullptr) / (double)prrCount;
+        auto bestSoFar = IMMResultItem{};
+        double S = prrCollection.select(args.k, std::back_inserter(bestSoFar.boostedNodes))
+                   / (double)std::max<std::uint64_t>(prrCount, 1);
         LOG_INFO(format("Iteration #{}: theta = {:.0f}, S = {:.7f}, required minimal S = {:.7f}",
                         i, theta, S, minS));
 
+        // The selection of each round is written out as the best-so-far result
+        bestSoFar.totalGain = S * (double)graph.nNodes();
+        bestSoFar.timeUsed = timer.elapsed().count();
+        bestSoFar.memoryUsage = prrCollection.totalBytesUsed();
+        bestSoFar.peakMemoryUsage = memory::peakBytes();
+        bestSoFar.budgetExhausted = budget.exhausted();
+        LOG_INFO(format("Best-so-far result with {} PRR-sketches: {}", prrCount, bestSoFar));
+        writeBestSoFar(args, prrCount, bestSoFar);
+
+        if (budget.exhausted()) {
+            LOG_INFO(format("Stops sampling with {} PRR-sketches: {}", prrCount, budget.reason()));
+            break;
+        }
         if (S >= minS) {
             LB = S * (double)graph.nNodes() / (1 + ns::sqrt2 * args.epsilon);
             break;
         }
     }
 
-    if (prrCount < args.sampleLimit) {
+    if (prrCount < args.sampleLimit && !budget.exhausted()) {
         theta = 2.0 * (double)graph.nNodes() * (double)std::pow(args.alpha + args.beta, 2.0)
                 / LB / std::pow(args.epsilon, 2.0);
         LOG_INFO(format("LB = {:.0f}, theta = {:.0f}", LB, theta));
     }
-
-    auto nSamples = (std::uint64_t)std::min(theta, (double)args.sampleLimit) - prrCount;
-    makeSketchesFast(prrCollection, graph, seeds, nSamples, args.nThreads);
+    auto finalCount = targetCount(theta);
+
+    // The samples generated in advance are independent of the ones above,
+    //  thus can be kept unless there are more than required
+    if (sampler.isRunning()) {
+        auto nAdvance = sampler.cancel();
+        auto keeps = prrCount + nAdvance <= finalCount;
+        if (keeps) {
+            sampler.mergeTo(prrCollection);
+            prrCount += nAdvance;
+        } else {
+            sampler.discard();
+            metrics::add(metrics::Counter::DiscardedSketches, nAdvance);
+        }
+        LOG_INFO(format("{} PRR-sketches generated in advance are {}", nAdvance, keeps ? "kept" : "discarded"));
+    }
+    if (prrCount < finalCount && !budget.exhausted()) {
+        sampler.start(finalCount - prrCount);
+        prrCount += sampler.finish();
+        sampler.mergeTo(prrCollection);
+        if (budget.exhausted()) {
+            LOG_INFO(format("Stops sampling with {} of {} PRR-sketches: {}", prrCount, finalCount, budget.reason()));
+        }
+    }
 
     return GenerateSamplesResult{
             .prrCollection = std::move(prrCollection),
-            .prrCount = prrCount
+            .prrCount = prrCount,
+            .LB = LB
     };
 }
 
-IMMResult PR_IMM_Dynamic(const IMMGraph& graph, const SeedSet& seeds, const DynamicArgs_PR_IMM& args) {
-    // Prepare parameters
-    args.setEnv();
-
+IMMResult PR_IMM_Dynamic(const IMMGraph& graph, const SeedSet& seeds, const DynamicArgs_PR_IMM& args,
+                         SketchCache* cache) {
     auto resItem = IMMResultItem{};
     auto timer = Timer();
-    auto [prrCollection, prrCount] = generateSamplesDynamic(graph, seeds, args);
+    auto budget = ResourceBudget(args.timeBudget, args.memoryBudget);
+    auto [prrCollection, prrCount, LB] = generateSamplesDynamic(graph, seeds, args, budget);
 
     // totalGain = |V| * E(gains / |R|) where |V| = graph size, |R| = sample size
     resItem.totalGain = prrCollection.select(args.k, std::back_inserter(resItem.boostedNodes))
-                        / (double)prrCount * (double)graph.nNodes();
+                        / (double)std::max<std::uint64_t>(prrCount, 1) * (double)graph.nNodes();
     resItem.timeUsed = timer.elapsed().count();
     resItem.memoryUsage = prrCollection.totalBytesUsed();
+    resItem.peakMemoryUsage = memory::peakBytes();
+    resItem.budgetExhausted = budget.exhausted();
+    resItem.epsilonAchieved = achievedEpsilon_PR_IMM(args, args.ell, LB, prrCount);
 
     LOG_INFO(format("PR_IMM: Finished generating PRR-sketches. Time used = {:.3f} sec.",
                     resItem.timeUsed));
+    LOG_INFO(format("Result item with {} PRR-sketches: {}", prrCount, resItem));
     LOG_INFO(format("Dump PRR-sketch collection:\n{}", prrCollection.dump()));
+    writeBestSoFar(args, prrCount, resItem);
+    if (cache != nullptr) {
+        cache->put(seeds, args.priority.array,
+                   {.collection = std::move(prrCollection), .prrCount = prrCount, .lambda = args.lambda});
+    }
 
     return IMMResult{
         .items = {{prrCount, std::move(resItem)}}
     };
 }
 
-IMMResult PR_IMM_Static(const IMMGraph& graph, const SeedSet& seeds, const StaticArgs_PR_IMM& args) {
+IMMResult PR_IMM_Static(const IMMGraph& graph, const SeedSet& seeds, const StaticArgs_PR_IMM& args,
+                        SketchCache* cache) {
     // Prepare parameters
-    args.setEnv();
-
-    auto prrCollection = PRRGraphCollection(graph.nNodes(), seeds);
+    auto stateCtx = args.nodeStateContext();
+
+    auto prrCollection = PRRGraphCollection(graph.nNodes(), seeds, stateCtx);
+    auto lastPrrCount = std::uint64_t{0};
+    // Cached PRR-sketches are all used, thus taken only if no more than the smallest sample size
+    if (auto entry = cache != nullptr ? cache->take(seeds, args.priority.array, args.lambda, args.nSamplesList.front())
+                                      : std::nullopt) {
+        prrCollection = std::move(entry->collection);
+        lastPrrCount = entry->prrCount;
+        if (entry->lambda != args.lambda) {
+            prrCollection.recomputeGains(stateCtx);
+        }
+        LOG_INFO(format("PR_IMM: reuses {} cached PRR-sketches", lastPrrCount));
+    }
+    // Sampling contexts of each worker, reused by all the rounds
+    auto contexts = makeSamplingContexts(graph, seeds, stateCtx, args.nThreads);
+    auto budget = ResourceBudget(args.timeBudget, args.memoryBudget);
     auto res = IMMResult{};
 
     auto timer = Timer{};
-    for (std::uint64_t lastPrrCount = 0; std::uint64_t prrCount: args.nSamplesList) {
-        // Appends until prrCount PRR-sketches
-        makeSketchesFast(prrCollection, graph, seeds, prrCount - lastPrrCount, args.nThreads);
+    for (std::uint64_t targetPrrCount: args.nSamplesList) {
+        // Appends until targetPrrCount PRR-sketches, or fewer if the budget is exhausted
+        auto prrCount = lastPrrCount;
+        if (targetPrrCount > lastPrrCount) {
+            prrCount += makeSketchesFast(prrCollection, contexts, graph, seeds, stateCtx,
+                                         targetPrrCount - lastPrrCount, budget, args.logPerPercentage);
+        }
 
         auto resItem = IMMResultItem{};
         // totalGain = |V| * E(gains / |R|) where |V| = graph size, |R| = sample size
         resItem.totalGain = prrCollection.select(args.k, std::back_inserter(resItem.boostedNodes))
-                            / (double)prrCount * (double)graph.nNodes();
+                            / (double)std::max<std::uint64_t>(prrCount, 1) * (double)graph.nNodes();
         resItem.timeUsed = timer.elapsed().count();
         resItem.memoryUsage = prrCollection.totalBytesUsed();
+        resItem.peakMemoryUsage = memory::peakBytes();
+        resItem.budgetExhausted = budget.exhausted();
+        // Lower bound of OPT is established by the sketches themselves, with ell = 1 by default
+        auto LB = lowerBoundOfOPT_PR_IMM(args, 1.0, resItem.totalGain / (double)graph.nNodes(), prrCount);
+        resItem.epsilonAchieved = achievedEpsilon_PR_IMM(args, 1.0, LB, prrCount);
 
         LOG_INFO(format("Result item with {} PRR-sketches: {}",
                         prrCount, resItem));
         LOG_INFO(format("Dump PRR-sketch collection with {} samples: {}",
                         prrCount, prrCollection.dump()));
+        writeBestSoFar(args, prrCount, resItem);
 
         // Adds a result record of current PRR-sketch count
         res.items[prrCount] = std::move(resItem);
         // Proceeds PRR-sketch count
         lastPrrCount = prrCount;
+        if (budget.exhausted()) {
+            LOG_INFO(format("Stops sampling with {} of {} PRR-sketches: {}",
+                            prrCount, targetPrrCount, budget.reason()));
+            break;
+        }
+    }
+    if (cache != nullptr) {
+        cache->put(seeds, args.priority.array,
+                   {.collection = std::move(prrCollection), .prrCount = lastPrrCount, .lambda = args.lambda});
     }
 
     return res;
 }
 
-IMMResult PR_IMM(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args) {
-    // Prepare global parameters
-    args.setEnv();
-
+IMMResult PR_IMM(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args, SketchCache* cache) {
     if (typeid(args) == typeid(DynamicArgs_PR_IMM)) {
-        return PR_IMM_Dynamic(graph, seeds, dynamic_cast<const DynamicArgs_PR_IMM&>(args));
+        return PR_IMM_Dynamic(graph, seeds, dynamic_cast<const DynamicArgs_PR_IMM&>(args), cache);
     } else if (typeid(args) == typeid(StaticArgs_PR_IMM)) {
-        return PR_IMM_Static(graph, seeds, dynamic_cast<const StaticArgs_PR_IMM&>(args));
+        return PR_IMM_Static(graph, seeds, dynamic_cast<const StaticArgs_PR_IMM&>(args), cache);
     } else {
         throw std::bad_cast();
     }
@@ -307,6 +694,7 @@ IMMResult PR_IMM(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs& a
  * @return A list of center nodes after filtering.
  */
 auto getCenterList(const IMMGraph& graph, const SeedSet& seeds, std::size_t distLimit) {
+    auto phase = metrics::ScopedPhase(metrics::Phase::CenterFiltering);
     auto res = std::vector<std::size_t>();
 
     // Simply picks all
@@ -348,74 +736,79 @@ auto getCenterList(const IMMGraph& graph, const SeedSet& seeds, std::size_t dist
  * @brief Sub-process for SA-IMM-LB or SA-RG-IMM-LB algorithms.
  *
  * This process adds additional R samples for each candidate center nodes to prrCollection object.
+ * Once the budget is exhausted, the process stops early:
+ *  the samples of a center node generated so far are still added, and the rest center nodes are skipped.
  *
  * @param prrCollection The sample collection to which the results are written
+ * @param contexts The sampling contexts of each worker
  * @param centerCandidates List of candidate center nodes
  * @param nSamples R above, number of samples per center node
  * @param graph The whole graph
  * @param seeds The seed set
+ * @param stateCtx The node state priority and gain
  * @param args Algorithm arguments
+ * @param budget The budget object
  */
 void SA_IMM_LB_Static_Process(
         PRRGraphCollectionSA&           prrCollection,
-        rs::range auto&&                centerCandidates,
+        std::vector<SamplingContext>&   contexts,
+        rs::random_access_range auto&&  centerCandidates,
         std::uint64_t                   nSamples,
         const IMMGraph&                 graph,
         const SeedSet&                  seeds,
-        const StaticArgs_SA_IMM_LB&     args) {
+        const NodeStateContext&         stateCtx,
+        const StaticArgs_SA_IMM_LB&     args,
+        ResourceBudget&                 budget) {
     auto progress = ProgressCounter("SA_IMM_LB", centerCandidates.size(), args.logPerPercentage);
-    // Creates a series of PRR-sketch objects for reusing in each thread
-    auto prrGraphPool = std::vector<PRRGraph>();
-    // Creates a series of link state objects for reusing in each thread
-    auto linkStatePool = std::vector<IMMLinkStateSamples>{};
-    // Creates a series of lists of double for reusing in each thread
-    auto vecPool = std::vector<std::vector<double>>{args.nThreads};
-
-    for (std::size_t i = 0; i < args.nThreads; i++) {
-        // Reserves before calling
-        prrGraphPool.push_back(PRRGraph{{
-            {"nodes", graph.nNodes()},
-            {"links", graph.nLinks()},
-            {"maxIndex", graph.nNodes()}
-        }});
-        // Initializes before calling
-        linkStatePool.emplace_back(graph.nLinks());
-    }
-
-    auto update = [&](std::size_t v, const std::vector<double>& totalGainsByBoosted) {
-        static auto mtx = std::mutex{};
+
+    auto mtx = std::mutex{};
+    auto update = [&](std::size_t v, std::uint64_t nDone, const std::vector<double>& totalGainsByBoosted) {
         {
-            auto lock = std::scoped_lock(mtx);
-            prrCollection.add(v, nSamples, totalGainsByBoosted);
-            progress.increment();
+            auto lock = [&]() {
+                auto event = trace::ScopedEvent("waitUpdate");
+                return std::unique_lock(mtx);
+            }();
+            prrCollection.add(v, nDone, totalGainsByBoosted);
         }
+        progress.increment();
     };
 
-    runTaskGroup(vs::iota(std::size_t{0}, args.nThreads) | vs::transform([&](std::size_t tid) {
-        return [&, tid](std::size_t v) {
-            auto& linkState         = linkStatePool[tid];
-            auto& prrGraph          = prrGraphPool[tid];
-            // curGainsByBoosted[s] = How much gain to current center node v if s is chosen as one boosted node
-            auto& curGainsByBoosted = vecPool[tid];
-            // Clears before using
-            curGainsByBoosted.assign(graph.nNodes(), 0.0);
-
-            for (std::uint64_t j = 0; j < nSamples; j++) {
-                makeSketchSlow(graph, linkState, prrGraph, seeds, v);
-                for (const auto& node: prrGraph.nodes()) {
-                    double delta = gain(node.centerStateTo) - gain(prrGraph.centerState);
-                    // Takes the sum
-                    curGainsByBoosted[index(node)] += delta;
-                }
+    auto phase = metrics::ScopedPhase(metrics::Phase::Sampling);
+    auto scope = memory::ScopedSubsystem(memory::Subsystem::Sketches);
+    parallelForEach(contexts.size(), centerCandidates, [&](std::size_t tid, std::size_t v) {
+        auto& linkState         = contexts[tid].linkStates;
+        auto& prrGraph          = contexts[tid].prrGraph;
+        // curGainsByBoosted[s] = How much gain to current center node v if s is chosen as one boosted node
+        auto& curGainsByBoosted = contexts[tid].gainsByBoosted;
+        if (budget.exhausted()) {
+            return;
+        }
+        // Clears before using
+        curGainsByBoosted.assign(graph.nNodes(), 0.0);
+
+        auto j = std::uint64_t{0};
+        for (; j < nSamples && !budgetExhausted(budget, j); j++) {
+            makeSketchSlow(graph, linkState, prrGraph, seeds, stateCtx, v);
+            auto isEmpty = true;
+            for (const auto& node: prrGraph.nodes()) {
+                double delta = stateCtx.gain(node.centerStateTo) - stateCtx.gain(prrGraph.centerState);
+                // Takes the sum
+                curGainsByBoosted[index(node)] += delta;
+                isEmpty = isEmpty && delta <= 0.0;
+            }
+            if (isEmpty) {
+                metrics::add(metrics::Counter::EmptySketches);
             }
-            update(v, curGainsByBoosted);
-        };
-    }), centerCandidates);
+        }
+        if (j != 0) {
+            update(v, j, curGainsByBoosted);
+        }
+    });
 }
 
 IMMResult SA_IMM_LB_Static(const IMMGraph& graph, const SeedSet& seeds, const StaticArgs_SA_IMM_LB& args) {
-    // Prepare global parameters
-    args.setEnv();
+    // Prepare parameters
+    auto stateCtx = args.nodeStateContext();
 
     auto prrCollection = PRRGraphCollectionSA(graph.nNodes(), args.gainThreshold, seeds);
     auto usesRandomGreedy = args.algo == AlgorithmLabel::SA_RG_IMM;
@@ -427,6 +820,9 @@ IMMResult SA_IMM_LB_Static(const IMMGraph& graph, const SeedSet& seeds, const St
                     centerCandidates.size(), graph.nNodes(), 100.0 * centerCandidates.size() / graph.nNodes()));
 
     auto res = IMMResult{};
+    // Sampling contexts of each worker, reused by all the partitions and rounds
+    auto contexts = makeSamplingContexts(graph, seeds, stateCtx, args.nThreads);
+    auto budget = ResourceBudget(args.timeBudget, args.memoryBudget);
     auto timer = Timer{};
 
     for (auto lastNSamples = std::uint64_t{0}; auto nSamples: args.nSamplesList) {
@@ -439,7 +835,8 @@ IMMResult SA_IMM_LB_Static(const IMMGraph& graph, const SeedSet& seeds, const St
             auto curPartition = rs::subrange(centerCandidates.begin() + firstIndex, centerCandidates.begin() + lastIndex);
 
             // Appends more samples with count = nSamples - lastNSamples
-            SA_IMM_LB_Static_Process(prrCollection, curPartition, nSamples - lastNSamples, graph, seeds, args);
+            SA_IMM_LB_Static_Process(
+                    prrCollection, contexts, curPartition, nSamples - lastNSamples, graph, seeds, stateCtx, args, budget);
 
             auto resItem = IMMResultItem{};
             if (usesRandomGreedy) {
@@ -454,13 +851,27 @@ IMMResult SA_IMM_LB_Static(const IMMGraph& graph, const SeedSet& seeds, const St
 
             resItem.timeUsed = timer.elapsed().count();
             resItem.memoryUsage = prrCollection.totalBytesUsed();
+            resItem.peakMemoryUsage = memory::peakBytes();
+            resItem.budgetExhausted = budget.exhausted();
+            // Every candidate has nSamples samples only after the last partition is finished,
+            //  and the bound is taken with ell = 1 by default
+            auto nSamplesAll = (i + 1 == nPartitions && !budget.exhausted()) ? nSamples : lastNSamples;
+            resItem.epsilonAchieved = achievedEpsilon_SA_IMM_LB(args, 1.0, nSamplesAll);
             LOG_INFO(format("Result item with {} samples per center node: {}",
                             nSamples, resItem));
             LOG_INFO(format("Dump sample collection with {} samples per center node: {}",
                             nSamples, prrCollection.dump()));
             // Assumes nSamples = 1 ... R
             // Maps key to 1 ... nPartitions ... R*nPartitions
-            res.items[(nSamples - 1) * nPartitions + i + 1] = resItem;
+            auto key = (nSamples - 1) * nPartitions + i + 1;
+            writeBestSoFar(args, key, resItem);
+            res.items[key] = std::move(resItem);
+
+            if (budget.exhausted()) {
+                LOG_INFO(format("Stops sampling at partition #{} with {} samples per center node: {}",
+                                i + 1, nSamples, budget.reason()));
+                return res;
+            }
         }
 
         lastNSamples = nSamples;
@@ -476,9 +887,6 @@ IMMResult SA_IMM_LB_Dynamic(const IMMGraph& graph, const SeedSet& seeds, const D
 }
 
 IMMResult SA_IMM_LB(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args) {
-    // Prepare global parameters
-    args.setEnv();
-
     if (typeid(args) == typeid(DynamicArgs_SA_IMM_LB)) {
         return SA_IMM_LB_Dynamic(graph, seeds, dynamic_cast<const DynamicArgs_SA_IMM_LB&>(args));
     } else if (typeid(args) == typeid(StaticArgs_SA_IMM_LB)) {
@@ -488,68 +896,238 @@ IMMResult SA_IMM_LB(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs
     }
 }
 
-IMMResult3 SA_IMM(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args_) {
+IMMResult3 SA_IMM(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args_, SketchCache* cache) {
     const auto& args = dynamic_cast<const Args_SA_IMM&>(args_);
     auto res = IMMResult3{};
 
     res.labels[0] = "Upper bound";
-    auto argsUB = args.argsUB();
-    LOG_INFO("SA-IMM: Arguments for upper bound: \n" + argsUB->dump());
-    res[0] = PR_IMM(graph, seeds, *argsUB);
-
     res.labels[1] = "Lower bound";
+    auto argsUB = args.argsUB();
     auto argsLB = args.argsLB();
+    // The bounds are independent, thus they run concurrently with the threads split between them.
+    //  The lower bound runs with its own thread(s) (see Args_SA_IMM::argsLB), and the upper bound with the rest.
+    auto concurrent = args.nThreads > argsLB->nThreads;
+    if (concurrent) {
+        argsUB->nThreads = args.nThreads - argsLB->nThreads;
+    }
+    LOG_INFO("SA-IMM: Arguments for upper bound: \n" + argsUB->dump());
     LOG_INFO("SA-IMM: Arguments for lower bound: \n" + argsLB->dump());
-    res[1] = SA_IMM_LB(graph, seeds, *argsLB);
+    if (!concurrent) {
+        res[0] = PR_IMM(graph, seeds, *argsUB, cache);
+        res[1] = SA_IMM_LB(graph, seeds, *argsLB);
+        return res;
+    }
 
+    auto lowerBound = std::async(std::launch::async, [&, context = ThreadContext{}]() {
+        auto contextScope = ScopedThreadContext(context);
+        trace::setThreadName("SA-IMM lower bound");
+        return SA_IMM_LB(graph, seeds, *argsLB);
+    });
+    // The lower bound refers to the local objects, thus it must be finished even if the upper bound throws
+    try {
+        res[0] = PR_IMM(graph, seeds, *argsUB, cache);
+    } catch (...) {
+        lowerBound.wait();
+        throw;
+    }
+    res[1] = lowerBound.get();
     return res;
 }
 
-GreedyResult greedy(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args_) {
-    const auto& args = dynamic_cast<const GreedyArgs&>(args_);
+/*!
+ * @brief Private objects of each thread during greedy algorithm.
+ */
+struct GreedyWorker {
+    // Private copy of the boosted node set to be evaluated
+    std::vector<std::size_t>    boostedNodes;
+    IMMLinkStateSamples         linkStates;
+    NodeSimStates               nodes;
+    // Buffer of delta propagation, used with world bank only
+    NodeDeltaBuffer             deltaBuffer;
+    // Sum of total gains of each candidate on the worlds processed by this thread, used with world bank only
+    std::vector<double>         gainSum;
+
+    /*!
+     * @brief Sets the private boosted node set as S + {extra...}
+     */
+    template <class... Nodes>
+    void setBoostedNodes(const std::vector<std::size_t>& S, Nodes... extra) {
+        boostedNodes.assign(S.begin(), S.end());
+        (boostedNodes.push_back(extra), ...);
+    }
+};
 
-    // Prepare parameters
-    args.setEnv();
+/*!
+ * @brief Evaluates the objective f(S) = E[total gain with boosted node set S] during greedy algorithm.
+ *
+ * The expectation is estimated either with greedyTestTimes freshly sampled worlds for each evaluation,
+ * or with the same R worlds sampled in advance (see IMMWorldBank) for all the evaluations.
+ */
+class GreedyEvaluator {
+    const IMMGraph&                 graph;
+    const SeedSet&                  seeds;
+    const GreedyArgs&               args;
+    NodeStateContext                stateCtx;
+    std::vector<GreedyWorker>       workers;
+    std::optional<IMMWorldBank>     bank;
+
+public:
+    GreedyEvaluator(const IMMGraph& graph, const SeedSet& seeds, const GreedyArgs& args):
+    graph(graph), seeds(seeds), args(args), stateCtx(args.nodeStateContext()), workers(args.nThreads) {
+        if (args.greedyWorldBank != 0) {
+            auto timer = Timer{};
+            bank.emplace(graph, args.greedyWorldBank, args.nThreads);
+            LOG_INFO(format("Greedy: sampled {} worlds in advance with {} bytes. Time used = {:.3f} sec.",
+                            bank->nWorlds(), bank->totalBytesUsed(), timer.elapsed().count()));
+        }
+    }
+
+    [[nodiscard]] bool usesWorldBank() const {
+        return bank.has_value();
+    }
+
+    /*!
+     * @brief Units of progress during evaluateAll: per candidate, or per world with the world bank.
+     */
+    [[nodiscard]] std::uint64_t progressUnits(std::uint64_t nCandidates) const {
+        return bank ? bank->nWorlds() : nCandidates;
+    }
+
+    /*!
+     * @brief Evaluates f(S + {extra...}) in the thread tid only.
+     */
+    template <class... Nodes>
+    double evaluateBy(std::size_t tid, const std::vector<std::size_t>& S, Nodes... extra) {
+        auto& w = workers[tid];
+        w.setBoostedNodes(S, extra...);
+        if (!bank) {
+            return simulateBoostedSerial(graph, w.linkStates, w.nodes, seeds, stateCtx, w.boostedNodes,
+                                         args.greedyTestTimes).totalGain;
+        }
+        auto sum = 0.0;
+        for (std::size_t r = 0; r != bank->nWorlds(); r++) {
+            auto world = bank->world(r);
+            sum += propagateOnce(graph, world, w.nodes, seeds, stateCtx, w.boostedNodes).totalGain;
+        }
+        return sum / (double)bank->nWorlds();
+    }
+
+    /*!
+     * @brief Evaluates f(S + {extra...}) with the worlds distributed to all the threads.
+     */
+    template <class... Nodes>
+    double evaluate(const std::vector<std::size_t>& S, Nodes... extra) {
+        auto nWorlds = bank ? bank->nWorlds() : args.greedyTestTimes;
+        auto subResults = std::vector<double>(args.nThreads);
+        for (auto& w: workers) {
+            w.setBoostedNodes(S, extra...);
+        }
+        parallelForIndex(args.nThreads, nWorlds, [&](std::size_t tid, std::size_t r) {
+            auto& w = workers[tid];
+            if (bank) {
+                auto world = bank->world(r);
+                subResults[tid] += propagateOnce(graph, world, w.nodes, seeds, stateCtx, w.boostedNodes).totalGain;
+            } else {
+                subResults[tid] += simulateBoostedOnce(graph, w.linkStates, w.nodes, seeds, stateCtx, w.boostedNodes)
+                        .totalGain;
+            }
+        });
+        return std::accumulate(subResults.begin(), subResults.end(), 0.0) / (double)nWorlds;
+    }
+
+    /*!
+     * @brief Evaluates gainV[v] = f(S + {v}) for every candidate v, i.e. isCandidate(v) == true.
+     *
+     * Without the world bank, candidates are distributed to all the threads.
+     * With the world bank, worlds are distributed instead: in each world, the propagation with S
+     * is performed only once, and then each candidate is evaluated by delta propagation on it.
+     *
+     * @param S The boosted node set
+     * @param isCandidate Predicate of candidates
+     * @param gainV Destination of the results. Values of non-candidates are left unchanged.
+     * @param progress Progress counter, incremented by progressUnits(number of candidates) in total
+     */
+    template <std::predicate<std::size_t> Pred>
+    void evaluateAll(const std::vector<std::size_t>& S, Pred&& isCandidate,
+                     std::vector<double>& gainV, ProgressCounter& progress) {
+        auto candidates = std::vector<std::size_t>{};
+        for (std::size_t v = 0; v != graph.nNodes(); v++) {
+            if (isCandidate(v)) {
+                candidates.push_back(v);
+            }
+        }
+
+        if (!bank) {
+            parallelForEach(args.nThreads, candidates, [&](std::size_t tid, std::size_t v) {
+                // Each v is evaluated by exactly one thread
+                gainV[v] = evaluateBy(tid, S, v);
+                progress.increment();
+            });
+            return;
+        }
 
+        for (auto& w: workers) {
+            w.gainSum.assign(graph.nNodes(), 0.0);
+            // The last one is a placeholder replaced by each candidate
+            w.setBoostedNodes(S, std::size_t{0});
+        }
+        parallelForIndex(args.nThreads, bank->nWorlds(), [&](std::size_t tid, std::size_t r) {
+            auto& w = workers[tid];
+            auto world = bank->world(r);
+            auto base = propagateOnce(graph, world, w.nodes, seeds, stateCtx, S);
+            for (auto v: candidates) {
+                w.boostedNodes.back() = v;
+                w.gainSum[v] += propagateDelta(
+                        graph, world, w.nodes, base, w.deltaBuffer, seeds, stateCtx, w.boostedNodes).totalGain;
+            }
+            progress.increment();
+        });
+
+        for (auto v: candidates) {
+            auto sum = 0.0;
+            for (const auto& w: workers) {
+                sum += w.gainSum[v];
+            }
+            gainV[v] = sum / (double)bank->nWorlds();
+        }
+    }
+};
+
+/*!
+ * @brief Greedy algorithm that evaluates every candidate node in each round.
+ *
+ * Applicable to any node state priority.
+ */
+GreedyResult greedyNaive(const IMMGraph& graph, const SeedSet& seeds, const GreedyArgs& args,
+                         GreedyEvaluator& evaluator) {
     auto res = GreedyResult{};
     auto gainV = std::vector<double>(graph.nNodes());
-
-    auto initGainV = [&]() {
-        // Initializes gain of other nodes to 0
-        rs::fill(gainV, 0.0);
-        // Initializes gain of chosen nodes and seed nodes to -inf
-        utils::ranges::concatForEach([&](std::size_t v) {
-            gainV[v] = halfMin<double>;
-        }, res.boostedNodes, seeds.Sa(), seeds.Sr());
-    };
+    // Seed nodes and chosen nodes are excluded from candidates
+    auto excluded = std::vector<bool>(graph.nNodes(), false);
+    utils::ranges::concatForEach([&](std::size_t v) {
+        excluded[v] = true;
+    }, seeds.Sa(), seeds.Sr());
 
     auto timer = Timer{};
     assert(graph.nNodes() >= seeds.size());
 
     auto nCandidates = graph.nNodes() - seeds.size();
-    auto nAttempts = (nCandidates >= args.k)
-                     ? nCandidates * args.k - args.k * (args.k - 1) / 2
-                     : (args.k + 1) * args.k / 2;
+    auto nAttempts = evaluator.usesWorldBank()
+                     ? evaluator.progressUnits(nCandidates) * std::min(nCandidates, args.k)
+                     : (nCandidates >= args.k)
+                       ? nCandidates * args.k - args.k * (args.k - 1) / 2
+                       : (args.k + 1) * args.k / 2;
     auto progress = ProgressCounter("Greedy", nAttempts, args.logPerPercentage);
 
     // Early stop if no more nodes can be chosen
     for (auto i = std::size_t{0}; i != args.k && i != nCandidates; i++) {
-        initGainV();
-        for (std::size_t v = 0; v != graph.nNodes(); v++) {
-            // Skip excluded nodes
-            if (gainV[v] < 0) {
-                continue;
-            }
-            // Sets S = S + {v} temporarily
-            res.boostedNodes.push_back(v);
-            gainV[v] += simulateBoosted(graph, seeds, res.boostedNodes, args.greedyTestTimes).totalGain;
-            // Restores S
-            res.boostedNodes.pop_back();
-            progress.increment();
-        }
+        // Gain of excluded nodes is -inf
+        rs::fill(gainV, halfMin<double>);
+        evaluator.evaluateAll(res.boostedNodes, [&](std::size_t v) { return !excluded[v]; }, gainV, progress);
 
         auto v = rs::max_element(gainV) - gainV.begin();
         res.boostedNodes.push_back(v);
+        excluded[v] = true;
         LOG_INFO(format("Added boosted node #{} = {} with gain = {:.3f}. "
                         "Time used = {:.3f} sec.",
                         i + 1, v, gainV[v], timer.elapsed().count()));
@@ -558,11 +1136,175 @@ GreedyResult greedy(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs
     return res;
 }
 
+/*!
+ * @brief Greedy algorithm with lazy forward evaluation (CELF++).
+ *
+ * The objective function must be submodular (and monotonic), i.e. the marginal gain of each node
+ * never increases as more nodes are selected. Thus a marginal gain evaluated in earlier rounds is
+ * an upper bound of the current one, and only the candidate on the top of the max-heap is re-evaluated.
+ *
+ * CELF++ further evaluates mg2 = gain(v | S + {prevBest}) together with mg1 = gain(v | S),
+ * where prevBest is the best candidate evaluated so far in the same round.
+ * If prevBest is exactly the node selected in that round, mg1 in the next round is simply mg2
+ * and no more simulation is required.
+ *
+ * The initial evaluation of all the candidates runs concurrently, where each thread tracks its own prevBest.
+ * With the world bank, the initial evaluation is performed by GreedyEvaluator::evaluateAll instead,
+ * where mg2 is left unknown.
+ * Re-evaluations of the heap top are sequential, with the worlds of each distributed to all the threads.
+ */
+GreedyResult greedyCELF(const IMMGraph& graph, const SeedSet& seeds, const GreedyArgs& args,
+                        GreedyEvaluator& evaluator) {
+    constexpr auto noNode = utils::halfMax<std::size_t>;
+
+    struct Candidate {
+        std::size_t v{};
+        // Marginal gain w.r.t. S
+        double      mg1{};
+        // The best candidate evaluated before v in the round when v is evaluated
+        std::size_t prevBest{};
+        // Marginal gain w.r.t. S + {prevBest}
+        double      mg2{};
+        // The size of S when v is evaluated
+        std::size_t flag{};
+    };
+    auto cmp = [](const Candidate& a, const Candidate& b) {
+        return a.mg1 < b.mg1;
+    };
+    auto Q = std::priority_queue<Candidate, std::vector<Candidate>, decltype(cmp)>(cmp);
+
+    // The best candidate evaluated in current round
+    struct BestCandidate {
+        std::size_t v       = noNode;
+        double      mg1     = halfMin<double>;
+        // f(S + {v})
+        double      gain    = 0.0;
+    };
+
+    auto res = GreedyResult{};
+    auto timer = Timer{};
+    assert(graph.nNodes() >= seeds.size());
+
+    auto nCandidates = graph.nNodes() - seeds.size();
+    auto progress = ProgressCounter("Greedy (CELF++) initialization",
+                                    evaluator.progressUnits(nCandidates), args.logPerPercentage);
+
+    // Evaluates mg1 and mg2 of candidate c w.r.t. the current S and best, and then updates best
+    // gainFn(extra...) = f(S + {extra...})
+    auto evaluate = [&](Candidate& c, BestCandidate& best, double gainS, auto&& gainFn) {
+        auto gainV = gainFn(c.v);
+        c.mg1 = gainV - gainS;
+        c.prevBest = best.v;
+        c.mg2 = (best.v == noNode) ? c.mg1 : gainFn(best.v, c.v) - best.gain;
+        c.flag = res.boostedNodes.size();
+        if (c.mg1 > best.mg1) {
+            best = {.v = c.v, .mg1 = c.mg1, .gain = gainV};
+        }
+    };
+
+    auto gainS = evaluator.evaluate(res.boostedNodes);
+    auto curBest = BestCandidate{};
+    // The node selected in the last round
+    auto lastSelected = noNode;
+
+    if (evaluator.usesWorldBank()) {
+        auto gainV = std::vector<double>(graph.nNodes());
+        evaluator.evaluateAll(res.boostedNodes, [&](std::size_t v) { return !seeds.contains(v); }, gainV, progress);
+        for (std::size_t v = 0; v != graph.nNodes(); v++) {
+            if (seeds.contains(v)) {
+                continue;
+            }
+            auto c = Candidate{.v = v, .mg1 = gainV[v] - gainS, .prevBest = noNode, .mg2 = 0.0, .flag = 0};
+            if (c.mg1 > curBest.mg1) {
+                curBest = {.v = v, .mg1 = c.mg1, .gain = gainV[v]};
+            }
+            Q.push(c);
+        }
+    } else {
+        // Initial evaluation, each thread with its own best candidate
+        auto bestOfThreads = std::vector<BestCandidate>(args.nThreads);
+        auto candidatesOfThreads = std::vector<std::vector<Candidate>>(args.nThreads);
+        auto candidates = std::vector<std::size_t>{};
+        for (std::size_t v = 0; v != graph.nNodes(); v++) {
+            if (!seeds.contains(v)) {
+                candidates.push_back(v);
+            }
+        }
+        parallelForEach(args.nThreads, candidates, [&](std::size_t tid, std::size_t v) {
+            auto c = Candidate{.v = v};
+            evaluate(c, bestOfThreads[tid], gainS, [&](auto... extra) {
+                return evaluator.evaluateBy(tid, res.boostedNodes, extra...);
+            });
+            candidatesOfThreads[tid].push_back(c);
+            progress.increment();
+        });
+        for (std::size_t tid = 0; tid != args.nThreads; tid++) {
+            for (const auto& c: candidatesOfThreads[tid]) {
+                Q.push(c);
+            }
+            if (bestOfThreads[tid].mg1 > curBest.mg1) {
+                curBest = bestOfThreads[tid];
+            }
+        }
+    }
+
+    std::size_t nEvaluations = 0;
+    while (res.boostedNodes.size() < args.k && !Q.empty()) {
+        auto c = Q.top();
+        Q.pop();
+
+        if (c.flag == res.boostedNodes.size()) {
+            // mg1 is up-to-date and the largest among all the upper bounds
+            res.boostedNodes.push_back(c.v);
+            gainS += c.mg1;
+            lastSelected = c.v;
+            LOG_INFO(format("Added boosted node #{} = {} with gain = {:.3f}. "
+                            "{} re-evaluations in this round. Time used = {:.3f} sec.",
+                            res.boostedNodes.size(), c.v, gainS, nEvaluations, timer.elapsed().count()));
+            // Starts a new round
+            curBest = BestCandidate{};
+            nEvaluations = 0;
+            continue;
+        }
+        if (c.prevBest == lastSelected && c.flag + 1 == res.boostedNodes.size()) {
+            // S of the current round = S of last round + {prevBest}
+            c.mg1 = c.mg2;
+            c.flag = res.boostedNodes.size();
+            if (c.mg1 > curBest.mg1) {
+                curBest = {.v = c.v, .mg1 = c.mg1, .gain = gainS + c.mg1};
+            }
+        } else {
+            evaluate(c, curBest, gainS, [&](auto... extra) {
+                return evaluator.evaluate(res.boostedNodes, extra...);
+            });
+            nEvaluations += 1;
+        }
+        Q.push(c);
+    }
+
+    return res;
+}
+
+GreedyResult greedy(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args_) {
+    const auto& args = dynamic_cast<const GreedyArgs&>(args_);
+
+    auto phase = metrics::ScopedPhase(metrics::Phase::Selection);
+    // Greedy is driven by simulation, thus its evaluation buffers are counted in simulation
+    auto scope = memory::ScopedSubsystem(memory::Subsystem::Simulation);
+
+    // Lazy evaluation requires that marginal gains never increase, i.e. sub-modularity
+    if (args.priority.satisfies("M - S")) {
+        LOG_INFO("Greedy: uses lazy forward evaluation (CELF++) since the priority is monotonic and submodular.");
+        auto evaluator = GreedyEvaluator(graph, seeds, args);
+        return greedyCELF(graph, seeds, args, evaluator);
+    }
+    LOG_INFO("Greedy: evaluates all the candidates in each round since the priority is not submodular.");
+    auto evaluator = GreedyEvaluator(graph, seeds, args);
+    return greedyNaive(graph, seeds, args, evaluator);
+}
+
 template <std::invocable<std::size_t, std::size_t> Func>
 GreedyResult naiveSolutionFramework(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args, Func&& func) {
-    // Prepare parameters
-    args.setEnv();
-
     auto indices = std::vector<std::size_t>(graph.nNodes());
     std::iota(indices.begin(), indices.end(), 0);
     rs::sort(indices, [&](std::size_t u, std::size_t v) {
@@ -593,10 +1335,25 @@ GreedyResult maxDegree(const IMMGraph& graph, const SeedSet& seeds, const BasicA
     });
 }
 
-GreedyResult pageRank(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args) {
-    LOG_INFO("Starts PageRank algorithm");
+std::vector<double> pageRankScores(const IMMGraph& graph) {
+    auto scope = memory::ScopedSubsystem(memory::Subsystem::Graph);
     auto pr = graph::pageRank(graph);
+    auto scores = std::vector<double>(graph.nNodes());
+    for (std::size_t v = 0; v != graph.nNodes(); v++) {
+        scores[v] = pr[v];
+    }
+    return scores;
+}
+
+GreedyResult pageRank(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args,
+                      const std::vector<double>* scores) {
+    LOG_INFO("Starts PageRank algorithm");
+    auto computed = std::vector<double>{};
+    if (scores == nullptr) {
+        computed = pageRankScores(graph);
+        scores = &computed;
+    }
     return naiveSolutionFramework(graph, seeds, args, [&](std::size_t u, std::size_t v) {
-        return pr[u] > pr[v];
+        return (*scores)[u] > (*scores)[v];
     });
 }
\ No newline at end of file
@@ -6,6 +6,8 @@
 #include "graphbasic.h"
 #include <map>
 
+class SketchCache;
+
 /*!
  * @brief Result for single sample size of IMM algorithm.
  *
@@ -24,9 +26,19 @@ struct IMMResultItem {
     //   gains = result of greedy selection sub-problem
     double                      totalGain{};
     // Estimation of time used (in seconds) during algorithm
-    double                      timeUsed;
-    // Estimation of memory usage (in bytes) during algorithm
-    std::size_t                 memoryUsage;
+    double                      timeUsed{};
+    // Estimation of memory usage (in bytes) of the sample collection
+    std::size_t                 memoryUsage{};
+    // Peak bytes allocated so far, counted by the allocator (see memory.h) in the account of the query if any,
+    //  otherwise by the whole process. The peak resident set size if the counting allocator is disabled
+    std::size_t                 peakMemoryUsage{};
+    // Whether sampling stopped early since the time or memory budget is exhausted
+    bool                        budgetExhausted = false;
+    // Approximation error epsilon achieved with the samples actually collected,
+    //  i.e. the result is (delta - epsilonAchieved)-approximate with high probability
+    //  where delta = 1 - 1/e, or 1/e for SA-RG-IMM.
+    // halfMax<double> if unknown
+    double                      epsilonAchieved = halfMax<double>;
 };
 
 /*!
@@ -90,6 +102,9 @@ struct GreedyResult {
  *      ----.boostedNodes = {1, 2, 3, 4},
  *      ----.timeUsed = 5.678 sec.
  *      ----.memoryUsage = 4096 bytes = 4.000 KibiBytes
+ *      ----.peakMemoryUsage = 8192 bytes = 8.000 KibiBytes
+ *      ----.budgetExhausted = false
+ *      ----.epsilonAchieved = 0.100
  *      }
  *
  * Indentation size should be non-negative. If a negative value is provided, it's treated as 0.
@@ -109,6 +124,10 @@ inline std::string toString(const IMMResultItem& item, int indent = 4) {
                               (item.totalGain <= halfMin<double> ? "-inf" : toString(item.totalGain, 'f', 3)));
     res += indentStr + format(".timeUsed = {:.3f} sec.\n", item.timeUsed);
     res += indentStr + format(".memoryUsage = {}\n", utils::totalBytesUsedToString(item.memoryUsage));
+    res += indentStr + format(".peakMemoryUsage = {}\n", utils::totalBytesUsedToString(item.peakMemoryUsage));
+    res += indentStr + format(".budgetExhausted = {}\n", item.budgetExhausted);
+    res += indentStr + format(".epsilonAchieved = {}\n",
+                              (item.epsilonAchieved >= halfMax<double> ? "unknown" : toString(item.epsilonAchieved, 'f', 3)));
 
     res += "}";
     return res;
@@ -118,13 +137,17 @@ inline std::string toString(const IMMResultItem& item, int indent = 4) {
  * @brief Solves with PR-IMM algorithm with dynamic sample size. For monotonic & sub-modular cases only.
  *
  * The result contains only one record: final sample size => result item.
+ * Since the final sample size depends on the selection of each round, the cache is not read,
+ * while the final PRR-sketch collection is put to the cache for the follow-up queries with fixed sample sizes.
  *
  * @param graph The whole graph
  * @param seeds The seed set
  * @param args Arguments of the algorithm
+ * @param cache The sketch cache, or nullptr if disabled
  * @return an IMMResult object as the algorithm result
  */
-IMMResult PR_IMM_Dynamic(const IMMGraph& graph, const SeedSet& seeds, const DynamicArgs_PR_IMM& args);
+IMMResult PR_IMM_Dynamic(const IMMGraph& graph, const SeedSet& seeds, const DynamicArgs_PR_IMM& args,
+                         SketchCache* cache = nullptr);
 
 
 /*!
@@ -132,12 +155,19 @@ IMMResult PR_IMM_Dynamic(const IMMGraph& graph, const SeedSet& seeds, const Dyna
  *
  * The result contains several records, sample size => result item for each nSamples in args.nSamplesList.
  *
+ * With the sketch cache, sampling starts from the cached PRR-sketches of the same seed set and priority (if any),
+ * and the collection is put back to the cache afterwards.
+ * Since all the cached PRR-sketches are used, a sample size smaller than the cached one is raised to it,
+ * and the result items are recorded with the sample sizes actually used.
+ *
  * @param graph The whole graph
  * @param seeds The seed set
  * @param args Arguments of the algorithm
+ * @param cache The sketch cache, or nullptr if disabled
  * @return an IMMResult object as the algorithm result
  */
-IMMResult PR_IMM_Static(const IMMGraph& graph, const SeedSet& seeds, const StaticArgs_PR_IMM& args);
+IMMResult PR_IMM_Static(const IMMGraph& graph, const SeedSet& seeds, const StaticArgs_PR_IMM& args,
+                        SketchCache* cache = nullptr);
 
 /*!
  * @brief Solves with PR-IMM algorithm. For monotonic & sub-modular cases only.
@@ -148,10 +178,11 @@ IMMResult PR_IMM_Static(const IMMGraph& graph, const SeedSet& seeds, const Stati
  * @param graph The whole graph
  * @param seeds The seed set
  * @param args Arguments of the algorithm
+ * @param cache The sketch cache (see sketchcache.h), or nullptr if disabled
  * @return an IMMResult object as the algorithm result
  * @throw std::bad_cast if args is neither DynamicArgs_PR_IMM nor StaticArgs
  */
-IMMResult PR_IMM(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args);
+IMMResult PR_IMM(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args, SketchCache* cache = nullptr);
 
 /*!
  * @brief Solves the lower bound part of SA-IMM or SA-RG-IMM algorithm with dynamic sample size.
@@ -198,13 +229,17 @@ IMMResult SA_IMM_LB(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs
  *   - Upper bound: performs PR-IMM algorithm on a "upper bound" node state priority
  *   - Lower bound: performs SA-IMM-LB algorithm. See SA_IMM_LB(graph, seeds, args) for details.
  *
+ * The two parts run concurrently if args.nThreads allows, with the lower bound on its own thread
+ * and the upper bound on the rest. Each part checks its own time and memory budget.
+ *
  * @param graph The whole graph.
  * @param seeds The seed set.
  * @param args Arguments of the algorithm
+ * @param cache The sketch cache used by the upper bound part, or nullptr if disabled
  * @return an IMMResult3 object as the algorithm result.
  * @throw std::bad_cast if conversion of argument type fails.
  */
-IMMResult3 SA_IMM(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args);
+IMMResult3 SA_IMM(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args, SketchCache* cache = nullptr);
 
 /*!
  * @brief Solves with greedy algorithm.
@@ -226,6 +261,10 @@ IMMResult3 SA_IMM(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs&
  *          S += { argmax_v gain(v) }
  *      return S
  *
+ * If the priority is monotonic and submodular, lazy forward evaluation (CELF++) is used instead:
+ * marginal gains evaluated in earlier rounds are kept in a max-heap as upper bounds,
+ * and only the candidate on the top is re-evaluated in each step.
+ *
  * @param graph The whole graph
  * @param seeds The seed set
  * @param args Arguments of the algorithm
@@ -246,6 +285,12 @@ GreedyResult greedy(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs
  */
 GreedyResult maxDegree(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args);
 
+/*!
+ * @brief Computes the PageRank score of each node, which depends on the graph only.
+ * @return A list of |V| scores.
+ */
+std::vector<double> pageRankScores(const IMMGraph& graph);
+
 /*!
  * @brief Solves with PageRank algorithm.
  *
@@ -254,9 +299,11 @@ GreedyResult maxDegree(const IMMGraph& graph, const SeedSet& seeds, const BasicA
  * @param graph The whole graph
  * @param seeds The seed set
  * @param args Arguments of the algorithm
+ * @param scores PageRank scores of the graph computed before (see pageRankScores), or nullptr to compute here
  * @return A GreedyResult object as the algorithm result.
  */
-GreedyResult pageRank(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args);
+GreedyResult pageRank(const IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args,
+                      const std::vector<double>* scores = nullptr);
 
 
 #endif //DAWNSEEKER_IMM_H
\ No newline at end of file
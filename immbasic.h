@@ -6,11 +6,10 @@
 #include <array>
 #include <compare>
 #include <random>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
-struct ReturnsValueTag {};
-inline auto returnsValue = ReturnsValueTag{};
-
 enum class NodeState {
     None = 0,       // Neither positive nor negative
     CaPlus = 1,     // Ca+: Boosted node with positive message
@@ -72,46 +71,6 @@ constexpr const char* toString(LinkState t) {
 using NodeStatePriorityArray = std::array<int, 5>;
 using NodeStateGainArray = std::array<double, 5>;
 
-/*
-* Let f(S) = the total gain with S = the set of boosted nodes
-*            as the expected number of extra nodes that get positive message due to S
-*            compared to that with no boosted nodes
-*     g(S) = the total gain with S = the set of boosted nodes
-*            as the expected number of nodes prevented from negative message due to S
-*            compared to that with no boosted nodes
-* Then the objective function h(S) = lambda * f(S) + (1-lambda) * g(S)
-* Gain of each node state (with parameter lambda):
-*   None:   0
-*   Ca+:    lambda
-*   Ca:     lambda
-*   Cr:     -(1-lambda)
-*   Cr-:    0
-*/
-inline NodeStateGainArray nodeStateGain;
-
-/*
-* Priority of the node states, higher is better
-* e.g. for the case Ca+ > Cr- > Cr > Ca,
-*       priority[Ca+]  = 3,
-*       priority[Cr-]  = 2,
-*       priority[Cr]   = 1,
-*       priority[Ca]   = 0,
-*       priority[None] = -1 (None is always considered the lowest)
-*/
-inline NodeStatePriorityArray nodeStatePriority;
-
-/*
-* Compares two node states by priority
-* A > B means A has higher priority than B
-* WARNING ON (POSSIBLE) COMPILER BUG:
-*  Implicit comparison operators (<, <=, etc.) may fail to work correctly
-*   in GCC 11.2 and/or other compilers
-*  Use explicit operator <=> instead. e.g. (A <=> B) == std::strong_ordering::greater
-*/
-inline std::strong_ordering operator <=> (NodeState A, NodeState B) {
-    return nodeStatePriority[static_cast<int>(A)] <=> nodeStatePriority[static_cast<int>(B)];
-}
-
 /*
  * Compares two node states by priority
  * compare(A, B)  > 0 means A has higher priority than B
@@ -122,13 +81,6 @@ inline int compare(const NodeStatePriorityArray& priority, NodeState A, NodeStat
     return priority[static_cast<int>(A)] - priority[static_cast<int>(B)];
 }
 
-/*
- * Compares with the global priority array
- */
-inline int compare(NodeState A, NodeState B) {
-    return compare(nodeStatePriority, A, B);
-}
-
 /*
  * Checks equality of two node states
  * A more efficient overload since priority[] is not cared about.
@@ -144,13 +96,6 @@ inline std::strong_ordering operator <=> (LinkState A, LinkState B) {
     return static_cast<int>(A) <=> static_cast<int>(B);
 }
 
-/*
-* Gets the gain of certain state
-*/
-inline double gain(NodeState state) {
-    return nodeStateGain[static_cast<int>(state)];
-}
-
 /*
 * Gets whether the state is positive (Ca+ or Ca)
 */
@@ -166,24 +111,40 @@ inline bool isNegative(NodeState state) {
 }
 
 /*
-* Sets the gain of each state with given parameter lambda
+* Let f(S) = the total gain with S = the set of boosted nodes
+*            as the expected number of extra nodes that get positive message due to S
+*            compared to that with no boosted nodes
+*     g(S) = the total gain with S = the set of boosted nodes
+*            as the expected number of nodes prevented from negative message due to S
+*            compared to that with no boosted nodes
+* Then the objective function h(S) = lambda * f(S) + (1-lambda) * g(S)
+* Gain of each node state (with parameter lambda):
+*   None:   0
+*   Ca+:    lambda
+*   Ca:     lambda
+*   Cr:     -(1-lambda)
+*   Cr-:    0
 */
-inline void setNodeStateGain(double lambda) {
+inline NodeStateGainArray makeNodeStateGain(double lambda) {
+    auto dest = NodeStateGainArray{};
     // Default state: 0.0
-    nodeStateGain[static_cast<int>(NodeState::None)] = 0.0;
+    dest[static_cast<int>(NodeState::None)] = 0.0;
     // Gain with positive state: lambda
-    nodeStateGain[static_cast<int>(NodeState::CaPlus)] = lambda;
-    nodeStateGain[static_cast<int>(NodeState::Ca)] = lambda;
+    dest[static_cast<int>(NodeState::CaPlus)] = lambda;
+    dest[static_cast<int>(NodeState::Ca)] = lambda;
     // Gain with negative state: - (1.0 - lambda)
-    nodeStateGain[static_cast<int>(NodeState::Cr)] = lambda - 1.0;
+    dest[static_cast<int>(NodeState::Cr)] = lambda - 1.0;
     // Gain with neutralized negative state: 0
-    nodeStateGain[static_cast<int>(NodeState::CrMinus)] = 0.0;
+    dest[static_cast<int>(NodeState::CrMinus)] = 0.0;
+
+    return dest;
 }
 
 /*!
- * @brief Sets the priority of each node state and returns the priority array as result.
+ * @brief Gets the priority array of node states.
  *
- * The priority values shall be a permutation of [0, 1, 2, 3]. Higher value refers to higher priority.
+ * The priority values shall be a permutation of [0, 1, 2, 3]. Higher value refers to higher priority,
+ * and None is always considered the lowest with priority -1.
  *
  * e.g. For the case Ca+ > Cr- > Cr > Ca,
  *  - caPlus  = 3 (highest)
@@ -198,13 +159,13 @@ inline void setNodeStateGain(double lambda) {
  * @return The priority array
  * @throw std::invalid_argument if the arguments do not satisfy the constraints above.
  */
-inline NodeStatePriorityArray setNodeStatePriority(ReturnsValueTag, int caPlus, int ca, int cr, int crMinus) {
+inline NodeStatePriorityArray makeNodeStatePriority(int caPlus, int ca, int cr, int crMinus) {
     // Checks the arguments to ensure they cover {0, 1, 2, 3}
     if (((1 << caPlus) | (1 << ca) | (1 << cr) | (1 << crMinus)) != 0b1111) {
         throw std::invalid_argument("Input priority values are not a permutation of [0, 1, 2, 3]");
     }
 
-    auto dest = std::array<int, 5>{};
+    auto dest = NodeStatePriorityArray{};
     dest[static_cast<int>(NodeState::None)] = -1;
     dest[static_cast<int>(NodeState::CaPlus)] = caPlus;
     dest[static_cast<int>(NodeState::Ca)] = ca;
@@ -215,27 +176,122 @@ inline NodeStatePriorityArray setNodeStatePriority(ReturnsValueTag, int caPlus,
 }
 
 /*!
- * @brief Sets the global node state priority.
- *
- * See setNodeStatePriority(caPlus, ca, cr, crMinus) for details.
+ * @brief Node state priority fixed at compile time, with which comparisons in the kernels fold to constants.
  *
- * @param caPlus Priority of Ca+
- * @param ca Priority of Ca
- * @param cr Priority of Cr
- * @param crMinus Priority of Cr-
- * @throw std::invalid_argument if the arguments do not satisfy the constraints.
+ * See makeNodeStatePriority(caPlus, ca, cr, crMinus) for the meaning of template arguments.
  */
-inline void setNodeStatePriority(int caPlus, int ca, int cr, int crMinus) {
-    nodeStatePriority = setNodeStatePriority(returnsValue, caPlus, ca, cr, crMinus);
-}
+template <int CaPlus, int Ca, int Cr, int CrMinus>
+struct StaticNodeStatePriority {
+    static constexpr auto array = NodeStatePriorityArray{-1, CaPlus, Ca, Cr, CrMinus};
+
+    /*!
+     * @brief Checks whether A has higher priority than B, i.e. compare(array, A, B) > 0
+     */
+    static constexpr bool higher(NodeState A, NodeState B) {
+        return (higherMask >> (5 * static_cast<int>(A) + static_cast<int>(B))) & 1u;
+    }
+
+private:
+    // Bit (5 * A + B) is set iff A has higher priority than B,
+    //  thus each comparison is a shift on a constant instead of two loads from the priority array
+    static constexpr auto higherMask = []() {
+        auto mask = std::uint32_t{0};
+        for (int a = 0; a < 5; a++) {
+            for (int b = 0; b < 5; b++) {
+                if (array[a] > array[b]) {
+                    mask |= std::uint32_t{1} << (5 * a + b);
+                }
+            }
+        }
+        return mask;
+    }();
+};
+
+/*
+ * All the 24 node state priorities, i.e. each permutation of [0, 1, 2, 3] as priority of (Ca+, Ca, Cr, Cr-)
+ */
+inline constexpr auto allNodeStatePriorities = []() {
+    auto res = std::array<NodeStatePriorityArray, 24>{};
+    auto perm = std::array{0, 1, 2, 3};
+    for (auto& dest: res) {
+        dest = NodeStatePriorityArray{-1, perm[0], perm[1], perm[2], perm[3]};
+        std::next_permutation(perm.begin(), perm.end());
+    }
+    return res;
+}();
+
+/*
+ * The I-th node state priority of allNodeStatePriorities fixed at compile time
+ */
+template <std::size_t I>
+using StaticNodeStatePriorityAt = StaticNodeStatePriority<
+        allNodeStatePriorities[I][1], allNodeStatePriorities[I][2],
+        allNodeStatePriorities[I][3], allNodeStatePriorities[I][4]>;
 
 /*!
- * @brief Sets the global node state priority with given array.
- * @param arr The priority array
+ * @brief Node state priority and gain of a single run.
+ *
+ * The context object is passed explicitly to the sampling, selection and simulation routines,
+ * thus runs with different priorities or lambdas can share the same graph concurrently.
  */
-inline void setNodeStatePriority(const NodeStatePriorityArray& arr) {
-    nodeStatePriority = arr;
-}
+struct NodeStateContext {
+    NodeStatePriorityArray  priority{};     // The priority array, see makeNodeStatePriority
+    NodeStateGainArray      gains{};        // Gain of each state, see makeNodeStateGain
+    std::size_t             priorityId{};   // Index of the priority in allNodeStatePriorities
+
+    /*!
+     * @brief Gets the context with given node state priority and lambda.
+     * @param priority The priority array
+     * @param lambda The weight parameter lambda of the objective function
+     * @return The NodeStateContext object.
+     * @throw std::invalid_argument if the priority is not a permutation of [0, 1, 2, 3] with priority[None] = -1.
+     */
+    static NodeStateContext of(const NodeStatePriorityArray& priority, double lambda) {
+        auto it = rs::find(allNodeStatePriorities, priority);
+        if (it == allNodeStatePriorities.end()) {
+            throw std::invalid_argument("Input priority values are not a permutation of [0, 1, 2, 3]");
+        }
+        return NodeStateContext{
+            .priority = priority,
+            .gains = makeNodeStateGain(lambda),
+            .priorityId = (std::size_t)(it - allNodeStatePriorities.begin())
+        };
+    }
+
+    /*!
+     * @brief Calls func(StaticNodeStatePriority<...>{}) with the priority of this context fixed at compile time.
+     *
+     * func is instantiated with all the 24 priorities, and the one of this context is picked by a table lookup,
+     * thus the kernels can be dispatched once per call instead of looking up the priority array per comparison.
+     *
+     * @param func The function object, invoked with an empty object of some StaticNodeStatePriority type
+     * @return The return value of func.
+     */
+    template <class Func>
+    decltype(auto) visitPriority(Func&& func) const {
+        using Result = std::invoke_result_t<Func&, StaticNodeStatePriorityAt<0>>;
+        static constexpr auto table = []<std::size_t... I>(std::index_sequence<I...>) {
+            return std::array<Result (*)(Func&), sizeof...(I)>{
+                +[](Func& f) -> Result { return f(StaticNodeStatePriorityAt<I>{}); }...
+            };
+        }(std::make_index_sequence<allNodeStatePriorities.size()>{});
+        return table[priorityId](func);
+    }
+
+    /*!
+     * @brief Compares two node states by priority. See compare(priority, A, B) for details.
+     */
+    [[nodiscard]] int compare(NodeState A, NodeState B) const {
+        return ::compare(priority, A, B);
+    }
+
+    /*!
+     * @brief Gets the gain of certain state.
+     */
+    [[nodiscard]] double gain(NodeState state) const {
+        return gains[static_cast<int>(state)];
+    }
+};
 
 /*!
  * @brief A class that contains properties of some node priority.
@@ -330,7 +386,7 @@ struct NodePriorityProperty {
     /*!
      * @brief Gets a NodePriorityProperty object from given node state priority values.
      *
-     * See setNodeStatePriority(caPlus, ca, cr, crMinus) for details.
+     * See makeNodeStatePriority(caPlus, ca, cr, crMinus) for details.
      *
      * @param caPlus Priority of Ca+
      * @param ca Priority of Ca
@@ -340,7 +396,7 @@ struct NodePriorityProperty {
      * @throw std::invalid_argument if the arguments do not satisfy the constraints.
      */
     static NodePriorityProperty of(int caPlus, int ca, int cr, int crMinus) {
-        return of(setNodeStatePriority(returnsValue, caPlus, ca, cr, crMinus));
+        return of(makeNodeStatePriority(caPlus, ca, cr, crMinus));
     }
 
     /*!
@@ -349,44 +405,31 @@ struct NodePriorityProperty {
      * @return The NodePriorityProperty object of given node state priority.
      */
     static NodePriorityProperty of(const NodeStatePriorityArray& priority) {
-        auto oldPriority = nodeStatePriority;
-        // Temporarily sets to current priority
-        nodeStatePriority = priority;
-        // Gets current
-        auto res = current();
-        // and then restores
-        nodeStatePriority = oldPriority;
-        return res;
-    }
-
-    /*!
-     * @brief Gets a NodePriorityProperty object of the current node state priority.
-     * @return The NodePriorityProperty object of current node state priority.
-     */
-    static NodePriorityProperty current() {
         using enum NodeState;
-        constexpr auto greater = std::strong_ordering::greater;
+        auto higher = [&](NodeState A, NodeState B) {
+            return compare(priority, A, B) > 0;
+        };
 
         auto res = NodePriorityProperty{
-            .array = nodeStatePriority,
+            .array = priority,
             .monotonic = true,
             .submodular = false
         };
         // Non-monotonic cases
-        if (      (Ca <=> Cr) == greater          && (Cr <=> CaPlus) == greater         // (1) Ca  > Cr  > Ca+
-               || (Ca <=> CrMinus) == greater     && (CrMinus <=> CaPlus) == greater    // (2) Ca  > Cr- > Ca+
-               || (CrMinus <=> CaPlus) == greater && (CaPlus <=> Cr) == greater         // (3) Cr- > Ca+ > Cr
-               || (CrMinus <=> Ca) == greater     && (Ca <=> Cr) == greater) {          // (4) Cr- > Ca  > Cr
+        if (      higher(Ca, Cr) && higher(Cr, CaPlus)              // (1) Ca  > Cr  > Ca+
+               || higher(Ca, CrMinus) && higher(CrMinus, CaPlus)    // (2) Ca  > Cr- > Ca+
+               || higher(CrMinus, CaPlus) && higher(CaPlus, Cr)     // (3) Cr- > Ca+ > Cr
+               || higher(CrMinus, Ca) && higher(Ca, Cr)) {          // (4) Cr- > Ca  > Cr
             res.monotonic = false;
         }
         // Sub-modular cases
         static auto submodularCases = {
-                setNodeStatePriority(returnsValue, 3, 2, 0, 1), // Ca+ > Ca  > Cr- > Cr
-                setNodeStatePriority(returnsValue, 3, 0, 1, 2), // Ca+ > Cr- > Cr  > Ca
-                setNodeStatePriority(returnsValue, 1, 0, 2, 3)  // Cr- > Cr  > Ca+ > Ca
+                makeNodeStatePriority(3, 2, 0, 1), // Ca+ > Ca  > Cr- > Cr
+                makeNodeStatePriority(3, 0, 1, 2), // Ca+ > Cr- > Cr  > Ca
+                makeNodeStatePriority(1, 0, 2, 3)  // Cr- > Cr  > Ca+ > Ca
         };
         for (const auto& c: submodularCases) {
-            if (nodeStatePriority == c) {
+            if (priority == c) {
                 res.submodular = true;
             }
         }
@@ -562,20 +605,21 @@ public:
 };
 
 /*!
- * @brief Generates a random link state according to probabilities (p, pBoost).
+ * @brief Generates a random link state according to probabilities (p, pBoost) with given generator.
  *
  *   - With p probability:              Active
  *   - With (pBoost - p) probability:   Boosted
  *   - With (1 - pBoost) probability:   Blocked
  *
+ * @param gen The random generator, e.g. std::mt19937
  * @param p
  * @param pBoost
  * @return One of Active, Boosted or Blocked
  */
-inline LinkState getRandomState(double p, double pBoost) {
-    static auto gen = createMT19937Generator();
+template <class Gen>
+inline LinkState getRandomState(Gen& gen, double p, double pBoost) {
      //A = 2 ^ (-B) where B = number of bits of each generated unsigned integer
-    constexpr static double A = quickPow(0.5, decltype(gen)::word_size);
+    constexpr static double A = quickPow(0.5, Gen::word_size);
 
     // Fast generation of pseudo-random value in [0, 1)
     double r = (double)gen() * A;
@@ -593,4 +637,18 @@ inline LinkState getRandomState(double p, double pBoost) {
     }
 }
 
+/*!
+ * @brief Generates a random link state according to probabilities (p, pBoost).
+ *
+ * The random generator of the current thread is used, thus it's safe in multi-threading cases.
+ * See getRandomState(gen, p, pBoost) for details.
+ *
+ * @param p
+ * @param pBoost
+ * @return One of Active, Boosted or Blocked
+ */
+inline LinkState getRandomState(double p, double pBoost) {
+    return getRandomState(threadLocalMT19937Generator(), p, pBoost);
+}
+
 #endif //DAWNSEEKER_IMMBASIC_H
\ No newline at end of file
@@ -7,7 +7,10 @@
 
 #include <fstream>
 #include "args-v2.h"
+#include "generators.h"
 #include "graphbasic.h"
+#include "memory.h"
+#include "metrics.h"
 
 /*!
  * @brief Reads the graph from given input stream.
@@ -55,6 +58,7 @@ inline IMMGraph readGraph(std::istream& in) {
  * @return The graph object.
  */
 inline IMMGraph readGraph(const fs::path& path) {
+    auto phase = metrics::ScopedPhase(metrics::Phase::GraphLoad);
     auto fin = std::ifstream(path);
     if (!fin.is_open()) {
         throw std::invalid_argument("Graph file not found!");
@@ -96,6 +100,7 @@ inline SeedSet readSeedSet(std::istream& in) {
  * @return The seed set object.
  */
 inline SeedSet readSeedSet(const fs::path& path) {
+    auto phase = metrics::ScopedPhase(metrics::Phase::GraphLoad);
     auto fin = std::ifstream(path);
     if (!fin.is_open()) {
         throw std::invalid_argument("Seed file not found!");
@@ -103,6 +108,20 @@ inline SeedSet readSeedSet(const fs::path& path) {
     return readSeedSet(fin);
 }
 
+/*!
+ * @brief Reads the seed set from given file path, or generates it if the path is a generator specification.
+ *
+ * See readSeedSet(const fs::path&) and gen::generateSeedSet for details.
+ *
+ * @param graph The whole graph
+ * @param path File path or generator specification starting with "gen:"
+ * @return The seed set object.
+ */
+inline SeedSet loadSeedSet(const IMMGraph& graph, const std::string& path) {
+    auto scope = memory::ScopedSubsystem(memory::Subsystem::Graph);
+    return gen::isGeneratorSpec(path) ? gen::generateSeedSet(graph, path) : readSeedSet(path);
+}
+
 /*!
  * @brief An all-in-one interface to handle input.
  *
@@ -110,7 +129,9 @@ inline SeedSet readSeedSet(const fs::path& path) {
  *   - Parses the program arguments (argc, argv) and wraps all the algorithm arguments into an object
  *     (see prepareProgramArgs and getAlgorithmArgs for details);
  *   - Reads the graph and seed set from given file path
- *     (see readGraph and readSeedSet for details).
+ *     (see readGraph and readSeedSet for details),
+ *     or generates them in-process if the path is a generator specification starting with "gen:"
+ *     (see gen::generateGraph and gen::generateSeedSet for details).
  *
  * @param argc
  * @param argv
@@ -124,9 +145,21 @@ inline auto handleInput(int argc, char** argv) {
     };
 
     auto argSet = prepareProgramArgs(argc, argv);
-    auto graph  = readGraph(argSet.s["graph-path"]);
-    auto seeds  = readSeedSet(argSet.s["seed-set-path"]);
-    auto args   = getAlgorithmArgs(graph.nNodes(), argSet);
+    auto graphPath = argSet.s["graph-path"];
+    auto seedSetPath = argSet.s["seed-set-path"];
+    auto nThreads = std::clamp<std::size_t>(argSet.getValueOr("n-threads", std::size_t{1}),
+                                            1, std::thread::hardware_concurrency());
+
+    auto scope = memory::ScopedSubsystem(memory::Subsystem::Graph);
+    auto graph = [&]() {
+        if (!gen::isGeneratorSpec(graphPath)) {
+            return readGraph(graphPath);
+        }
+        auto phase = metrics::ScopedPhase(metrics::Phase::GraphLoad);
+        return gen::generateGraph(graphPath, nThreads);
+    }();
+    auto seeds = loadSeedSet(graph, seedSetPath);
+    auto args  = getAlgorithmArgs(graph.nNodes(), argSet);
 
     return ResultType{
         .graph = std::move(graph), // NOLINT(performance-move-const-arg)
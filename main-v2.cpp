@@ -2,68 +2,58 @@
 // Created by Onlynagesha on 2022/5/8.
 //
 
-#include "imm.h"
+#include "dispatch.h"
 #include "input.h"
 #include "Logger.h"
-#include "simulate.h"
-
-void doSimulation(
-        IMMGraph&                       graph,
-        const SeedSet&                  seeds,
-        const std::vector<std::size_t>& boostedNodes,
-        const BasicArgs&                args) {
-    auto simRes = simulate(graph, seeds, boostedNodes, args.kList, args.testTimes, args.nThreads);
-    for (std::size_t i = 0; i != args.kList.size(); i++) {
-        LOG_INFO(format("Simulation results with k = {}: {}",
-                        args.kList[i], toString(simRes[i], true)));
-    }
-}
-
-template <class ResultType>
-void doSimulation(IMMGraph& graph, const SeedSet& seeds, const ResultType& algoRes, const BasicArgs& args) {
-    for (const auto& [nSamples, resItem]: algoRes.items) {
-        LOG_INFO(format("Starts simulation for result with {} samples:", nSamples));
-        doSimulation(graph, seeds, resItem.boostedNodes, args);
-    }
-}
+#include "perf.h"
+#include "service.h"
+#include "trace.h"
 
 int mainWorker(int argc, char** argv) {
     auto [graph, seeds, args] = handleInput(argc, argv);
     LOG_INFO("Overall Arguments:\n" + args->dump());
+    if (args->perfCounters) {
+        perf::enable();
+    }
+    if (!args->tracePath.empty()) {
+        trace::enable();
+    }
 
-    if (args->algo == AlgorithmLabel::PR_IMM) {
-        auto res = PR_IMM(graph, seeds, *args);
-        doSimulation(graph, seeds, res, *args);
-    } else if (args->algo == AlgorithmLabel::SA_IMM || args->algo == AlgorithmLabel::SA_RG_IMM) {
-        auto res = SA_IMM(graph, seeds, *args);
-        for (auto i: {0, 1}) {
-            LOG_INFO(format("Starts simulation for the result of label '{}':", res.labels[i]));
-            doSimulation(graph, seeds, res[i], *args);
-        }
-    } else {
-        auto res = GreedyResult{};
-        if (args->algo == AlgorithmLabel::Greedy) {
-            res = greedy(graph, seeds, *args);
-        } else if (args->algo == AlgorithmLabel::MaxDegree) {
-            res = maxDegree(graph, seeds, *args);
-        } else if (args->algo == AlgorithmLabel::PageRank) {
-            res = pageRank(graph, seeds, *args);
-        } else {
-            throw std::logic_error("Unexpected case of algorithm selection: unimplemented or wrong logic");
-        }
-        LOG_INFO(format("Result of {} algorithm: {}", args->algo, utils::join(res.boostedNodes, ", ", "[", "]")));
-        doSimulation(graph, seeds, res.boostedNodes, *args);
+    if (!args->serve.empty()) {
+        auto code = runService(graph, seeds, *args, argc, argv);
+        logPerformanceSummary();
+        writeReport(graph, *args, {});
+        writeTrace(*args);
+        return code;
+    }
+    if (!args->batchPath.empty()) {
+        auto nFailed = runBatch(graph, seeds, *args, argc, argv);
+        logPerformanceSummary();
+        writeReport(graph, *args, {});
+        writeTrace(*args);
+        return nFailed == 0 ? 0 : 1;
     }
 
+    auto results = runAlgorithm(graph, seeds, *args);
+    doSimulation(graph, seeds, results, *args);
+    logPerformanceSummary();
+
+    writeReport(graph, *args, results);
+    writeTrace(*args);
     return 0;
 }
 
 int main(int argc, char** argv) try {
-    // To standard output
-    logger::Loggers::add(std::make_shared<logger::Logger>("output", std::cout, logger::LogLevel::Debug));
+    trace::setThreadName("main");
+    // To standard output, or standard error in service mode over stdin where the responses are written to stdout
+    auto& logStream = servesStdin(argc, argv) ? std::cerr : std::cout;
+    auto output = std::make_shared<logger::Logger>("output", logStream, logger::LogLevel::Debug);
+    // Lines are written by a background thread, thus logging never blocks the algorithms
+    output->setAsync(true);
+    logger::Loggers::add(output);
     return mainWorker(argc, argv);
 } catch (std::exception& e) {
     LOG_CRITICAL("Exception caught: "s + e.what());
     LOG_CRITICAL("Abort.");
     return -1;
-}
\ No newline at end of file
+}
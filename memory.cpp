@@ -0,0 +1,230 @@
+//
+// Created by Onlynagesha on 2022/5/26.
+//
+
+#include <cstdlib>
+#include <malloc.h>
+#include <mutex>
+#include <new>
+#include "memory.h"
+
+namespace {
+    // Guards the acquisition and release of account slots
+    std::mutex accountMutex;
+    std::array<bool, memory::nAccountSlots> accountSlotUsed{};
+}
+
+memory::Account::Account() {
+    auto lock = std::scoped_lock(accountMutex);
+    for (std::uint32_t i = 1; i != nAccountSlots; i++) {
+        if (!accountSlotUsed[i]) {
+            accountSlotUsed[i] = true;
+            // Blocks of the previous owner are left out since the generation changes
+            accountCounters[i].current.store(0, std::memory_order_relaxed);
+            accountCounters[i].peak.store(0, std::memory_order_relaxed);
+            auto generation = accountGenerations[i].fetch_add(1, std::memory_order_relaxed) + 1;
+            _tag = {.slot = i, .generation = generation};
+            return;
+        }
+    }
+}
+
+memory::Account::~Account() {
+    if (_tag.slot == 0) {
+        return;
+    }
+    auto lock = std::scoped_lock(accountMutex);
+    accountGenerations[_tag.slot].fetch_add(1, std::memory_order_relaxed);
+    accountSlotUsed[_tag.slot] = false;
+}
+
+std::size_t memory::Account::peakBytes() const {
+    if constexpr (MEMORY_TRACKING) {
+        const auto& counter = _tag.alive() ? accountCounters[_tag.slot] : totalCounter;
+        return (std::size_t)std::max<std::int64_t>(0, counter.peak.load(std::memory_order_relaxed));
+    } else {
+        return peakResidentMemoryBytes();
+    }
+}
+
+memory::Snapshot memory::snapshot() {
+    auto res = Snapshot{};
+    for (std::size_t i = 0; i != nSubsystems; i++) {
+        // Blocks freed by another subsystem may make a counter negative transiently
+        res.current[i] = (std::size_t)std::max<std::int64_t>(0, subsystemCounters[i].current.load());
+        res.peak[i] = (std::size_t)std::max<std::int64_t>(0, subsystemCounters[i].peak.load());
+    }
+    res.totalCurrent = (std::size_t)std::max<std::int64_t>(0, totalCounter.current.load());
+    res.totalPeak = (std::size_t)std::max<std::int64_t>(0, totalCounter.peak.load());
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    auto info = mallinfo2();
+    // arena: bytes of the main and thread arenas; hblkhd: bytes of the blocks allocated by mmap
+    res.heapInUse = info.uordblks + info.hblkhd;
+    res.heapReserved = info.arena + info.hblkhd;
+#endif
+    res.resident = residentMemoryBytes();
+    res.peakResident = peakResidentMemoryBytes();
+    return res;
+}
+
+#if MEMORY_TRACKING
+
+namespace {
+    // Each block is prefixed with a header recording its subsystem and account.
+    // Header size keeps the default alignment of malloc for the block returned.
+    struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) Header {
+        memory::Subsystem   subsystem;
+        memory::AccountTag  account;
+    };
+    constexpr std::size_t headerSize = sizeof(Header);
+
+    void count(void* base, Header* header) {
+        auto bytes = (std::int64_t)malloc_usable_size(base);
+        header->subsystem = memory::currentSubsystem();
+        header->account = memory::currentAccount();
+        memory::subsystemCounters[static_cast<std::size_t>(header->subsystem)].add(bytes);
+        memory::totalCounter.add(bytes);
+        if (header->account.alive()) {
+            memory::accountCounters[header->account.slot].add(bytes);
+        }
+    }
+
+    void uncount(void* base, const Header* header) {
+        auto bytes = (std::int64_t)malloc_usable_size(base);
+        memory::subsystemCounters[static_cast<std::size_t>(header->subsystem)].sub(bytes);
+        memory::totalCounter.sub(bytes);
+        if (header->account.alive()) {
+            memory::accountCounters[header->account.slot].sub(bytes);
+        }
+    }
+
+    // Returns nullptr on failure
+    void* allocate(std::size_t size) noexcept {
+        auto* base = std::malloc(size + headerSize);
+        if (base == nullptr) {
+            return nullptr;
+        }
+        auto* header = static_cast<Header*>(base);
+        count(base, header);
+        return header + 1;
+    }
+
+    // For alignment > default, the header lies right before the block, with the block offset by the alignment
+    void* allocate(std::size_t size, std::align_val_t al) noexcept {
+        auto align = std::max(static_cast<std::size_t>(al), headerSize);
+        auto* base = (void*)nullptr;
+        if (posix_memalign(&base, align, size + align) != 0) {
+            return nullptr;
+        }
+        auto* block = static_cast<char*>(base) + align;
+        count(base, reinterpret_cast<Header*>(block) - 1);
+        return block;
+    }
+
+    void deallocate(void* ptr) noexcept {
+        if (ptr == nullptr) {
+            return;
+        }
+        auto* header = static_cast<Header*>(ptr) - 1;
+        uncount(header, header);
+        std::free(header);
+    }
+
+    void deallocate(void* ptr, std::align_val_t al) noexcept {
+        if (ptr == nullptr) {
+            return;
+        }
+        auto align = std::max(static_cast<std::size_t>(al), headerSize);
+        auto* base = static_cast<char*>(ptr) - align;
+        uncount(base, static_cast<Header*>(ptr) - 1);
+        std::free(base);
+    }
+
+    // Loops with the new-handler as required by the standard
+    template <class... Args>
+    void* allocateOrThrow(std::size_t size, Args... args) {
+        for (;;) {
+            if (auto* p = allocate(size, args...)) {
+                return p;
+            }
+            auto handler = std::get_new_handler();
+            if (handler == nullptr) {
+                throw std::bad_alloc();
+            }
+            handler();
+        }
+    }
+
+    template <class... Args>
+    void* allocateOrNull(std::size_t size, Args... args) noexcept {
+        try {
+            return allocateOrThrow(size, args...);
+        } catch (...) {
+            return nullptr;
+        }
+    }
+}
+
+void* operator new(std::size_t size) {
+    return allocateOrThrow(size);
+}
+void* operator new[](std::size_t size) {
+    return allocateOrThrow(size);
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return allocateOrNull(size);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return allocateOrNull(size);
+}
+void* operator new(std::size_t size, std::align_val_t al) {
+    return allocateOrThrow(size, al);
+}
+void* operator new[](std::size_t size, std::align_val_t al) {
+    return allocateOrThrow(size, al);
+}
+void* operator new(std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+    return allocateOrNull(size, al);
+}
+void* operator new[](std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+    return allocateOrNull(size, al);
+}
+
+void operator delete(void* ptr) noexcept {
+    deallocate(ptr);
+}
+void operator delete[](void* ptr) noexcept {
+    deallocate(ptr);
+}
+void operator delete(void* ptr, std::size_t) noexcept {
+    deallocate(ptr);
+}
+void operator delete[](void* ptr, std::size_t) noexcept {
+    deallocate(ptr);
+}
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    deallocate(ptr);
+}
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    deallocate(ptr);
+}
+void operator delete(void* ptr, std::align_val_t al) noexcept {
+    deallocate(ptr, al);
+}
+void operator delete[](void* ptr, std::align_val_t al) noexcept {
+    deallocate(ptr, al);
+}
+void operator delete(void* ptr, std::size_t, std::align_val_t al) noexcept {
+    deallocate(ptr, al);
+}
+void operator delete[](void* ptr, std::size_t, std::align_val_t al) noexcept {
+    deallocate(ptr, al);
+}
+void operator delete(void* ptr, std::align_val_t al, const std::nothrow_t&) noexcept {
+    deallocate(ptr, al);
+}
+void operator delete[](void* ptr, std::align_val_t al, const std::nothrow_t&) noexcept {
+    deallocate(ptr, al);
+}
+
+#endif
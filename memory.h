@@ -0,0 +1,346 @@
+//
+// Created by Onlynagesha on 2022/5/26.
+//
+
+#ifndef DAWNSEEKER_MEMORY_H
+#define DAWNSEEKER_MEMORY_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include "global.h"
+
+/*!
+ * @brief Gets the resident set size of the current process, read from /proc/self/statm.
+ * @return Size in bytes, or 0 if unavailable.
+ */
+inline std::size_t residentMemoryBytes() {
+    auto fin = std::ifstream("/proc/self/statm");
+    auto nPagesTotal = std::size_t{0};
+    auto nPagesResident = std::size_t{0};
+    if (!(fin >> nPagesTotal >> nPagesResident)) {
+        return 0;
+    }
+    return nPagesResident * (std::size_t)sysconf(_SC_PAGESIZE);
+}
+
+/*!
+ * @brief Gets the peak resident set size of the current process, read from VmHWM of /proc/self/status.
+ * @return Size in bytes, or 0 if unavailable.
+ */
+inline std::size_t peakResidentMemoryBytes() {
+    auto fin = std::ifstream("/proc/self/status");
+    for (std::string key; fin >> key; ) {
+        if (key == "VmHWM:") {
+            auto kiB = std::size_t{0};
+            fin >> kiB;
+            return kiB * 1024;
+        }
+        fin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+    return 0;
+}
+
+/*!
+ * @brief Resets the peak resident set size to the current one, so that peaks of separated stages can be measured.
+ * @return false if not supported (requires Linux 4.0 or later).
+ */
+inline bool resetPeakResidentMemory() {
+    auto fout = std::ofstream("/proc/self/clear_refs");
+    return static_cast<bool>(fout << "5" << std::flush);
+}
+
+// Whether the counting allocator (memory.cpp) replaces the global operator new and delete.
+#ifndef MEMORY_TRACKING
+#define MEMORY_TRACKING 0
+#endif
+
+/*!
+ * @brief Allocator-level memory accounting with a per-subsystem breakdown.
+ *
+ * With MEMORY_TRACKING = 1, every allocation via operator new is counted
+ * by the bytes the allocator actually reserves for it (i.e. malloc_usable_size, rounding included),
+ * and attributed to the subsystem of the allocating thread at that time.
+ * The subsystem is recorded with the memory block, thus a block freed by another thread or subsystem
+ * is still subtracted from the one it is counted in.
+ *
+ * The subsystem of a thread is set by ScopedSubsystem, and inherited by the workers of parallel calls
+ * (see ThreadPool). Allocations outside any scope are counted as Other.
+ *
+ * Allocations are also counted in the account of the allocating thread if any (see Account),
+ * so that the peak of each query is measured on its own while other queries run concurrently.
+ *
+ * Besides, allocator statistics (mallinfo2 with glibc 2.33 or later) and the resident set size
+ * are sampled in snapshots, which also cover fragmentation, free lists and memory not allocated via operator new.
+ */
+namespace memory {
+    enum class Subsystem : std::size_t {
+        // Allocations outside any scope
+        Other,
+        // The graph and the seed set
+        Graph,
+        // Per-worker buffers reused across samples, e.g. PRR-sketch objects and link states in sampling contexts
+        Workspace,
+        // PRR-sketch collections, including the growth of workspace buffers during sampling
+        Sketches,
+        // Greedy selection on the sketches
+        Selection,
+        // Forward simulation and greedy evaluation
+        Simulation
+    };
+    constexpr std::size_t nSubsystems = 6;
+
+    constexpr const char* subsystemNames[nSubsystems] = {
+        "other", "graph", "workspace", "sketches", "selection", "simulation"
+    };
+
+    /*!
+     * @brief Bytes counted by the allocator, written in memory.cpp.
+     *
+     * Constant-initialized, thus valid for allocations before main() starts.
+     */
+    struct alignas(64) Counter {
+        std::atomic<std::int64_t>   current{0};
+        std::atomic<std::int64_t>   peak{0};
+
+        void add(std::int64_t n) {
+            auto cur = current.fetch_add(n, std::memory_order_relaxed) + n;
+            // Compare-and-swap only when a new peak is reached, which is rare after warming up
+            for (auto p = peak.load(std::memory_order_relaxed);
+                 cur > p && !peak.compare_exchange_weak(p, cur, std::memory_order_relaxed); );
+        }
+
+        void sub(std::int64_t n) {
+            current.fetch_sub(n, std::memory_order_relaxed);
+        }
+    };
+
+    inline constinit std::array<Counter, nSubsystems>   subsystemCounters{};
+    inline constinit Counter                            totalCounter{};
+
+    // Number of account slots, where slot 0 stands for no account
+    constexpr std::size_t nAccountSlots = 64;
+
+    /*!
+     * @brief Counters of the account slots, and the generation of each slot,
+     *        which is increased each time the slot is acquired or released.
+     *
+     * A block is subtracted from its slot only if the generation is unchanged since it's allocated,
+     * thus blocks outliving their accounts (e.g. cached sketches) are not subtracted from the next owner of the slot.
+     */
+    inline constinit std::array<Counter, nAccountSlots>                     accountCounters{};
+    inline constinit std::array<std::atomic<std::uint32_t>, nAccountSlots>  accountGenerations{};
+
+    /*!
+     * @brief Identifies an account by its slot and the generation of the slot when acquired.
+     */
+    struct AccountTag {
+        std::uint32_t   slot = 0;
+        std::uint32_t   generation = 0;
+
+        // Whether the tag refers to an account that is still alive
+        [[nodiscard]] bool alive() const {
+            return slot != 0 && accountGenerations[slot].load(std::memory_order_relaxed) == generation;
+        }
+    };
+
+    /*!
+     * @brief Gets the account of the calling thread, which new allocations are counted in.
+     */
+    inline AccountTag& currentAccount() {
+        thread_local constinit AccountTag account{};
+        return account;
+    }
+
+    /*!
+     * @brief A memory account with its own peak, e.g. of a query, held by a slot during its lifetime.
+     *
+     * Allocations are counted in the account only by the threads inside its ScopedAccount,
+     * and the workers of their parallel calls (see ThreadPool).
+     * If all the slots are taken, the account falls back to the process-wide counters.
+     */
+    class Account {
+    public:
+        Account();
+        Account(const Account&) = delete;
+        Account& operator = (const Account&) = delete;
+        ~Account();
+
+        [[nodiscard]] AccountTag tag() const {
+            return _tag;
+        }
+
+        /*!
+         * @brief Gets the peak bytes counted in the account,
+         *        or the process-wide ones if no slot is held (see memory::peakBytes).
+         */
+        [[nodiscard]] std::size_t peakBytes() const;
+
+    private:
+        AccountTag  _tag;
+    };
+
+    /*!
+     * @brief Counts the allocations of the calling thread in an account during its lifetime.
+     */
+    class ScopedAccount {
+    public:
+        explicit ScopedAccount(AccountTag tag): old(std::exchange(currentAccount(), tag)) {}
+
+        ScopedAccount(const ScopedAccount&) = delete;
+
+        ~ScopedAccount() {
+            currentAccount() = old;
+        }
+
+    private:
+        AccountTag old;
+    };
+
+    /*!
+     * @brief Gets the subsystem of the calling thread, which new allocations are attributed to.
+     */
+    inline Subsystem& currentSubsystem() {
+        thread_local constinit Subsystem subsystem = Subsystem::Other;
+        return subsystem;
+    }
+
+    /*!
+     * @brief Attributes the allocations of the calling thread to a subsystem during its lifetime.
+     */
+    class ScopedSubsystem {
+    public:
+        explicit ScopedSubsystem(Subsystem s): old(std::exchange(currentSubsystem(), s)) {}
+
+        ScopedSubsystem(const ScopedSubsystem&) = delete;
+
+        ~ScopedSubsystem() {
+            currentSubsystem() = old;
+        }
+
+    private:
+        Subsystem old;
+    };
+
+    /*!
+     * @brief Current and peak bytes at some time point.
+     *
+     * Peak of each subsystem is taken independently, thus they may not sum up to the total peak.
+     * Allocator statistics are 0 if unavailable.
+     */
+    struct Snapshot {
+        // Whether the counting allocator is enabled. If not, all the counted bytes are 0.
+        bool                                tracked = MEMORY_TRACKING;
+        std::array<std::size_t, nSubsystems> current{};
+        std::array<std::size_t, nSubsystems> peak{};
+        std::size_t                         totalCurrent{};
+        std::size_t                         totalPeak{};
+        // Bytes in use by the allocator, including the ones not allocated via operator new
+        std::size_t                         heapInUse{};
+        // Bytes obtained by the allocator from the system, including free chunks and fragmentation
+        std::size_t                         heapReserved{};
+        // Resident set size of the process and its peak
+        std::size_t                         resident{};
+        std::size_t                         peakResident{};
+    };
+
+    /*!
+     * @brief Takes the snapshot of the counters, allocator statistics and resident set size.
+     *
+     * Reading the allocator statistics and resident set size takes system calls and locks,
+     * thus it should not be called in hot loops.
+     */
+    Snapshot snapshot();
+
+    /*!
+     * @brief Gets the peak bytes counted in the account of the calling thread if any,
+     *        otherwise the ones counted since the program starts.
+     *        The peak resident set size is returned instead if the counting allocator is disabled.
+     */
+    inline std::size_t peakBytes() {
+        if constexpr (MEMORY_TRACKING) {
+            auto account = currentAccount();
+            const auto& counter = account.alive() ? accountCounters[account.slot] : totalCounter;
+            return (std::size_t)std::max<std::int64_t>(0, counter.peak.load(std::memory_order_relaxed));
+        } else {
+            return peakResidentMemoryBytes();
+        }
+    }
+
+    /*!
+     * @brief Gets the bytes counted currently in an account if it's alive,
+     *        otherwise the ones counted in the whole process.
+     *        The resident set size is returned instead if the counting allocator is disabled.
+     */
+    inline std::size_t currentBytes(AccountTag account) {
+        if constexpr (MEMORY_TRACKING) {
+            const auto& counter = account.alive() ? accountCounters[account.slot] : totalCounter;
+            return (std::size_t)std::max<std::int64_t>(0, counter.current.load(std::memory_order_relaxed));
+        } else {
+            return residentMemoryBytes();
+        }
+    }
+
+    /*!
+     * @brief Dumps the snapshot as a table of current and peak bytes per subsystem.
+     * @return A multi-line string, without trailing new-line character.
+     */
+    inline std::string toString(const Snapshot& s) {
+        auto res = std::string{};
+        if (s.tracked) {
+            for (std::size_t i = 0; i != nSubsystems; i++) {
+                res += format("    {:<12} current = {}, peak = {}\n", subsystemNames[i],
+                              utils::totalBytesUsedToString(s.current[i]), utils::totalBytesUsedToString(s.peak[i]));
+            }
+            res += format("    {:<12} current = {}, peak = {}\n", "total",
+                          utils::totalBytesUsedToString(s.totalCurrent), utils::totalBytesUsedToString(s.totalPeak));
+        } else {
+            res += "    (counting allocator disabled)\n";
+        }
+        res += format("    heap in use = {}, heap reserved = {}\n",
+                      utils::totalBytesUsedToString(s.heapInUse), utils::totalBytesUsedToString(s.heapReserved));
+        res += format("    resident = {}, peak resident = {}",
+                      utils::totalBytesUsedToString(s.resident), utils::totalBytesUsedToString(s.peakResident));
+        return res;
+    }
+
+    /*!
+     * @brief Dumps the snapshot as a JSON object.
+     *
+     * Format:
+     *
+     *      {
+     *        "tracked": true,
+     *        "subsystems": { "other": { "current": 1024, "peak": 2048 }, ... },
+     *        "total": { "current": 4096, "peak": 8192 },
+     *        "heapInUse": 4096, "heapReserved": 16384, "resident": 65536, "peakResident": 65536
+     *      }
+     *
+     * @param s The snapshot
+     * @param indent Indentation of the lines except the first one
+     * @return A multi-line string, without trailing new-line character.
+     */
+    inline std::string toJson(const Snapshot& s, int indent = 0) {
+        auto pad = std::string(std::max(0, indent), ' ');
+        auto res = std::string{"{\n"};
+        res += pad + format("  \"tracked\": {},\n", s.tracked);
+        res += pad + "  \"subsystems\": {";
+        for (std::size_t i = 0; i != nSubsystems; i++) {
+            res += format("{}\n{}    \"{}\": {{ \"current\": {}, \"peak\": {} }}",
+                          i == 0 ? "" : ",", pad, subsystemNames[i], s.current[i], s.peak[i]);
+        }
+        res += "\n" + pad + "  },\n";
+        res += pad + format("  \"total\": {{ \"current\": {}, \"peak\": {} }},\n", s.totalCurrent, s.totalPeak);
+        res += pad + format("  \"heapInUse\": {}, \"heapReserved\": {}, \"resident\": {}, \"peakResident\": {}\n",
+                            s.heapInUse, s.heapReserved, s.resident, s.peakResident);
+        res += pad + "}";
+        return res;
+    }
+}
+
+#endif //DAWNSEEKER_MEMORY_H
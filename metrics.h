@@ -0,0 +1,379 @@
+//
+// Created by Onlynagesha on 2022/5/21.
+//
+
+#ifndef DAWNSEEKER_METRICS_H
+#define DAWNSEEKER_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "global.h"
+#include "utils/perthread.h"
+
+/*!
+ * @brief Process-wide performance counters and per-phase timers.
+ *
+ * Counters are collected per thread without contention:
+ * each thread writes only its own cache-line-aligned block (registered on its first use),
+ * and a snapshot sums up all the blocks, including the ones of the threads that have exited.
+ *
+ * Phase timers record the wall-clock time of each scoped phase on the thread running it.
+ * Phases may overlap, e.g. sampling of the next round runs in background while the current one is merged.
+ *
+ * Counters and timers are written to the registry of the calling thread (see ScopedRegistry),
+ * which is the process-wide one by default. A query running concurrently with others has a registry of its own,
+ * which is absorbed into the process-wide one when the query finishes.
+ */
+namespace metrics {
+    enum class Phase : std::size_t {
+        GraphLoad, CenterFiltering, Sampling, Merge, Selection, Simulation
+    };
+    constexpr std::size_t nPhases = 6;
+
+    constexpr const char* phaseNames[nPhases] = {
+        "graphLoad", "centerFiltering", "sampling", "merge", "selection", "simulation"
+    };
+
+    enum class Counter : std::size_t {
+        // Number of sketches sampled, either added to collections or not
+        SketchesSampled,
+        // Number of link states sampled
+        LinksSampled,
+        // Total number of nodes of all the sketches sampled
+        SketchNodes,
+        // Total number of links of all the sketches sampled
+        SketchLinks,
+        // Number of sketches skipped since no boosted node makes positive gain
+        EmptySketches,
+        // Number of sketches dropped after generated, e.g. the ones generated in advance but not required
+        DiscardedSketches,
+        // Number of gain updates of the candidate nodes during selection
+        SelectionUpdates
+    };
+    constexpr std::size_t nCounters = 7;
+
+    constexpr const char* counterNames[nCounters] = {
+        "sketchesSampled", "linksSampled", "sketchNodes", "sketchLinks",
+        "emptySketches", "discardedSketches", "selectionUpdates"
+    };
+
+    enum class Histogram : std::size_t {
+        NodesPerSketch, LinksPerSketch
+    };
+    constexpr std::size_t nHistograms = 2;
+
+    constexpr const char* histogramNames[nHistograms] = {
+        "nodesPerSketch", "linksPerSketch"
+    };
+
+    // Histogram buckets in log2 scale: bucket 0 = {0}, bucket b = [2^(b-1), 2^b) for b >= 1
+    constexpr std::size_t nBuckets = 65;
+
+    /*!
+     * @brief Gets the bucket of a value in the histogram.
+     */
+    constexpr std::size_t bucketOf(std::uint64_t value) {
+        return std::bit_width(value);
+    }
+
+    /*!
+     * @brief Counters of a single thread, written only by its owner thread.
+     *
+     * Values are atomic only to be read by snapshots safely.
+     * Since there's only one writer, a relaxed load and store is enough without any locked instruction.
+     */
+    struct alignas(64) ThreadCounters {
+        std::array<std::atomic<std::uint64_t>, nCounters>                       counters{};
+        std::array<std::array<std::atomic<std::uint64_t>, nBuckets>, nHistograms> histograms{};
+
+        static void increase(std::atomic<std::uint64_t>& c, std::uint64_t n) {
+            c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+    };
+
+    /*!
+     * @brief Sum of all the counters and timers at some time point.
+     */
+    struct Snapshot {
+        std::array<double, nPhases>                                     phaseSeconds{};
+        std::array<std::uint64_t, nPhases>                              phaseCalls{};
+        std::array<std::uint64_t, nCounters>                            counters{};
+        std::array<std::array<std::uint64_t, nBuckets>, nHistograms>    histograms{};
+
+        [[nodiscard]] double seconds(Phase p) const {
+            return phaseSeconds[static_cast<std::size_t>(p)];
+        }
+
+        [[nodiscard]] std::uint64_t operator [] (Counter c) const {
+            return counters[static_cast<std::size_t>(c)];
+        }
+    };
+
+    class Registry {
+    public:
+        Registry() = default;
+        Registry(const Registry&) = delete;
+        Registry& operator = (const Registry&) = delete;
+
+        /*!
+         * @brief Gets the process-wide registry.
+         */
+        static Registry& global() {
+            static auto registry = Registry{};
+            return registry;
+        }
+
+        /*!
+         * @brief Gets the registry set by ScopedRegistry for the calling thread, or nullptr if not set.
+         */
+        static Registry*& threadRegistry() {
+            thread_local constinit Registry* registry = nullptr;
+            return registry;
+        }
+
+        /*!
+         * @brief Gets the registry of the calling thread, or the process-wide one if not set.
+         */
+        static Registry& current() {
+            auto* registry = threadRegistry();
+            return registry != nullptr ? *registry : global();
+        }
+
+        /*!
+         * @brief Gets the counter block of the calling thread, registered on its first call.
+         */
+        ThreadCounters& local() {
+            return blocks.local();
+        }
+
+        /*!
+         * @brief Adds the time of a finished phase.
+         */
+        void addPhase(Phase p, std::chrono::nanoseconds duration) {
+            auto i = static_cast<std::size_t>(p);
+            phaseNanoseconds[i].fetch_add((std::uint64_t)duration.count(), std::memory_order_relaxed);
+            phaseCalls[i].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        /*!
+         * @brief Adds all the counters and timers of a snapshot, e.g. of a finished query.
+         */
+        void absorb(const Snapshot& s) {
+            for (std::size_t i = 0; i != nPhases; i++) {
+                phaseNanoseconds[i].fetch_add((std::uint64_t)std::llround(1e9 * s.phaseSeconds[i]),
+                                              std::memory_order_relaxed);
+                phaseCalls[i].fetch_add(s.phaseCalls[i], std::memory_order_relaxed);
+            }
+            // The absorbed block has multiple writers, serialized by the lock
+            auto lock = std::scoped_lock(absorbMtx);
+            for (std::size_t i = 0; i != nCounters; i++) {
+                ThreadCounters::increase(absorbed.counters[i], s.counters[i]);
+            }
+            for (std::size_t h = 0; h != nHistograms; h++) {
+                for (std::size_t b = 0; b != nBuckets; b++) {
+                    ThreadCounters::increase(absorbed.histograms[h][b], s.histograms[h][b]);
+                }
+            }
+        }
+
+        /*!
+         * @brief Sums up all the counters and timers.
+         */
+        [[nodiscard]] Snapshot snapshot() {
+            auto res = Snapshot{};
+            for (std::size_t i = 0; i != nPhases; i++) {
+                res.phaseSeconds[i] = 1e-9 * (double)phaseNanoseconds[i].load(std::memory_order_relaxed);
+                res.phaseCalls[i] = phaseCalls[i].load(std::memory_order_relaxed);
+            }
+            auto addBlock = [&](const ThreadCounters& block) {
+                for (std::size_t i = 0; i != nCounters; i++) {
+                    res.counters[i] += block.counters[i].load(std::memory_order_relaxed);
+                }
+                for (std::size_t h = 0; h != nHistograms; h++) {
+                    for (std::size_t b = 0; b != nBuckets; b++) {
+                        res.histograms[h][b] += block.histograms[h][b].load(std::memory_order_relaxed);
+                    }
+                }
+            };
+            blocks.forEach(addBlock);
+            addBlock(absorbed);
+            return res;
+        }
+
+    private:
+        utils::PerThreadBlocks<ThreadCounters>              blocks;
+        std::array<std::atomic<std::uint64_t>, nPhases>     phaseNanoseconds{};
+        std::array<std::atomic<std::uint64_t>, nPhases>     phaseCalls{};
+        // Counters of the registries absorbed, guarded by absorbMtx for writing
+        std::mutex                                          absorbMtx;
+        ThreadCounters                                      absorbed;
+    };
+
+    /*!
+     * @brief Writes the counters and timers of the calling thread to a registry during its lifetime.
+     * @param registry The registry, or nullptr for the process-wide one
+     */
+    class ScopedRegistry {
+    public:
+        explicit ScopedRegistry(Registry* registry): old(std::exchange(Registry::threadRegistry(), registry)) {}
+
+        ScopedRegistry(const ScopedRegistry&) = delete;
+
+        ~ScopedRegistry() {
+            Registry::threadRegistry() = old;
+        }
+
+    private:
+        Registry* old;
+    };
+
+    /*!
+     * @brief Increases a counter of the calling thread by n.
+     */
+    inline void add(Counter c, std::uint64_t n = 1) {
+        ThreadCounters::increase(Registry::current().local().counters[static_cast<std::size_t>(c)], n);
+    }
+
+    /*!
+     * @brief Records a sampled sketch with its size and the number of link states sampled for it.
+     */
+    inline void recordSketch(std::uint64_t nNodes, std::uint64_t nLinks, std::uint64_t nLinksSampled) {
+        auto& block = Registry::current().local();
+        auto& c = block.counters;
+        ThreadCounters::increase(c[static_cast<std::size_t>(Counter::SketchesSampled)], 1);
+        ThreadCounters::increase(c[static_cast<std::size_t>(Counter::LinksSampled)], nLinksSampled);
+        ThreadCounters::increase(c[static_cast<std::size_t>(Counter::SketchNodes)], nNodes);
+        ThreadCounters::increase(c[static_cast<std::size_t>(Counter::SketchLinks)], nLinks);
+        auto& h = block.histograms;
+        ThreadCounters::increase(h[static_cast<std::size_t>(Histogram::NodesPerSketch)][bucketOf(nNodes)], 1);
+        ThreadCounters::increase(h[static_cast<std::size_t>(Histogram::LinksPerSketch)][bucketOf(nLinks)], 1);
+    }
+
+    /*!
+     * @brief Measures the wall-clock time of a phase during its lifetime,
+     *        added to the registry of the calling thread when constructed.
+     */
+    class ScopedPhase {
+    public:
+        explicit ScopedPhase(Phase p):
+        registry(Registry::current()), phase(p), start(std::chrono::steady_clock::now()) {}
+
+        ScopedPhase(const ScopedPhase&) = delete;
+
+        ~ScopedPhase() {
+            registry.addPhase(phase, std::chrono::steady_clock::now() - start);
+        }
+
+    private:
+        Registry&                               registry;
+        Phase                                   phase;
+        std::chrono::steady_clock::time_point   start;
+    };
+
+    /*!
+     * @brief Gets the snapshot of all the counters and timers of the registry of the calling thread.
+     */
+    inline Snapshot snapshot() {
+        return Registry::current().snapshot();
+    }
+
+    /*!
+     * @brief Quotes and escapes a string as a JSON string literal.
+     */
+    inline std::string jsonString(std::string_view str) {
+        auto res = std::string{"\""};
+        for (char c: str) {
+            switch (c) {
+            case '"':   res += "\\\"";  break;
+            case '\\':  res += "\\\\";  break;
+            case '\n':  res += "\\n";   break;
+            case '\t':  res += "\\t";   break;
+            default:
+                if ((unsigned char)c < 0x20) {
+                    res += format("\\u{:04x}", (unsigned)c);
+                } else {
+                    res += c;
+                }
+            }
+        }
+        return res + '"';
+    }
+
+    /*!
+     * @brief Formats a floating point value as a JSON number. Infinity and NaN are written as null.
+     */
+    inline std::string jsonNumber(double value) {
+        return std::isfinite(value) ? format("{}", value) : "null";
+    }
+
+    /*!
+     * @brief Dumps the snapshot as a JSON object.
+     *
+     * Format (with non-empty histogram buckets only, where [lo, hi] is the value range of the bucket):
+     *
+     *      {
+     *        "phases": { "graphLoad": { "seconds": 0.1, "calls": 1 }, ... },
+     *        "counters": { "sketchesSampled": 100, ... },
+     *        "histograms": { "nodesPerSketch": [ { "lo": 1, "hi": 1, "count": 10 }, ... ], ... },
+     *        "throughput": { "sketchesPerSecond": 1000.0, "linksSampledPerSecond": 100000.0 }
+     *      }
+     *
+     * @param s The snapshot
+     * @param indent Indentation of the lines except the first one
+     * @return A multi-line string, without trailing new-line character.
+     */
+    inline std::string toJson(const Snapshot& s, int indent = 0) {
+        auto pad = std::string(std::max(0, indent), ' ');
+        auto res = std::string{"{\n"};
+
+        res += pad + "  \"phases\": {";
+        for (std::size_t i = 0; i != nPhases; i++) {
+            res += format("{}\n{}    \"{}\": {{ \"seconds\": {}, \"calls\": {} }}",
+                          i == 0 ? "" : ",", pad, phaseNames[i], jsonNumber(s.phaseSeconds[i]), s.phaseCalls[i]);
+        }
+        res += "\n" + pad + "  },\n";
+
+        res += pad + "  \"counters\": {";
+        for (std::size_t i = 0; i != nCounters; i++) {
+            res += format("{}\n{}    \"{}\": {}", i == 0 ? "" : ",", pad, counterNames[i], s.counters[i]);
+        }
+        res += "\n" + pad + "  },\n";
+
+        res += pad + "  \"histograms\": {";
+        for (std::size_t h = 0; h != nHistograms; h++) {
+            res += format("{}\n{}    \"{}\": [", h == 0 ? "" : ",", pad, histogramNames[h]);
+            auto first = true;
+            for (std::size_t b = 0; b != nBuckets; b++) {
+                if (s.histograms[h][b] == 0) {
+                    continue;
+                }
+                auto lo = b == 0 ? std::uint64_t{0} : std::uint64_t{1} << (b - 1);
+                auto hi = b == 0 ? std::uint64_t{0} : lo + (lo - 1);
+                res += format("{} {{ \"lo\": {}, \"hi\": {}, \"count\": {} }}",
+                              first ? "" : ",", lo, hi, s.histograms[h][b]);
+                first = false;
+            }
+            res += " ]";
+        }
+        res += "\n" + pad + "  },\n";
+
+        auto perSecond = [&](Counter c) {
+            auto t = s.seconds(Phase::Sampling);
+            return t > 0.0 ? (double)s[c] / t : 0.0;
+        };
+        res += pad + format("  \"throughput\": {{ \"sketchesPerSecond\": {}, \"linksSampledPerSecond\": {} }}\n",
+                            jsonNumber(perSecond(Counter::SketchesSampled)),
+                            jsonNumber(perSecond(Counter::LinksSampled)));
+        res += pad + "}";
+        return res;
+    }
+}
+
+#endif //DAWNSEEKER_METRICS_H
@@ -0,0 +1,454 @@
+//
+// Created by Onlynagesha on 2022/5/27.
+//
+
+#ifndef DAWNSEEKER_PERF_H
+#define DAWNSEEKER_PERF_H
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "global.h"
+#include "Logger.h"
+#include "utils/perthread.h"
+
+#if __has_include(<linux/perf_event.h>)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define PERF_EVENTS_SUPPORTED 1
+#else
+#define PERF_EVENTS_SUPPORTED 0
+#endif
+
+/*!
+ * @brief Optional hardware performance counters around the major kernels, via Linux perf_event_open.
+ *
+ * Each thread opens its own group of counters (user space only) on its first measured kernel,
+ * and the counts of each kernel are accumulated to the block of the thread,
+ * written only by its owner thread as metrics::ThreadCounters.
+ * Reading the group takes a system call at both ends of each kernel call,
+ * thus the counters are disabled by default.
+ *
+ * If perf_event_open is forbidden (e.g. by /proc/sys/kernel/perf_event_paranoid or seccomp),
+ * a warning is logged and the counters stay disabled. Events not supported by the hardware are skipped.
+ * Nested kernels are counted inclusively by each of them.
+ */
+namespace perf {
+    enum class Kernel : std::size_t {
+        // samplePRRSketch
+        SketchBuild,
+        // calculateCenterStateToFast and calculateCenterStateToSlow
+        GainComputation,
+        // PRRGraphCollection::merge
+        Merge,
+        // Greedy selection on PRR-sketch collections
+        Select,
+        // Single forward simulation, or evaluation of a sketch in sketch-based simulation
+        Simulation
+    };
+    constexpr std::size_t nKernels = 5;
+
+    constexpr const char* kernelNames[nKernels] = {
+        "sketchBuild", "gainComputation", "merge", "select", "simulation"
+    };
+
+    enum class Event : std::size_t {
+        Cycles, Instructions, LLCMisses, BranchMisses, DTLBMisses
+    };
+    constexpr std::size_t nEvents = 5;
+
+    constexpr const char* eventNames[nEvents] = {
+        "cycles", "instructions", "llcMisses", "branchMisses", "dtlbMisses"
+    };
+
+    using EventCounts = std::array<std::uint64_t, nEvents>;
+
+    /*!
+     * @brief Counts read from a group, with the time (in nanoseconds) it has been enabled and actually counting.
+     *
+     * If there are more events than hardware counters (e.g. with other groups or the NMI watchdog),
+     * the groups are multiplexed by the kernel, and running < enabled.
+     */
+    struct GroupReading {
+        EventCounts     counts{};
+        std::uint64_t   timeEnabled = 0;
+        std::uint64_t   timeRunning = 0;
+    };
+
+    /*!
+     * @brief Counter group of a thread, closed when the thread exits.
+     */
+    class ThreadGroup {
+    public:
+        ThreadGroup() {
+            slots.fill(-1);
+        }
+
+        ThreadGroup(const ThreadGroup&) = delete;
+
+        ~ThreadGroup() {
+            close();
+        }
+
+        /*!
+         * @brief Opens all the events as a group on the calling thread.
+         * @return errno of the leader if no event is available, 0 otherwise.
+         */
+        int open() {
+#if PERF_EVENTS_SUPPORTED
+            auto error = 0;
+            for (std::size_t e = 0; e != nEvents; e++) {
+                auto attr = perf_event_attr{};
+                attr.size = sizeof(attr);
+                std::tie(attr.type, attr.config) = eventConfig(static_cast<Event>(e));
+                attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                // User space only, which is allowed with perf_event_paranoid <= 2
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                auto fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC);
+                if (fd < 0) {
+                    error = error == 0 ? errno : error;
+                    continue;
+                }
+                fds.push_back(fd);
+                slots[e] = (int)fds.size() - 1;
+                leader = leader < 0 ? fd : leader;
+            }
+            return fds.empty() ? error : 0;
+#else
+            return ENOSYS;
+#endif
+        }
+
+        void close() {
+#if PERF_EVENTS_SUPPORTED
+            for (auto fd: fds) {
+                ::close(fd);
+            }
+#endif
+            fds.clear();
+            leader = -1;
+        }
+
+        /*!
+         * @brief Reads the current counts and times. Unavailable events are 0.
+         */
+        GroupReading read() const {
+            auto res = GroupReading{};
+#if PERF_EVENTS_SUPPORTED
+            // Format of PERF_FORMAT_GROUP with both times: { nr, time_enabled, time_running, values[nr] }
+            auto buffer = std::array<std::uint64_t, nEvents + 3>{};
+            if (leader < 0 || ::read(leader, buffer.data(), sizeof(buffer)) <= 0) {
+                return res;
+            }
+            res.timeEnabled = buffer[1];
+            res.timeRunning = buffer[2];
+            for (std::size_t e = 0; e != nEvents; e++) {
+                if (slots[e] >= 0 && (std::uint64_t)slots[e] < buffer[0]) {
+                    res.counts[e] = buffer[slots[e] + 3];
+                }
+            }
+#endif
+            return res;
+        }
+
+        /*!
+         * @brief Whether each event is available.
+         */
+        [[nodiscard]] bool available(Event e) const {
+            return slots[static_cast<std::size_t>(e)] >= 0;
+        }
+
+    private:
+#if PERF_EVENTS_SUPPORTED
+        static std::pair<std::uint32_t, std::uint64_t> eventConfig(Event e) {
+            switch (e) {
+            case Event::Cycles:         return {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES};
+            case Event::Instructions:   return {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS};
+            case Event::LLCMisses:      return {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES};
+            case Event::BranchMisses:   return {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES};
+            default:
+                return {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB
+                                            | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+            }
+        }
+#endif
+
+        int                             leader = -1;
+        std::vector<int>                fds;
+        // slots[e] = position of event e in the group, -1 if unavailable
+        std::array<int, nEvents>        slots{};
+    };
+
+    /*!
+     * @brief Counts of a single thread, written only by its owner thread.
+     */
+    struct alignas(64) ThreadCounts {
+        std::array<std::atomic<std::uint64_t>, nKernels>                            calls{};
+        // Calls during which the group is never scheduled on the hardware counters, thus nothing is counted
+        std::array<std::atomic<std::uint64_t>, nKernels>                            unscheduledCalls{};
+        std::array<std::array<std::atomic<std::uint64_t>, nEvents>, nKernels>       events{};
+
+        static void increase(std::atomic<std::uint64_t>& c, std::uint64_t n) {
+            c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+    };
+
+    /*!
+     * @brief Sum of counts of each kernel at some time point, in total and per thread.
+     */
+    struct Snapshot {
+        struct Counts {
+            std::array<std::uint64_t, nKernels>     calls{};
+            std::array<std::uint64_t, nKernels>     unscheduledCalls{};
+            std::array<EventCounts, nKernels>       events{};
+        };
+        // Whether the counters are enabled
+        bool                            enabled = false;
+        // Whether each event is available
+        std::array<bool, nEvents>       available{};
+        Counts                          total{};
+        // perThread[i] = Counts of the i-th thread in order of their first measured kernel
+        std::vector<Counts>             perThread{};
+    };
+
+    class Registry {
+    public:
+        /*!
+         * @brief Gets the process-wide registry.
+         */
+        static Registry& global() {
+            static auto registry = Registry{};
+            return registry;
+        }
+
+        /*!
+         * @brief Enables the counters if perf_event_open is permitted. Otherwise, logs a warning.
+         * @return Whether the counters are enabled.
+         */
+        bool enable() {
+            auto probe = ThreadGroup{};
+            if (auto error = probe.open(); error != 0) {
+                LOG_WARNING(format("Hardware performance counters are disabled since perf_event_open fails: {}. "
+                                   "Check /proc/sys/kernel/perf_event_paranoid.", std::strerror(error)));
+                return false;
+            }
+            for (std::size_t e = 0; e != nEvents; e++) {
+                available[e] = probe.available(static_cast<Event>(e));
+                if (!available[e]) {
+                    LOG_WARNING(format("Hardware performance counter '{}' is not supported, skipped.", eventNames[e]));
+                }
+            }
+            enabled_.store(true, std::memory_order_relaxed);
+            return true;
+        }
+
+        [[nodiscard]] bool enabled() const {
+            return enabled_.load(std::memory_order_relaxed);
+        }
+
+        /*!
+         * @brief Gets the counter group of the calling thread, opened on its first call.
+         */
+        static const ThreadGroup& localGroup() {
+            thread_local auto group = []() {
+                auto res = std::make_unique<ThreadGroup>();
+                res->open();
+                return res;
+            }();
+            return *group;
+        }
+
+        /*!
+         * @brief Gets the count block of the calling thread, registered on its first call.
+         */
+        ThreadCounts& localCounts() {
+            return blocks.local();
+        }
+
+        [[nodiscard]] Snapshot snapshot() {
+            auto res = Snapshot{.enabled = enabled(), .available = available};
+            blocks.forEach([&](const ThreadCounts& block) {
+                auto& cur = res.perThread.emplace_back();
+                for (std::size_t k = 0; k != nKernels; k++) {
+                    cur.calls[k] = block.calls[k].load(std::memory_order_relaxed);
+                    res.total.calls[k] += cur.calls[k];
+                    cur.unscheduledCalls[k] = block.unscheduledCalls[k].load(std::memory_order_relaxed);
+                    res.total.unscheduledCalls[k] += cur.unscheduledCalls[k];
+                    for (std::size_t e = 0; e != nEvents; e++) {
+                        cur.events[k][e] = block.events[k][e].load(std::memory_order_relaxed);
+                        res.total.events[k][e] += cur.events[k][e];
+                    }
+                }
+            });
+            return res;
+        }
+
+    private:
+        std::atomic<bool>           enabled_ = false;
+        std::array<bool, nEvents>   available{};
+        utils::PerThreadBlocks<ThreadCounts>    blocks;
+    };
+
+    /*!
+     * @brief Enables the counters. See Registry::enable for details.
+     */
+    inline bool enable() {
+        return Registry::global().enable();
+    }
+
+    inline Snapshot snapshot() {
+        return Registry::global().snapshot();
+    }
+
+    /*!
+     * @brief Counts the events of a kernel call on the calling thread during its lifetime.
+     *
+     * If the group is multiplexed, the counts are scaled by the ratio of time enabled to time running,
+     * as perf stat does. Calls during which the group never runs are recorded as unscheduled.
+     *
+     * Costs only a relaxed load if the counters are disabled.
+     */
+    class ScopedKernel {
+    public:
+        explicit ScopedKernel(Kernel k): kernel(k), active(Registry::global().enabled()) {
+            if (active) {
+                start = Registry::localGroup().read();
+            }
+        }
+
+        ScopedKernel(const ScopedKernel&) = delete;
+
+        ~ScopedKernel() {
+            if (!active) {
+                return;
+            }
+            auto end = Registry::localGroup().read();
+            auto& block = Registry::global().localCounts();
+            auto k = static_cast<std::size_t>(kernel);
+            ThreadCounts::increase(block.calls[k], 1);
+            auto enabled = end.timeEnabled - start.timeEnabled;
+            auto running = end.timeRunning - start.timeRunning;
+            if (running == 0) {
+                if (enabled != 0) {
+                    ThreadCounts::increase(block.unscheduledCalls[k], 1);
+                }
+                return;
+            }
+            auto scale = running >= enabled ? 1.0 : (double)enabled / (double)running;
+            for (std::size_t e = 0; e != nEvents; e++) {
+                auto delta = end.counts[e] - start.counts[e];
+                ThreadCounts::increase(block.events[k][e],
+                                       scale == 1.0 ? delta : (std::uint64_t)std::llround(scale * (double)delta));
+            }
+        }
+
+    private:
+        Kernel          kernel;
+        bool            active;
+        GroupReading    start{};
+    };
+
+    /*!
+     * @brief Dumps the counts as a table of each kernel, with IPC, misses per thousand instructions
+     *        and calls during which the counters are never scheduled, followed by the cycles of each kernel per thread.
+     * @return A multi-line string, without trailing new-line character.
+     */
+    inline std::string toString(const Snapshot& s) {
+        if (!s.enabled) {
+            return "    (hardware performance counters disabled)";
+        }
+        auto perKilo = [](std::uint64_t n, std::uint64_t instructions) {
+            return instructions == 0 ? 0.0 : 1000.0 * (double)n / (double)instructions;
+        };
+        auto res = format("    {:<16} {:>10} {:>16} {:>16} {:>6} {:>10} {:>10} {:>10} {:>10}\n",
+                          "kernel", "calls", "cycles", "instructions", "IPC", "LLC/kI", "branch/kI", "dTLB/kI",
+                          "unsched.");
+        for (std::size_t k = 0; k != nKernels; k++) {
+            const auto& ev = s.total.events[k];
+            auto instr = ev[static_cast<std::size_t>(Event::Instructions)];
+            auto cycles = ev[static_cast<std::size_t>(Event::Cycles)];
+            res += format("    {:<16} {:>10} {:>16} {:>16} {:>6.2f} {:>10.3f} {:>10.3f} {:>10.3f} {:>10}\n",
+                          kernelNames[k], s.total.calls[k], cycles, instr,
+                          cycles == 0 ? 0.0 : (double)instr / (double)cycles,
+                          perKilo(ev[static_cast<std::size_t>(Event::LLCMisses)], instr),
+                          perKilo(ev[static_cast<std::size_t>(Event::BranchMisses)], instr),
+                          perKilo(ev[static_cast<std::size_t>(Event::DTLBMisses)], instr),
+                          s.total.unscheduledCalls[k]);
+        }
+        res += "    Cycles per thread:";
+        for (std::size_t t = 0; t != s.perThread.size(); t++) {
+            res += format("\n    #{:<3}", t);
+            for (std::size_t k = 0; k != nKernels; k++) {
+                res += format(" {}={}", kernelNames[k],
+                              s.perThread[t].events[k][static_cast<std::size_t>(Event::Cycles)]);
+            }
+        }
+        return res;
+    }
+
+    /*!
+     * @brief Dumps the counts as a JSON object.
+     *
+     * Format (kernels without any call are omitted in "perThread"):
+     *
+     *      {
+     *        "enabled": true,
+     *        "available": { "cycles": true, ... },
+     *        "kernels": { "sketchBuild": { "calls": 100, "unscheduledCalls": 0, "cycles": 1000, ... }, ... },
+     *        "perThread": [ { "sketchBuild": { "calls": 50, "cycles": 500, ... }, ... }, ... ]
+     *      }
+     *
+     * @param s The snapshot
+     * @param indent Indentation of the lines except the first one
+     * @return A multi-line string, without trailing new-line character.
+     */
+    inline std::string toJson(const Snapshot& s, int indent = 0) {
+        auto pad = std::string(std::max(0, indent), ' ');
+        auto kernelJson = [&](const Snapshot::Counts& c, std::size_t k) {
+            auto res = format("{{ \"calls\": {}, \"unscheduledCalls\": {}", c.calls[k], c.unscheduledCalls[k]);
+            for (std::size_t e = 0; e != nEvents; e++) {
+                res += format(", \"{}\": {}", eventNames[e], c.events[k][e]);
+            }
+            return res + " }";
+        };
+
+        auto res = std::string{"{\n"};
+        res += pad + format("  \"enabled\": {},\n", s.enabled);
+        res += pad + "  \"available\": {";
+        for (std::size_t e = 0; e != nEvents; e++) {
+            res += format("{} \"{}\": {}", e == 0 ? "" : ",", eventNames[e], s.available[e]);
+        }
+        res += " },\n";
+        res += pad + "  \"kernels\": {";
+        for (std::size_t k = 0; k != nKernels; k++) {
+            res += format("{}\n{}    \"{}\": {}", k == 0 ? "" : ",", pad, kernelNames[k], kernelJson(s.total, k));
+        }
+        res += "\n" + pad + "  },\n";
+        res += pad + "  \"perThread\": [";
+        for (std::size_t t = 0; t != s.perThread.size(); t++) {
+            res += format("{}\n{}    {{", t == 0 ? "" : ",", pad);
+            auto first = true;
+            for (std::size_t k = 0; k != nKernels; k++) {
+                if (s.perThread[t].calls[k] == 0) {
+                    continue;
+                }
+                res += format("{} \"{}\": {}", first ? "" : ",", kernelNames[k], kernelJson(s.perThread[t], k));
+                first = false;
+            }
+            res += " }";
+        }
+        res += "\n" + pad + "  ]\n";
+        res += pad + "}";
+        return res;
+    }
+}
+
+#endif //DAWNSEEKER_PERF_H
@@ -0,0 +1,210 @@
+//
+// Created by Onlynagesha on 2022/5/30.
+//
+
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "Logger.h"
+#include "memory.h"
+#include "service.h"
+#include "sketchcache.h"
+
+namespace {
+    /*!
+     * @brief Line-based channel over a pair of file descriptors, which are not owned.
+     */
+    class LineChannel {
+    public:
+        LineChannel(int inFd, int outFd, bool isSocket): inFd(inFd), outFd(outFd), isSocket(isSocket) {}
+
+        /*!
+         * @brief Reads a line without the trailing "\n" or "\r\n".
+         * @return false on end of input or error.
+         */
+        bool readLine(std::string& line) {
+            for (;;) {
+                if (auto pos = buffer.find('\n'); pos != std::string::npos) {
+                    line.assign(buffer, 0, pos);
+                    buffer.erase(0, pos + 1);
+                    if (line.ends_with('\r')) {
+                        line.pop_back();
+                    }
+                    return true;
+                }
+                char chunk[4096];
+                auto n = ::read(inFd, chunk, sizeof(chunk));
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    // The last line without trailing new-line character
+                    if (!buffer.empty()) {
+                        line = std::move(buffer);
+                        buffer.clear();
+                        return true;
+                    }
+                    return false;
+                }
+                buffer.append(chunk, (std::size_t)n);
+            }
+        }
+
+        /*!
+         * @brief Writes a line with trailing "\n" appended.
+         * @return false on error, e.g. the client is disconnected.
+         */
+        bool writeLine(std::string line) {
+            line += '\n';
+            for (auto p = line.data(), end = p + line.length(); p != end; ) {
+                // The program shall not be killed by SIGPIPE when the client is disconnected
+                auto n = isSocket ? ::send(outFd, p, end - p, MSG_NOSIGNAL) : ::write(outFd, p, end - p);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    return false;
+                }
+                p += n;
+            }
+            return true;
+        }
+
+    private:
+        int         inFd;
+        int         outFd;
+        bool        isSocket;
+        std::string buffer;
+    };
+
+    enum class SessionEnd {
+        Closed, Shutdown
+    };
+
+    class Service {
+    public:
+        Service(IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args, int argc, char** argv):
+        graph(graph), cache(args.cacheMemory),
+        runner(graph, seeds, args, argc, argv, args.cacheMemory != 0 ? &cache : nullptr) {}
+
+        SessionEnd serve(LineChannel& channel) {
+            for (auto line = std::string{}; channel.readLine(line); ) {
+                auto pos = line.find_first_not_of(" \t");
+                if (pos == std::string::npos || line[pos] == '#') {
+                    continue;
+                }
+                auto command = line.substr(pos, line.find_last_not_of(" \t") + 1 - pos);
+                if (command == "quit") {
+                    return SessionEnd::Closed;
+                }
+                if (command == "shutdown") {
+                    return SessionEnd::Shutdown;
+                }
+                auto response = command == "stats" ? stats() : runner.run(line).json;
+                if (!channel.writeLine(std::move(response))) {
+                    LOG_WARNING("Failed to write the response. The client may be disconnected.");
+                    return SessionEnd::Closed;
+                }
+            }
+            return SessionEnd::Closed;
+        }
+
+    private:
+        std::string stats() {
+            auto memoryJson = memory::toJson(memory::snapshot());
+            // Flattens to a single line
+            std::erase(memoryJson, '\n');
+            return format("{{ \"queries\": {}, \"graph\": {{ \"nNodes\": {}, \"nLinks\": {} }}, "
+                          "\"cache\": {}, \"memory\": {} }}",
+                          runner.queryCount(), graph.nNodes(), graph.nLinks(), cache.statsToJson(), memoryJson);
+        }
+
+        IMMGraph&   graph;
+        SketchCache cache;
+        QueryRunner runner;
+    };
+
+    int serveSocket(Service& service, const std::string& path) {
+        auto addr = sockaddr_un{};
+        if (path.length() >= sizeof(addr.sun_path)) {
+            throw std::invalid_argument(format("Socket path '{}' is too long", path));
+        }
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+        // A stale socket file left by a killed service is removed, i.e. if nobody is listening on it.
+        //  Sockets of running services and other kinds of files are kept.
+        if (struct stat st{}; ::lstat(path.c_str(), &st) == 0) {
+            if (!S_ISSOCK(st.st_mode)) {
+                throw std::invalid_argument(format("'{}' exists and is not a socket", path));
+            }
+            auto probeFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (probeFd < 0) {
+                throw std::runtime_error(format("socket(): {}", std::strerror(errno)));
+            }
+            auto connected = ::connect(probeFd, (const sockaddr*)&addr, sizeof(addr)) == 0;
+            auto probeErrno = errno;
+            ::close(probeFd);
+            if (connected) {
+                throw std::runtime_error(format("Socket '{}' is already in use by another service", path));
+            }
+            if (probeErrno != ECONNREFUSED) {
+                throw std::runtime_error(format("Socket '{}' is already in use: {}", path, std::strerror(probeErrno)));
+            }
+            ::unlink(path.c_str());
+        }
+        auto listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0) {
+            throw std::runtime_error(format("socket(): {}", std::strerror(errno)));
+        }
+        if (::bind(listenFd, (const sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(listenFd, 8) != 0) {
+            auto reason = std::string{std::strerror(errno)};
+            ::close(listenFd);
+            throw std::runtime_error(format("Failed to listen on '{}': {}", path, reason));
+        }
+        LOG_INFO(format("Service: listening on '{}'", path));
+
+        for (auto end = SessionEnd::Closed; end != SessionEnd::Shutdown; ) {
+            auto fd = ::accept(listenFd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                LOG_ERROR(format("accept(): {}", std::strerror(errno)));
+                break;
+            }
+            LOG_INFO("Service: client connected");
+            auto channel = LineChannel(fd, fd, true);
+            end = service.serve(channel);
+            ::close(fd);
+            LOG_INFO("Service: client disconnected");
+        }
+        ::close(listenFd);
+        ::unlink(path.c_str());
+        return 0;
+    }
+}
+
+bool servesStdin(int argc, char** argv) {
+    for (int i = 1; i + 1 < argc; i++) {
+        auto token = std::string_view{argv[i]};
+        if ((token == "-serve" || token == "--serve") && std::string_view{argv[i + 1]} == "stdin") {
+            return true;
+        }
+    }
+    return false;
+}
+
+int runService(IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args, int argc, char** argv) {
+    auto service = Service(graph, seeds, args, argc, argv);
+    if (args.serve == "stdin") {
+        LOG_INFO("Service: reading queries from stdin");
+        auto channel = LineChannel(STDIN_FILENO, STDOUT_FILENO, false);
+        service.serve(channel);
+        return 0;
+    }
+    return serveSocket(service, args.serve);
+}
@@ -0,0 +1,44 @@
+//
+// Created by Onlynagesha on 2022/5/30.
+//
+
+#ifndef DAWNSEEKER_SERVICE_H
+#define DAWNSEEKER_SERVICE_H
+
+#include "dispatch.h"
+
+/*!
+ * @brief Checks whether the program arguments enable service mode over stdin (i.e. <code>-serve stdin</code>),
+ *        in which case the standard output is reserved for the responses and logs should go elsewhere.
+ * @param argc
+ * @param argv
+ */
+bool servesStdin(int argc, char** argv);
+
+/*!
+ * @brief Runs as a long-running service answering the queries on the graph loaded once (service mode).
+ *
+ * Queries are read from stdin if args.serve is "stdin", or from the clients of the Unix domain socket
+ * at path args.serve otherwise (one client at a time, in the order of connection).
+ * An existing socket file at the path is replaced only if no service is listening on it,
+ * otherwise the service fails to start.
+ * The protocol is line-based, with a response line to each request line:
+ *   - a query in the same format as batch mode (see QueryRunner), answered with its result record;
+ *   - <code>stats</code>: answered with the statistics of the service, the sketch cache and memory usage;
+ *   - <code>quit</code>: closes the connection (or ends the service over stdin) without response;
+ *   - <code>shutdown</code>: stops the service without response.
+ * Empty lines and the ones starting with '#' are ignored without response.
+ *
+ * PRR-sketch collections of PR-IMM are kept warm in a sketch cache of args.cacheMemory bytes (see SketchCache),
+ * so that a follow-up query with another k or lambda and fixed sample sizes is answered without sampling again.
+ *
+ * @param graph The whole graph
+ * @param seeds The seed set of the command line
+ * @param args Arguments of the command line
+ * @param argc
+ * @param argv
+ * @return Exit code of the program
+ */
+int runService(IMMGraph& graph, const SeedSet& seeds, const BasicArgs& args, int argc, char** argv);
+
+#endif //DAWNSEEKER_SERVICE_H
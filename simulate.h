@@ -8,7 +8,11 @@
 #include <queue>
 #include "graphbasic.h"
 #include "immbasic.h"
+#include "perf.h"
+#include "PRRGraph.h"
+#include "ProgressCounter.h"
 #include "thread.h"
+#include "trace.h"
 
 struct SimResultItem {
     double positiveGain;    // positive = sum of all the gain(v) > 0
@@ -23,6 +27,8 @@ struct SimResultItem {
     double crMinusCount;
 
 private:
+    friend struct SimResultStats;
+
     static const auto& members() {
         static auto mps = std::initializer_list<std::tuple<double SimResultItem::*, const char*>>{
                 {&SimResultItem::positiveGain, "positiveGain"},
@@ -66,8 +72,8 @@ public:
         }
     }
 
-    void add(NodeState state) {
-        add(gain(state), state);
+    void add(NodeState state, const NodeStateContext& stateCtx) {
+        add(stateCtx.gain(state), state);
     }
 
     SimResultItem& operator += (const SimResultItem& rhs) {
@@ -109,6 +115,19 @@ public:
         return res;
     }
 
+    SimResultItem& operator *= (double ratio) {
+        for (auto mp: members() | vs::keys) {
+            this->*mp *= ratio;
+        }
+        return *this;
+    }
+
+    SimResultItem operator * (double ratio) const {
+        auto res = *this;
+        res *= ratio;
+        return res;
+    }
+
     friend std::string toString(const SimResultItem& item, int indent = 4) {
         indent = std::max(indent, 0);
         auto indentStr = std::string(indent, ' ');
@@ -130,11 +149,124 @@ public:
     }
 };
 
+/*!
+ * @brief Running statistics of SimResultItem samples: count, mean and variance of each field.
+ *
+ * Samples are added one by one with Welford's algorithm,
+ * and statistics of disjoint sample sets (e.g. from different threads) are merged with Chan's formula.
+ */
+struct SimResultStats {
+    std::size_t     count = 0;
+    SimResultItem   mean{};
+    // Sum of squared deviations from the mean
+    SimResultItem   m2{};
+
+    void add(const SimResultItem& x) {
+        count += 1;
+        for (auto mp: SimResultItem::members() | vs::keys) {
+            double delta = x.*mp - mean.*mp;
+            mean.*mp += delta / (double)count;
+            m2.*mp += delta * (x.*mp - mean.*mp);
+        }
+    }
+
+    SimResultStats& operator += (const SimResultStats& rhs) {
+        if (rhs.count == 0) {
+            return *this;
+        }
+        auto n = count + rhs.count;
+        for (auto mp: SimResultItem::members() | vs::keys) {
+            double delta = rhs.mean.*mp - mean.*mp;
+            mean.*mp += delta * (double)rhs.count / (double)n;
+            m2.*mp += rhs.m2.*mp + delta * delta * (double)count * (double)rhs.count / (double)n;
+        }
+        count = n;
+        return *this;
+    }
+
+    /*!
+     * @brief Squared standard error of the mean of each field, i.e. Var / n with the unbiased sample variance.
+     */
+    [[nodiscard]] SimResultItem squaredStdError() const {
+        auto res = SimResultItem{};
+        if (count >= 2) {
+            for (auto mp: SimResultItem::members() | vs::keys) {
+                res.*mp = m2.*mp / (double)(count - 1) / (double)count;
+            }
+        }
+        return res;
+    }
+
+    /*!
+     * @brief Half-width of the confidence interval of the mean of each field, by normal approximation.
+     * @param z The two-sided normal quantile of the confidence level, e.g. 2.576 for 99%
+     */
+    [[nodiscard]] SimResultItem halfWidth(double z) const {
+        return halfWidth(z, squaredStdError());
+    }
+
+    /*!
+     * @brief Half-width of confidence interval z * sqrt(se2) of each field
+     *  with given squared standard errors.
+     */
+    static SimResultItem halfWidth(double z, SimResultItem se2) {
+        for (auto mp: SimResultItem::members() | vs::keys) {
+            se2.*mp = z * std::sqrt(se2.*mp);
+        }
+        return se2;
+    }
+};
+
+/*!
+ * @brief Precision target of simulation.
+ *
+ * If relError > 0, simulations are performed in batches, and stop once the confidence interval of
+ * total gain (or its difference between with and without boosted nodes) with given confidence level
+ * has half-width no more than relError * |mean|.
+ * The simulation count T given is then the upper limit.
+ * Otherwise, simulation always repeats T times.
+ */
+struct SimPrecision {
+    // Target relative error. 0 if disabled
+    double  relError    = 0.0;
+    // Confidence level of the confidence interval
+    double  confidence  = 0.99;
+
+    // How many simulations to perform between two checks
+    static constexpr std::size_t batchSize = 1000;
+
+    [[nodiscard]] bool enabled() const {
+        return relError > 0.0;
+    }
+
+    /*!
+     * @brief Two-sided normal quantile of the confidence level
+     */
+    [[nodiscard]] double z() const {
+        return utils::normalQuantile(0.5 + confidence / 2.0);
+    }
+
+    /*!
+     * @brief Checks whether the confidence interval of total gain is narrow enough.
+     * @param mean The estimated mean
+     * @param halfWidth The half-width of confidence interval
+     */
+    [[nodiscard]] bool satisfiedBy(const SimResultItem& mean, const SimResultItem& halfWidth) const {
+        return halfWidth.totalGain <= relError * std::fabs(mean.totalGain);
+    }
+};
+
 struct SimResult {
     SimResultItem withBoosted;
     SimResultItem withoutBoosted;
     SimResultItem diff;     // diff = without boosted - without boosted
 
+    // How many simulations are performed (with boosted nodes). 0 if unknown
+    std::size_t   sampleCount = 0;
+    // Confidence level and half-width of the confidence interval of diff
+    double        confidence = 0.0;
+    SimResultItem diffHalfWidth{};
+
     SimResult() = default;
 
     SimResult(SimResultItem with, SimResultItem without):
@@ -142,12 +274,15 @@ struct SimResult {
 };
 
 inline std::string toString(const SimResult& res, bool showDiffOnly = false) {
-    if (showDiffOnly) {
-        return toString(res.diff);
-    } else {
-        return format("with boosted: {},\nwithout boosted: {},\ndiff: {}",
-                      res.withBoosted, res.withoutBoosted, res.diff);
+    auto str = showDiffOnly
+            ? toString(res.diff)
+            : format("with boosted: {},\nwithout boosted: {},\ndiff: {}",
+                     res.withBoosted, res.withoutBoosted, res.diff);
+    if (res.sampleCount != 0) {
+        str += format("\n({} simulations, {:.3g}% confidence interval of total gain diff: {:.3f} +- {:.3f})",
+                      res.sampleCount, res.confidence * 100.0, res.diff.totalGain, res.diffHalfWidth.totalGain);
     }
+    return str;
 }
 
 namespace {
@@ -166,99 +301,594 @@ namespace {
     };
 
     /*!
-     * Simulates message propagation with given boosted nodes.
-     *
-     * Each simulation sums up the gain of all the nodes,
-     * Ca and Ca+ counted as lambda, Cr as lambda - 1, Cr- and None as 0.
-     *
-     * The link states object (which must be initialized with graph size |E|) is provided for reusing.
-     * Refreshing is done once during this procedure.
+     * @brief Node properties of all the nodes during simulation, reused among multiple propagations.
      *
-     * The node states list is provided for reusing.
-     *
-     * @param graph The whole graph
-     * @param linkStates The already initialized link states object
-     * @param node The list of node property collection for each node
-     * @param seeds The seed set
-     * @param boostedNodes The list of boosted nodes
-     * @return A SimResultItem object with the result of this simulation.
+     * Each item is marked by an epoch stamp, and items with an out-dated stamp are regarded as default.
+     * Therefore, resetting takes O(1) time instead of O(|V|),
+     * and only the nodes touched (reached or boosted) in current propagation are recorded.
      */
-    template <rs::range Range>
-    SimResultItem simulateBoostedOnce(
+    class NodeSimStates {
+        // Current epoch. The item of node v is valid only if stamp[v] == epoch
+        unsigned                        epoch = 0;
+        std::vector<unsigned>           stamp;
+        std::vector<NodeSimProperties>  items;
+        // List of nodes touched in current epoch
+        std::vector<std::size_t>        touchedNodes;
+
+        static inline const auto defaultItem = NodeSimProperties{};
+
+    public:
+        /*!
+         * @brief Starts a new propagation, resetting all the nodes to default.
+         * @param n Graph size |V|
+         */
+        void reset(std::size_t n) {
+            if (stamp.size() != n) {
+                stamp.assign(n, 0);
+                items.resize(n);
+                epoch = 0;
+            }
+            // Resets all the stamps once the epoch value overflows
+            if (++epoch == 0) {
+                rs::fill(stamp, 0);
+                epoch = 1;
+            }
+            touchedNodes.clear();
+        }
+
+        /*!
+         * @brief Gets the properties of node v. Default values are returned if not touched yet.
+         */
+        [[nodiscard]] const NodeSimProperties& operator [] (std::size_t v) const {
+            return stamp[v] == epoch ? items[v] : defaultItem;
+        }
+
+        /*!
+         * @brief Gets the mutable properties of node v, which is then marked as touched.
+         */
+        NodeSimProperties& touch(std::size_t v) {
+            if (stamp[v] != epoch) {
+                stamp[v] = epoch;
+                items[v] = NodeSimProperties{};
+                touchedNodes.push_back(v);
+            }
+            return items[v];
+        }
+
+        /*!
+         * @brief Gets the list of nodes touched in current propagation.
+         */
+        [[nodiscard]] const std::vector<std::size_t>& touched() const {
+            return touchedNodes;
+        }
+    };
+
+    /*!
+     * Implementation of propagateOnce with the node state priority fixed at compile time.
+     */
+    template <class Priority, LinkStateSource LinkStates, rs::range Range>
+    SimResultItem _propagateOnce(
+            Priority,
             const IMMGraph&                 graph,
-            IMMLinkStateSamples&            linkStates,
-            std::vector<NodeSimProperties>& nodes,
+            LinkStates&                     linkStates,
+            NodeSimStates&                  nodes,
             const SeedSet&                  seeds,
+            const NodeStateContext&         stateCtx,
             Range&&                         boostedNodes)
     requires(std::convertible_to<rs::range_value_t<Range>, std::size_t>) {
-        // First refreshes all the link states
-        linkStates.initOrRefresh(graph.nLinks());
-        // Initializes all the node properties with default values
-        nodes.assign(graph.nNodes(), NodeSimProperties{});
+        // Resets all the node properties to default values
+        nodes.reset(graph.nNodes());
 
         // Marks all the boosted nodes
         for (auto s: boostedNodes) {
-            nodes[s].boosted = true;
+            nodes.touch(s).boosted = true;
         }
 
         auto Q = std::queue<std::size_t>();
         // Adds all the seeds to queue first
         for (auto a: seeds.Sa()) {
-            nodes[a].state = NodeState::Ca;
-            nodes[a].dist = 0;
+            auto& node = nodes.touch(a);
+            node.state = NodeState::Ca;
+            node.dist = 0;
             Q.emplace(a);
         }
         for (auto r: seeds.Sr()) {
-            nodes[r].state = NodeState::Cr;
-            nodes[r].dist = 0;
+            auto& node = nodes.touch(r);
+            node.state = NodeState::Cr;
+            node.dist = 0;
             Q.emplace(r);
         }
 
         for (; !Q.empty(); Q.pop()) {
             auto cur = Q.front();
+            auto& curNode = nodes.touch(cur);
             // Boosted nodes may change its state,
             //  making positive message boosted and negative message neutralized
-            if (nodes[cur].boosted) {
-                if (nodes[cur].state == NodeState::Ca) {
-                    nodes[cur].state = NodeState::CaPlus;
-                } else if (nodes[cur].state == NodeState::Cr) {
-                    nodes[cur].state = NodeState::CrMinus;
+            if (curNode.boosted) {
+                if (curNode.state == NodeState::Ca) {
+                    curNode.state = NodeState::CaPlus;
+                } else if (curNode.state == NodeState::Cr) {
+                    curNode.state = NodeState::CrMinus;
                 }
             }
             for (const auto& [to_, link]: graph.fastLinksFrom(cur)) {
                 auto to = index(to_);
                 // Checks the link state
                 // For Ca+ message, either boosted or active is OK.
-                if (nodes[cur].state == NodeState::CaPlus && linkStates.get(link) == LinkState::Blocked) {
+                if (curNode.state == NodeState::CaPlus && linkStates.get(link) == LinkState::Blocked) {
                     continue;
                 }
                 // For others, only active.
-                if (nodes[cur].state != NodeState::CaPlus && linkStates.get(link) != LinkState::Active) {
+                if (curNode.state != NodeState::CaPlus && linkStates.get(link) != LinkState::Active) {
                     continue;
                 }
 
-                if (nodes[cur].dist + 1 < nodes[to].dist) {
+                auto& toNode = nodes.touch(to);
+                if (curNode.dist + 1 < toNode.dist) {
                     // If to is never visited before, adds it to queue
-                    if (nodes[to].dist == NodeSimProperties::infDist) {
+                    if (toNode.dist == NodeSimProperties::infDist) {
                         Q.emplace(to);
                     }
                     // Updates dist and state, message propagates along cur -> to
-                    nodes[to].state = nodes[cur].state;
-                    nodes[to].dist = nodes[cur].dist + 1;
+                    toNode.state = curNode.state;
+                    toNode.dist = curNode.dist + 1;
                 }
                     // Some other message has arrived in the same round, but current one has higher priority
-                else if (nodes[cur].dist + 1 == nodes[to].dist && compare(nodes[cur].state, nodes[to].state) > 0) {
-                    nodes[to].state = nodes[cur].state;
+                else if (curNode.dist + 1 == toNode.dist && Priority::higher(curNode.state, toNode.state)) {
+                    toNode.state = curNode.state;
                 }
             }
         }
 
+        // Only the touched nodes are counted. All the others are None.
         auto res = SimResultItem{};
-        for (const auto& node: graph.nodes()) {
-            res.add(nodes[index(node)].state);
+        for (auto v: nodes.touched()) {
+            res.add(nodes[v].state, stateCtx);
         }
+        res.noneCount += static_cast<double>(graph.nNodes() - nodes.touched().size());
         return res;
     }
+
+    /*!
+     * Propagates messages with given boosted nodes in the current sampled world.
+     *
+     * Each propagation sums up the gain of all the nodes,
+     * Ca and Ca+ counted as lambda, Cr as lambda - 1, Cr- and None as 0.
+     *
+     * Unlike simulateBoostedOnce, the link states are NOT refreshed,
+     * thus multiple calls between two refreshing share the same sampled world.
+     * The link states object must be initialized with graph size |E| before calling,
+     * or a pre-sampled world (e.g. IMMWorldBank::World) can be used instead.
+     *
+     * The node states object is provided for reusing,
+     * and only the nodes reached or boosted are touched so that the cost scales with the cascade size.
+     *
+     * @param graph The whole graph
+     * @param linkStates The already initialized link states object
+     * @param node The list of node property collection for each node
+     * @param seeds The seed set
+     * @param stateCtx The node state priority and gain
+     * @param boostedNodes The list of boosted nodes
+     * @return A SimResultItem object with the result of this propagation.
+     */
+    template <LinkStateSource LinkStates, rs::range Range>
+    SimResultItem propagateOnce(
+            const IMMGraph&                 graph,
+            LinkStates&                     linkStates,
+            NodeSimStates&                  nodes,
+            const SeedSet&                  seeds,
+            const NodeStateContext&         stateCtx,
+            Range&&                         boostedNodes)
+    requires(std::convertible_to<rs::range_value_t<Range>, std::size_t>) {
+        return stateCtx.visitPriority([&](auto priority) {
+            return _propagateOnce(priority, graph, linkStates, nodes, seeds, stateCtx,
+                                  std::forward<Range>(boostedNodes));
+        });
+    }
+
+    /*!
+     * @brief Buffers of delta propagation, reused among multiple calls.
+     *
+     * Let (dist0, state0) be the baseline propagation result of a node in the current world,
+     * and (dist, state) be that with more boosted nodes.
+     * Only the nodes whose (dist, state) may differ from the baseline are stored in the overlay,
+     * which is marked by epoch stamps so that no full reset is required between calls.
+     */
+    struct NodeDeltaBuffer {
+        // Current epoch. The overlay item of node v is valid only if changedStamp[v] == epoch
+        unsigned                    epoch = 0;
+        // changedStamp[v] == epoch: the baseline value of node v is out-dated,
+        //  with (dist[v], state[v]) as its current value
+        std::vector<unsigned>       changedStamp;
+        // finalStamp[v] == epoch: the current value of node v is final.
+        //  Otherwise, the overlay item (+inf, None) is a placeholder until the new value is found
+        std::vector<unsigned>       finalStamp;
+        // boostedStamp[v] == epoch: node v is boosted
+        std::vector<unsigned>       boostedStamp;
+        // scheduledStamp[v] == epoch: node v has been scheduled at level scheduledLevel[v] most recently
+        std::vector<unsigned>       scheduledStamp;
+        std::vector<std::size_t>    scheduledLevel;
+        // Current values of the changed nodes
+        std::vector<std::size_t>    dist;
+        std::vector<NodeState>      state;
+        // List of all the changed nodes
+        std::vector<std::size_t>    changed;
+        // buckets[d] = nodes to be re-evaluated at level d
+        std::vector<std::vector<std::size_t>> buckets;
+
+        /*!
+         * @brief Starts a new epoch, invalidating all the overlay items.
+         * @param n Graph size |V|
+         */
+        void nextEpoch(std::size_t n) {
+            if (changedStamp.size() != n) {
+                changedStamp.assign(n, 0);
+                finalStamp.assign(n, 0);
+                boostedStamp.assign(n, 0);
+                scheduledStamp.assign(n, 0);
+                scheduledLevel.assign(n, 0);
+                dist.assign(n, NodeSimProperties::infDist);
+                state.assign(n, NodeState::None);
+                epoch = 0;
+            }
+            // Resets all the stamps once the epoch value overflows
+            if (++epoch == 0) {
+                rs::fill(changedStamp, 0);
+                rs::fill(finalStamp, 0);
+                rs::fill(boostedStamp, 0);
+                rs::fill(scheduledStamp, 0);
+                epoch = 1;
+            }
+            changed.clear();
+            for (auto& b: buckets) {
+                b.clear();
+            }
+        }
+    };
+
+    /*!
+     * Implementation of propagateDelta with the node state priority fixed at compile time.
+     */
+    template <class Priority, LinkStateSource LinkStates, rs::range Range>
+    SimResultItem _propagateDelta(
+            Priority,
+            const IMMGraph&                         graph,
+            LinkStates&                             linkStates,
+            const NodeSimStates&                    baseNodes,
+            const SimResultItem&                    baseResult,
+            NodeDeltaBuffer&                        buffer,
+            const SeedSet&                          seeds,
+            const NodeStateContext&                 stateCtx,
+            Range&&                                 boostedNodes)
+    requires(std::convertible_to<rs::range_value_t<Range>, std::size_t>) {
+        constexpr auto infDist = NodeSimProperties::infDist;
+        auto& B = buffer;
+        B.nextEpoch(graph.nNodes());
+
+        auto isChanged = [&](std::size_t v) {
+            return B.changedStamp[v] == B.epoch;
+        };
+        // Current (dist, state) of node v, either in the overlay or the baseline
+        auto curDist = [&](std::size_t v) {
+            return isChanged(v) ? B.dist[v] : baseNodes[v].dist;
+        };
+        auto curState = [&](std::size_t v) {
+            return isChanged(v) ? B.state[v] : baseNodes[v].state;
+        };
+        // For Ca+ message, either boosted or active is OK. For others, only active.
+        auto passable = [&](NodeState s, const IMMLink& link) {
+            auto linkState = linkStates.get(link);
+            return s == NodeState::CaPlus ? linkState != LinkState::Blocked : linkState == LinkState::Active;
+        };
+        auto schedule = [&](std::size_t v, std::size_t level) {
+            if (B.scheduledStamp[v] == B.epoch && B.scheduledLevel[v] == level) {
+                return;
+            }
+            B.scheduledStamp[v] = B.epoch;
+            B.scheduledLevel[v] = level;
+            if (level >= B.buckets.size()) {
+                B.buckets.resize(level + 1);
+            }
+            B.buckets[level].push_back(v);
+        };
+        auto setOverlay = [&](std::size_t v, std::size_t dist, NodeState state) {
+            if (!isChanged(v)) {
+                B.changedStamp[v] = B.epoch;
+                B.changed.push_back(v);
+            }
+            B.dist[v] = dist;
+            B.state[v] = state;
+        };
+        // Schedules the out-neighbors of v at level L + 1 after the value of v changes at level L.
+        // newDist == +inf if the new value is not found yet.
+        auto scheduleOutNeighbors = [&](std::size_t v, std::size_t level, std::size_t newDist, NodeState newState) {
+            const auto& base = baseNodes[v];
+            for (const auto& [to_, link]: graph.fastLinksFrom(v)) {
+                auto to = index(to_);
+                // The baseline value of the target may be contributed by v
+                bool wasSource = base.dist != infDist && base.dist + 1 == baseNodes[to].dist
+                                 && passable(base.state, link);
+                // The new value of v may contribute to the target
+                bool isSource = newDist != infDist && newDist + 1 <= curDist(to) && passable(newState, link);
+                if (wasSource || isSource) {
+                    schedule(to, level + 1);
+                }
+            }
+        };
+
+        for (auto s: boostedNodes) {
+            B.boostedStamp[s] = B.epoch;
+            // Boosting changes the state of s (Ca -> Ca+, Cr -> Cr-) if it's reached in the baseline
+            if (!baseNodes[s].boosted && baseNodes[s].dist != infDist) {
+                schedule(s, baseNodes[s].dist);
+            }
+        }
+
+        for (std::size_t level = 0; level < B.buckets.size(); level++) {
+            // New nodes are scheduled at higher levels only, thus B.buckets[level] is never changed in the loop
+            for (std::size_t i = 0; i < B.buckets[level].size(); i++) {
+                auto v = B.buckets[level][i];
+                // The new value is final once confirmed
+                if (B.finalStamp[v] == B.epoch) {
+                    continue;
+                }
+                // Re-evaluates (dist, state) of node v from its in-neighbors with final values
+                auto dist = infDist;
+                auto state = NodeState::None;
+                // Tentative dist from the other in-neighbors, whose values may still change
+                auto tentativeDist = infDist;
+                if (seeds.contains(v)) {
+                    dist = 0;
+                    state = seeds.containsInSr(v) ? NodeState::Cr : NodeState::Ca;
+                } else {
+                    for (const auto& [from_, link]: graph.fastLinksTo(v)) {
+                        auto from = index(from_);
+                        auto fromDist = curDist(from);
+                        if (fromDist == infDist || fromDist + 1 > dist) {
+                            continue;
+                        }
+                        if (fromDist >= level) {
+                            if (fromDist + 1 < tentativeDist && passable(curState(from), link)) {
+                                tentativeDist = fromDist + 1;
+                            }
+                            continue;
+                        }
+                        auto fromState = curState(from);
+                        if (!passable(fromState, link)) {
+                            continue;
+                        }
+                        if (fromDist + 1 < dist) {
+                            dist = fromDist + 1;
+                            state = fromState;
+                        } else if (Priority::higher(fromState, state)) {
+                            state = fromState;
+                        }
+                    }
+                }
+                if (B.boostedStamp[v] == B.epoch) {
+                    if (state == NodeState::Ca) {
+                        state = NodeState::CaPlus;
+                    } else if (state == NodeState::Cr) {
+                        state = NodeState::CrMinus;
+                    }
+                }
+
+                const auto& base = baseNodes[v];
+                if (dist <= level) {
+                    // The value is final. Propagation is cut off here if it agrees with the baseline again.
+                    if (!isChanged(v) && dist == base.dist && state == base.state) {
+                        continue;
+                    }
+                    B.finalStamp[v] = B.epoch;
+                    setOverlay(v, dist, state);
+                    scheduleOutNeighbors(v, level, dist, state);
+                    continue;
+                }
+                // The baseline value is out-dated since dist > level = dist0
+                if (!isChanged(v) && base.dist == level) {
+                    setOverlay(v, infDist, NodeState::None);
+                    scheduleOutNeighbors(v, level, infDist, NodeState::None);
+                }
+                // Re-evaluated later, no later than dist0 if the baseline value is still possible.
+                // If the tentative dist decreases later, v is scheduled again by the in-neighbor changed.
+                auto next = isChanged(v) ? tentativeDist : std::min(tentativeDist, base.dist);
+                if (next != infDist) {
+                    schedule(v, next);
+                }
+            }
+        }
+
+        // Applies the difference to the baseline result
+        auto added = SimResultItem{};
+        auto removed = SimResultItem{};
+        for (auto v: B.changed) {
+            added.add(B.state[v], stateCtx);
+            removed.add(baseNodes[v].state, stateCtx);
+        }
+        return baseResult + added - removed;
+    }
+
+    /*!
+     * Propagates messages with given boosted nodes in the current sampled world,
+     * by applying the difference on the baseline propagation result.
+     *
+     * The baseline nodes must be the result of propagateOnce in the same sampled world
+     * (i.e. link states not refreshed since then), with a subset of the given boosted nodes.
+     * The result is the same as propagateOnce(graph, linkStates, nodes, seeds, boostedNodes),
+     * but only the nodes whose state or distance may change are re-evaluated.
+     *
+     * Nodes are processed level by level, where the values of all the nodes with dist < L are final
+     * when processing level L. A node re-evaluated at level L takes the current values of its in-neighbors:
+     *   - If its dist becomes L, the value is final, and the out-neighbors are scheduled at level L + 1
+     *     if the change matters to them;
+     *   - If its dist is larger but its baseline dist is L, the baseline value is out-dated
+     *     (e.g. a Ca+ node becomes Cr- thus some Boosted link is no longer passable),
+     *     its out-neighbors are scheduled at level L + 1 as well,
+     *     and it's re-scheduled at the level of its tentative dist.
+     * Propagation stops once no node changes any more.
+     * With the empty baseline boosted set, dist never increases thus the latter case never happens.
+     *
+     * @param graph The whole graph
+     * @param linkStates The link states object, with the same world as the baseline
+     * @param baseNodes The baseline propagation result
+     * @param baseResult The SimResultItem of the baseline
+     * @param buffer The buffer object for reusing
+     * @param seeds The seed set
+     * @param stateCtx The node state priority and gain
+     * @param boostedNodes The list of boosted nodes, as a superset of that of the baseline
+     * @return A SimResultItem object with the result with boosted nodes.
+     */
+    template <LinkStateSource LinkStates, rs::range Range>
+    SimResultItem propagateDelta(
+            const IMMGraph&                         graph,
+            LinkStates&                             linkStates,
+            const NodeSimStates&                    baseNodes,
+            const SimResultItem&                    baseResult,
+            NodeDeltaBuffer&                        buffer,
+            const SeedSet&                          seeds,
+            const NodeStateContext&                 stateCtx,
+            Range&&                                 boostedNodes)
+    requires(std::convertible_to<rs::range_value_t<Range>, std::size_t>) {
+        return stateCtx.visitPriority([&](auto priority) {
+            return _propagateDelta(priority, graph, linkStates, baseNodes, baseResult, buffer, seeds, stateCtx,
+                                   std::forward<Range>(boostedNodes));
+        });
+    }
+
+    /*!
+     * Simulates message propagation with given boosted nodes.
+     *
+     * The link states are refreshed first so that a new world is sampled.
+     * See propagateOnce for details.
+     *
+     * @param graph The whole graph
+     * @param linkStates The already initialized link states object
+     * @param node The list of node property collection for each node
+     * @param seeds The seed set
+     * @param stateCtx The node state priority and gain
+     * @param boostedNodes The list of boosted nodes
+     * @return A SimResultItem object with the result of this simulation.
+     */
+    template <rs::range Range>
+    SimResultItem simulateBoostedOnce(
+            const IMMGraph&                 graph,
+            IMMLinkStateSamples&            linkStates,
+            NodeSimStates&                  nodes,
+            const SeedSet&                  seeds,
+            const NodeStateContext&         stateCtx,
+            Range&&                         boostedNodes)
+    requires(std::convertible_to<rs::range_value_t<Range>, std::size_t>) {
+        auto kernel = perf::ScopedKernel(perf::Kernel::Simulation);
+        auto event = trace::ScopedEvent("simulateBoostedOnce");
+        // First refreshes all the link states
+        linkStates.initOrRefresh(graph.nLinks());
+        return propagateOnce(graph, linkStates, nodes, seeds, stateCtx, std::forward<Range>(boostedNodes));
+    }
+
+    /*!
+     * Simulates message propagation with given boosted nodes for T times in current thread,
+     * with the link states object and the node states object provided for reusing.
+     *
+     * @param graph The whole graph
+     * @param linkStates The link states object
+     * @param nodes The node states object
+     * @param seeds The seed set
+     * @param stateCtx The node state priority and gain
+     * @param boostedNodes The list of boosted nodes
+     * @param simTimes T, How many times to simulate
+     * @return The average result of T simulations
+     */
+    template <rs::range Range>
+    SimResultItem simulateBoostedSerial(
+            const IMMGraph&                 graph,
+            IMMLinkStateSamples&            linkStates,
+            NodeSimStates&                  nodes,
+            const SeedSet&                  seeds,
+            const NodeStateContext&         stateCtx,
+            Range&&                         boostedNodes,
+            std::size_t                     simTimes)
+    requires(std::convertible_to<rs::range_value_t<Range>, std::size_t>) {
+        auto res = SimResultItem{};
+        for (std::size_t i = 0; i != simTimes; i++) {
+            res += simulateBoostedOnce(graph, linkStates, nodes, seeds, stateCtx, boostedNodes);
+        }
+        return res / simTimes;
+    }
+
+    /*!
+     * Simulates message propagation without boosted nodes and with each prefix of the boosted nodes,
+     * all in the same sampled world.
+     *
+     * The baseline is propagated only once, and then each prefix is evaluated by delta propagation on it.
+     * See propagateDelta for details.
+     *
+     * The results are written to res, which is resized to |kList| + 1:
+     *   - res[0] = result without boosted nodes;
+     *   - res[i + 1] = result with the first min{kList[i], Total} boosted nodes.
+     *
+     * @param graph The whole graph
+     * @param linkStates The already initialized link states object
+     * @param node The list of node property collection for each node
+     * @param deltaBuffer The buffer object of delta propagation
+     * @param seeds The seed set
+     * @param stateCtx The node state priority and gain
+     * @param boostedNodes The list of boosted nodes
+     * @param kList The list of K's
+     * @param res The destination of results
+     */
+    template <rs::range NodeRange, rs::sized_range KRange>
+    void simulatePairedOnce(
+            const IMMGraph&                 graph,
+            IMMLinkStateSamples&            linkStates,
+            NodeSimStates&                  nodes,
+            NodeDeltaBuffer&                deltaBuffer,
+            const SeedSet&                  seeds,
+            const NodeStateContext&         stateCtx,
+            NodeRange&&                     boostedNodes,
+            KRange&&                        kList,
+            std::vector<SimResultItem>&     res)
+    requires (std::convertible_to<rs::range_value_t<NodeRange>, std::size_t>)
+    && (std::convertible_to<rs::range_value_t<KRange>, std::size_t>) {
+        auto kernel = perf::ScopedKernel(perf::Kernel::Simulation);
+        auto event = trace::ScopedEvent("simulatePairedOnce");
+        res.resize(rs::size(kList) + 1);
+        // Samples the world only once for all the propagations below
+        linkStates.initOrRefresh(graph.nLinks());
+        res[0] = propagateOnce(graph, linkStates, nodes, seeds, stateCtx, vs::empty<std::size_t>);
+
+        for (std::size_t i = 0; auto k: kList) {
+            res[++i] = propagateDelta(graph, linkStates, nodes, res[0], deltaBuffer, seeds, stateCtx,
+                                      boostedNodes | vs::take(k));
+        }
+    }
+    /*!
+     * Runs simulations in batches until T simulations are done or the stopping condition is satisfied.
+     * If the precision target is disabled, all the T simulations are run in a single batch.
+     *
+     * @param simTimes T, Upper limit of simulation count
+     * @param precision The precision target
+     * @param runBatch Function runBatch(n) which runs n simulations
+     * @param stop Predicate stop() checked after each batch. Stops if true is returned.
+     */
+    template <class BatchFunc, class StopFunc>
+    void runSimulationBatches(
+            std::size_t         simTimes,
+            const SimPrecision& precision,
+            BatchFunc&&         runBatch,
+            StopFunc&&          stop) {
+        if (!precision.enabled()) {
+            runBatch(simTimes);
+            return;
+        }
+        for (std::size_t done = 0; done < simTimes; ) {
+            auto cur = std::min(SimPrecision::batchSize, simTimes - done);
+            runBatch(cur);
+            done += cur;
+            if (stop()) {
+                break;
+            }
+        }
+    }
 }
 
 /*!
@@ -269,40 +899,49 @@ namespace {
  *
  * @param graph The whole graph
  * @param seeds The seed set
+ * @param stateCtx The node state priority and gain
  * @param boostedNodes The list of boosted nodes
  * @return A SimResultItem object with the result of this simulation.
  */
 template <rs::range Range>
 SimResultItem simulateBoostedOnce(
-        const IMMGraph& graph,
-        const SeedSet&  seeds,
-        Range&&         boostedNodes)
+        const IMMGraph&         graph,
+        const SeedSet&          seeds,
+        const NodeStateContext& stateCtx,
+        Range&&                 boostedNodes)
 {
     auto linkStates = IMMLinkStateSamples(graph.nLinks());
-    auto nodes = std::vector<NodeSimProperties>(graph.nNodes());
-    return simulateBoostedOnce(graph, linkStates, nodes, seeds, std::forward<Range>(boostedNodes));
+    auto nodes = NodeSimStates{};
+    return simulateBoostedOnce(graph, linkStates, nodes, seeds, stateCtx, std::forward<Range>(boostedNodes));
 }
 
 /*!
  * @brief Simulates message propagation with given boosted nodes, with multi-threading support.
 
- * Simulation repeats for T times and the average is taken as result.
+ * Simulation repeats for T times, or fewer if the precision target is satisfied earlier,
+ * and the statistics of all the simulations are taken as result.
  * See simulateBoostedOnce for details.
  *
  * @param graph The whole graph
  * @param seeds The seed set
+ * @param stateCtx The node state priority and gain
  * @param boostedNodes The list of boosted nodes
- * @param simTimes T, How many times to simulate
+ * @param simTimes T, How many times to simulate at most
  * @param nThreads How many threads used for simulation
- * @return Total gain, positive gain and negative gain in average
+ * @param precision The precision target. Disabled by default
+ * @param progress Progress counter incremented per simulation, or nullptr if not reported
+ * @return Statistics of all the simulation results
  */
 template <rs::range Range>
-SimResultItem simulateBoosted (
-        const IMMGraph& graph,
-        const SeedSet&  seeds,
-        Range&&         boostedNodes,
-        std::size_t     simTimes,
-        std::size_t     nThreads = 1)
+SimResultStats simulateBoostedStats(
+        const IMMGraph&         graph,
+        const SeedSet&          seeds,
+        const NodeStateContext& stateCtx,
+        Range&&                 boostedNodes,
+        std::size_t             simTimes,
+        std::size_t             nThreads = 1,
+        const SimPrecision&     precision = {},
+        ProgressCounter*        progress = nullptr)
         requires (std::convertible_to<rs::range_value_t<Range>, std::size_t>)
 {
     // Reuses link state objects for each thread
@@ -311,20 +950,57 @@ SimResultItem simulateBoosted (
         linkStatesPool[i].init(graph.nLinks());
     }
     // Reuses node state lists for each thread
-    auto nodesPool = std::vector<std::vector<NodeSimProperties>>{nThreads};
-    // Results of each thread
-    auto subResults = std::vector<SimResultItem>{nThreads};
+    auto nodesPool = std::vector<NodeSimStates>{nThreads};
+    // Statistics of each thread in current batch
+    auto subStats = std::vector<SimResultStats>{nThreads};
+    auto stats = SimResultStats{};
 
-    runTaskGroup(vs::iota(std::size_t{0}, nThreads) | vs::transform([&](std::size_t tid) {
-        return [&, tid](std::size_t) {
+    runSimulationBatches(simTimes, precision, [&](std::size_t batchSize) {
+        parallelForIndex(nThreads, batchSize, [&](std::size_t tid, std::size_t) {
             auto& linkStates    = linkStatesPool[tid];
             auto& nodes         = nodesPool[tid];
-            auto& subRes        = subResults[tid];
-            subRes += simulateBoostedOnce(graph, linkStates, nodes, seeds, boostedNodes);
-        };
-    }), vs::iota(std::size_t{0}, simTimes));
+            subStats[tid].add(simulateBoostedOnce(graph, linkStates, nodes, seeds, stateCtx, boostedNodes));
+            if (progress != nullptr) {
+                progress->increment();
+            }
+        });
+
+        for (auto& sub: subStats) {
+            stats += sub;
+            sub = SimResultStats{};
+        }
+    }, [&]() {
+        return precision.satisfiedBy(stats.mean, stats.halfWidth(precision.z()));
+    });
 
-    return std::accumulate(subResults.begin(), subResults.end(), SimResultItem{}) / simTimes;
+    return stats;
+}
+
+/*!
+ * @brief Simulates message propagation with given boosted nodes, with multi-threading support.
+
+ * Simulation repeats for T times and the average is taken as result.
+ * See simulateBoostedStats for details.
+ *
+ * @param graph The whole graph
+ * @param seeds The seed set
+ * @param stateCtx The node state priority and gain
+ * @param boostedNodes The list of boosted nodes
+ * @param simTimes T, How many times to simulate
+ * @param nThreads How many threads used for simulation
+ * @return Total gain, positive gain and negative gain in average
+ */
+template <rs::range Range>
+SimResultItem simulateBoosted (
+        const IMMGraph&         graph,
+        const SeedSet&          seeds,
+        const NodeStateContext& stateCtx,
+        Range&&                 boostedNodes,
+        std::size_t             simTimes,
+        std::size_t             nThreads = 1)
+        requires (std::convertible_to<rs::range_value_t<Range>, std::size_t>)
+{
+    return simulateBoostedStats(graph, seeds, stateCtx, std::forward<Range>(boostedNodes), simTimes, nThreads).mean;
 }
 
 /*!
@@ -335,6 +1011,7 @@ SimResultItem simulateBoosted (
  *
  * @param graph The whole graph
  * @param seeds The seed set
+ * @param stateCtx The node state priority and gain
  * @param boostedNodes The list of boosted nodes
  * @param simTimes T, How many times to simulate
  * @param nThreads How many threads used for simulation
@@ -342,16 +1019,17 @@ SimResultItem simulateBoosted (
  */
 template <rs::range Range>
 SimResult simulate(
-        const IMMGraph& graph,
-        const SeedSet&  seeds,
-        Range&&         boostedNodes,
-        std::size_t     simTimes,
-        std::size_t     nThreads = 1)
+        const IMMGraph&         graph,
+        const SeedSet&          seeds,
+        const NodeStateContext& stateCtx,
+        Range&&                 boostedNodes,
+        std::size_t             simTimes,
+        std::size_t             nThreads = 1)
         requires (std::convertible_to<rs::range_value_t<Range>, std::size_t>)
 {
     return SimResult(
-            simulateBoosted(graph, seeds, boostedNodes, simTimes, nThreads),
-            simulateBoosted(graph, seeds, vs::empty<std::size_t>, simTimes, nThreads)
+            simulateBoosted(graph, seeds, stateCtx, boostedNodes, simTimes, nThreads),
+            simulateBoosted(graph, seeds, stateCtx, vs::empty<std::size_t>, simTimes, nThreads)
             );
 }
 
@@ -366,31 +1044,266 @@ SimResult simulate(
  *
  * See simulate(graph, seeds, boostedNodes, simTimes, nThreads) for details.
  *
+ * If the precision target is enabled, simulations with and without boosted nodes
+ * stop independently once the confidence interval of their own total gain is narrow enough.
+ *
  * @param graph The whole graph
  * @param seeds The seed set
+ * @param stateCtx The node state priority and gain
  * @param boostedNodes The list of boosted nodes
  * @param kList The list of K's
- * @param simTimes T, How many times to simulate
+ * @param simTimes T, How many times to simulate at most
  * @param nThreads How many threads used for simulation
+ * @param precision The precision target. Disabled by default
+ * @param progress Progress counter incremented per simulation, T * (|kList| + 1) in total,
+ *  or nullptr if not reported
  * @return A list of simulation results for each K, with boosted nodes, without boosted nodes, and their difference
  */
 template <rs::range NodeRange, rs::range KRange>
 std::vector<SimResult> simulate(
-        const IMMGraph& graph,
-        const SeedSet&  seeds,
-        NodeRange&&     boostedNodes,
-        KRange&&        kList,
-        std::size_t     simTimes,
-        std::size_t     nThreads = 1)
+        const IMMGraph&         graph,
+        const SeedSet&          seeds,
+        const NodeStateContext& stateCtx,
+        NodeRange&&             boostedNodes,
+        KRange&&                kList,
+        std::size_t             simTimes,
+        std::size_t             nThreads = 1,
+        const SimPrecision&     precision = {},
+        ProgressCounter*        progress = nullptr)
         requires (std::convertible_to<rs::range_value_t<NodeRange>, std::size_t>)
         && (std::convertible_to<rs::range_value_t<KRange>, std::size_t>)
 {
-    auto withoutBoosted = simulateBoosted(graph, seeds, vs::empty<std::size_t>, simTimes, nThreads);
+    auto z = precision.z();
+    auto withoutBoosted = simulateBoostedStats(
+            graph, seeds, stateCtx, vs::empty<std::size_t>, simTimes, nThreads, precision, progress);
     auto res = std::vector<SimResult>{};
 
     for (auto k: kList) {
-        auto withBoosted = simulateBoosted(graph, seeds, boostedNodes | vs::take(k), simTimes, nThreads);
-        res.push_back(SimResult(withBoosted, withoutBoosted));
+        auto withBoosted = simulateBoostedStats(
+                graph, seeds, stateCtx, boostedNodes | vs::take(k), simTimes, nThreads, precision, progress);
+        auto& item = res.emplace_back(withBoosted.mean, withoutBoosted.mean);
+        // Both are estimated independently, thus Var(diff) = Var(with) + Var(without)
+        item.sampleCount = withBoosted.count;
+        item.confidence = precision.confidence;
+        item.diffHalfWidth = SimResultStats::halfWidth(
+                z, withBoosted.squaredStdError() + withoutBoosted.squaredStdError());
+    }
+    return res;
+}
+
+/*!
+ * @brief Simulates message propagation with and without given boosted nodes, using common random numbers.
+ *
+ * Unlike simulate(graph, seeds, boostedNodes, kList, simTimes, nThreads) where each K is simulated
+ * independently with freshly sampled worlds, each world is sampled only once here,
+ * and the result without boosted nodes and the results of all the K's are evaluated on the same world.
+ * Therefore, the differences are paired per world, with much lower variance than the independent ones,
+ * and (|kList| + 1) times fewer link samples are required.
+ * Besides, the baseline is propagated once per world and each K is evaluated by delta propagation on it,
+ * whose cost scales with the nodes changed by boosting rather than the whole cascade.
+ *
+ * Assumes that the boosted nodes are sorted by descending order of influence.
+ * For each K, only the first min{K, Total} boosted nodes are used for simulation.
+ *
+ * @param graph The whole graph
+ * @param seeds The seed set
+ * @param stateCtx The node state priority and gain
+ * @param boostedNodes The list of boosted nodes
+ * @param kList The list of K's
+ * @param simTimes T, How many worlds to sample at most
+ * @param nThreads How many threads used for simulation
+ * @param precision The precision target, checked with the confidence intervals of differences. Disabled by default
+ * @param progress Progress counter incremented per world, or nullptr if not reported
+ * @return A list of simulation results for each K, with boosted nodes, without boosted nodes, and their difference
+ */
+template <rs::range NodeRange, rs::sized_range KRange>
+std::vector<SimResult> simulatePaired(
+        const IMMGraph&         graph,
+        const SeedSet&          seeds,
+        const NodeStateContext& stateCtx,
+        NodeRange&&             boostedNodes,
+        KRange&&                kList,
+        std::size_t             simTimes,
+        std::size_t             nThreads = 1,
+        const SimPrecision&     precision = {},
+        ProgressCounter*        progress = nullptr)
+        requires (std::convertible_to<rs::range_value_t<NodeRange>, std::size_t>)
+        && (std::convertible_to<rs::range_value_t<KRange>, std::size_t>)
+{
+    auto nK = rs::size(kList);
+    auto z = precision.z();
+    // Reuses link state objects for each thread
+    auto linkStatesPool = std::vector<IMMLinkStateSamples>{nThreads};
+    for (std::size_t i = 0; i < nThreads; i++) {
+        linkStatesPool[i].init(graph.nLinks());
+    }
+    // Reuses node state lists for each thread
+    auto nodesPool = std::vector<NodeSimStates>{nThreads};
+    // Reuses delta propagation buffers for each thread
+    auto deltaBufferPool = std::vector<NodeDeltaBuffer>{nThreads};
+    // Reuses result lists of a single world for each thread
+    auto curResultsPool = std::vector<std::vector<SimResultItem>>{nThreads};
+    // Statistics of each thread in current batch,
+    //  subStats[tid][0] without boosted nodes, subStats[tid][i + 1] with kList[i]
+    auto subStats = std::vector<std::vector<SimResultStats>>(nThreads, std::vector<SimResultStats>(nK + 1));
+    // Statistics of per-world differences of each thread in current batch, subDiffStats[tid][i] with kList[i]
+    auto subDiffStats = std::vector<std::vector<SimResultStats>>(nThreads, std::vector<SimResultStats>(nK));
+    auto stats = std::vector<SimResultStats>(nK + 1);
+    auto diffStats = std::vector<SimResultStats>(nK);
+
+    runSimulationBatches(simTimes, precision, [&](std::size_t batchSize) {
+        parallelForIndex(nThreads, batchSize, [&](std::size_t tid, std::size_t) {
+            auto& curResults = curResultsPool[tid];
+            simulatePairedOnce(graph, linkStatesPool[tid], nodesPool[tid], deltaBufferPool[tid],
+                               seeds, stateCtx, boostedNodes, kList, curResults);
+            subStats[tid][0].add(curResults[0]);
+            for (std::size_t i = 0; i != nK; i++) {
+                subStats[tid][i + 1].add(curResults[i + 1]);
+                subDiffStats[tid][i].add(curResults[i + 1] - curResults[0]);
+            }
+            if (progress != nullptr) {
+                progress->increment();
+            }
+        });
+
+        for (std::size_t tid = 0; tid != nThreads; tid++) {
+            for (std::size_t i = 0; i != nK + 1; i++) {
+                stats[i] += std::exchange(subStats[tid][i], SimResultStats{});
+            }
+            for (std::size_t i = 0; i != nK; i++) {
+                diffStats[i] += std::exchange(subDiffStats[tid][i], SimResultStats{});
+            }
+        }
+    }, [&]() {
+        // Stops once the differences of all the k's are precise enough
+        return rs::all_of(diffStats, [&](const SimResultStats& d) {
+            return precision.satisfiedBy(d.mean, d.halfWidth(z));
+        });
+    });
+
+    auto res = std::vector<SimResult>{};
+    for (std::size_t i = 0; i != nK; i++) {
+        auto& item = res.emplace_back(stats[i + 1].mean, stats[0].mean);
+        item.sampleCount = diffStats[i].count;
+        item.confidence = precision.confidence;
+        item.diffHalfWidth = diffStats[i].halfWidth(z);
+    }
+    return res;
+}
+
+/*!
+ * @brief Estimates the results with and without given boosted nodes by PRR-sketches, with multi-threading support.
+ *
+ * Instead of forward simulation over the whole graph, T PRR-sketches are sampled
+ * with uniformly random centers, independently of the ones used for boosted node selection.
+ * For each PRR-sketch, the state of its center is evaluated without boosted nodes
+ * and with each prefix of the boosted nodes, see calculateCenterStateBoosted for details.
+ * Each result is the average over sketches scaled by |V|, which is an unbiased estimation
+ * of the simulation result, while the cost of each sample scales with the sketch size
+ * rather than the size of the whole cascade.
+ * Like simulatePaired, all the K's share the same sketches, thus the differences are paired per sketch.
+ *
+ * Assumes that the boosted nodes are sorted by descending order of influence.
+ * For each K, only the first min{K, Total} boosted nodes are used.
+ *
+ * @param graph The whole graph
+ * @param seeds The seed set
+ * @param stateCtx The node state priority and gain
+ * @param boostedNodes The list of boosted nodes
+ * @param kList The list of K's
+ * @param nSketches T, How many PRR-sketches to sample at most
+ * @param nThreads How many threads used for sampling
+ * @param precision The precision target, checked with the confidence intervals of differences. Disabled by default
+ * @param progress Progress counter incremented per sketch, or nullptr if not reported
+ * @return A list of estimated results for each K, with boosted nodes, without boosted nodes, and their difference
+ */
+template <rs::range NodeRange, rs::sized_range KRange>
+std::vector<SimResult> simulateBySketches(
+        const IMMGraph&         graph,
+        const SeedSet&          seeds,
+        const NodeStateContext& stateCtx,
+        NodeRange&&             boostedNodes,
+        KRange&&                kList,
+        std::size_t             nSketches,
+        std::size_t             nThreads = 1,
+        const SimPrecision&     precision = {},
+        ProgressCounter*        progress = nullptr)
+        requires (std::convertible_to<rs::range_value_t<NodeRange>, std::size_t>)
+        && (std::convertible_to<rs::range_value_t<KRange>, std::size_t>)
+{
+    auto n = graph.nNodes();
+    auto nK = rs::size(kList);
+    auto z = precision.z();
+
+    // boostedRank[v] = position of v in the boosted node list, or +inf if v is not boosted
+    auto boostedRank = std::vector<std::size_t>(n, utils::halfMax<std::size_t>);
+    for (std::size_t i = 0; auto v: boostedNodes) {
+        boostedRank[v] = std::min(boostedRank[v], i++);
+    }
+
+    // Reuses link state objects and PRR-sketch objects for each thread
+    auto linkStatesPool = std::vector<IMMLinkStateSamples>{};
+    auto prrGraphPool = std::vector<PRRGraph>{};
+    for (std::size_t i = 0; i < nThreads; i++) {
+        linkStatesPool.emplace_back(graph.nLinks());
+        prrGraphPool.push_back(PRRGraph{{{"maxIndex", n}}});
+    }
+    // Statistics of each thread in current batch, see simulatePaired for details
+    auto subStats = std::vector<std::vector<SimResultStats>>(nThreads, std::vector<SimResultStats>(nK + 1));
+    auto subDiffStats = std::vector<std::vector<SimResultStats>>(nThreads, std::vector<SimResultStats>(nK));
+    auto stats = std::vector<SimResultStats>(nK + 1);
+    auto diffStats = std::vector<SimResultStats>(nK);
+
+    runSimulationBatches(nSketches, precision, [&](std::size_t batchSize) {
+        parallelForIndex(nThreads, batchSize, [&](std::size_t tid, std::size_t) {
+            // Uniformly generates a center node in [0, n), with the random generator of each worker
+            auto center = std::uniform_int_distribution<std::size_t>(0, n - 1)(threadLocalMT19937Generator());
+            auto& prrGraph = prrGraphPool[tid];
+            samplePRRSketch(graph, linkStatesPool[tid], prrGraph, seeds, stateCtx, center);
+
+            auto base = SimResultItem{};
+            base.add(prrGraph.centerState, stateCtx);
+            subStats[tid][0].add(base);
+
+            // Boosted nodes outside the PRR-sketch never change the center state
+            auto minRank = rs::min(prrGraph.nodes() | vs::transform([&](const PRRNode& node) {
+                return boostedRank[node.index()];
+            }));
+            for (std::size_t i = 0; auto k: kList) {
+                auto cur = SimResultItem{};
+                cur.add(k <= minRank ? prrGraph.centerState
+                                     : calculateCenterStateBoosted(prrGraph, seeds, stateCtx, boostedRank, k),
+                        stateCtx);
+                subStats[tid][i + 1].add(cur);
+                subDiffStats[tid][i].add(cur - base);
+                i += 1;
+            }
+            if (progress != nullptr) {
+                progress->increment();
+            }
+        });
+
+        for (std::size_t tid = 0; tid != nThreads; tid++) {
+            for (std::size_t i = 0; i != nK + 1; i++) {
+                stats[i] += std::exchange(subStats[tid][i], SimResultStats{});
+            }
+            for (std::size_t i = 0; i != nK; i++) {
+                diffStats[i] += std::exchange(subDiffStats[tid][i], SimResultStats{});
+            }
+        }
+    }, [&]() {
+        // Relative error is invariant to scaling by |V|
+        return rs::all_of(diffStats, [&](const SimResultStats& d) {
+            return precision.satisfiedBy(d.mean, d.halfWidth(z));
+        });
+    });
+
+    auto res = std::vector<SimResult>{};
+    for (std::size_t i = 0; i != nK; i++) {
+        auto& item = res.emplace_back(stats[i + 1].mean * (double)n, stats[0].mean * (double)n);
+        item.sampleCount = diffStats[i].count;
+        item.confidence = precision.confidence;
+        item.diffHalfWidth = diffStats[i].halfWidth(z) * (double)n;
     }
     return res;
 }
@@ -0,0 +1,146 @@
+//
+// Created by Onlynagesha on 2022/5/30.
+//
+
+#ifndef DAWNSEEKER_SKETCHCACHE_H
+#define DAWNSEEKER_SKETCHCACHE_H
+
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include "greedyselect.h"
+
+/*!
+ * @brief LRU cache of PR-IMM PRR-sketch collections, kept warm among the queries in service mode.
+ *
+ * PRR-sketches depend only on the graph, the seed set and the node state priority, thus entries are keyed by
+ * (seed set, priority), and a follow-up query with another k reuses them without sampling again.
+ * The total gains stored in a collection depend on lambda as well,
+ * which are recomputed when reused with another lambda (see PRRGraphCollection::recomputeGains).
+ *
+ * All the PRR-sketches of an entry are used once it's taken, thus an entry is taken only by the queries
+ * whose sample sizes are no less than its count, so that each sample size is answered with exactly its own count.
+ *
+ * Entries are evicted from the least recently used one once their total bytes exceed the capacity.
+ */
+class SketchCache {
+public:
+    struct Entry {
+        PRRGraphCollection  collection;
+        // Number of PRR-sketches sampled, including the empty ones skipped by the collection
+        std::uint64_t       prrCount{};
+        // Lambda with which the total gains of the collection are computed
+        double              lambda{};
+    };
+
+    /*!
+     * @brief Constructs with the capacity.
+     * @param capacity Capacity of all the collections in bytes, estimated by PRRGraphCollection::totalBytesUsed
+     */
+    explicit SketchCache(std::size_t capacity): capacity(capacity) {}
+
+    /*!
+     * @brief Takes the entry out of the cache, so that the caller can append PRR-sketches to it.
+     *
+     * The entry should be put back via put() afterwards.
+     * An entry computed with another lambda is taken only if the gains can be recomputed,
+     * i.e. both lambdas are in (0, 1) where the sign of each gain difference is unchanged.
+     * An entry with more than maxCount PRR-sketches is not taken, and kept in the cache.
+     *
+     * @param seeds The seed set
+     * @param priority The node state priority
+     * @param lambda Lambda of the query
+     * @param maxCount The smallest sample size of the query
+     * @return The entry, or std::nullopt if missing.
+     */
+    std::optional<Entry> take(const SeedSet& seeds, const NodeStatePriorityArray& priority, double lambda,
+                              std::uint64_t maxCount) {
+        auto lock = std::scoped_lock(mtx);
+        auto it = index.find(makeKey(seeds, priority));
+        auto reusable = [&](const Entry& cached) {
+            return cached.prrCount <= maxCount
+                   && (cached.lambda == lambda
+                       || (0.0 < cached.lambda && cached.lambda < 1.0 && 0.0 < lambda && lambda < 1.0));
+        };
+        if (it == index.end() || !reusable(it->second->second)) {
+            nMisses += 1;
+            return std::nullopt;
+        }
+        nHits += 1;
+        auto res = std::move(it->second->second);
+        totalBytes -= res.collection.totalBytesUsed();
+        entries.erase(it->second);
+        index.erase(it);
+        return res;
+    }
+
+    /*!
+     * @brief Puts an entry as the most recently used one, replacing the existing one with the same key
+     *        unless the existing one has more PRR-sketches.
+     *
+     * The least recently used entries are evicted if the capacity is exceeded.
+     * An entry larger than the capacity is not kept.
+     *
+     * @param seeds The seed set
+     * @param priority The node state priority
+     * @param entry The entry
+     */
+    void put(const SeedSet& seeds, const NodeStatePriorityArray& priority, Entry entry) {
+        auto lock = std::scoped_lock(mtx);
+        auto key = makeKey(seeds, priority);
+        if (auto it = index.find(key); it != index.end()) {
+            if (it->second->second.prrCount > entry.prrCount) {
+                // Keeps the larger one as the most recently used
+                entries.splice(entries.begin(), entries, it->second);
+                return;
+            }
+            totalBytes -= it->second->second.collection.totalBytesUsed();
+            entries.erase(it->second);
+            index.erase(it);
+        }
+        auto bytes = entry.collection.totalBytesUsed();
+        if (bytes > capacity) {
+            LOG_INFO(format("Sketch cache: entry of {} is larger than the capacity {}, thus not kept",
+                            totalBytesUsedToString(bytes), totalBytesUsedToString(capacity)));
+            return;
+        }
+        entries.emplace_front(key, std::move(entry));
+        index[std::move(key)] = entries.begin();
+        totalBytes += bytes;
+
+        for (; totalBytes > capacity; nEvictions++) {
+            auto& [lruKey, lru] = entries.back();
+            LOG_INFO(format("Sketch cache: evicts the entry with {} PRR-sketches", lru.prrCount));
+            totalBytes -= lru.collection.totalBytesUsed();
+            index.erase(lruKey);
+            entries.pop_back();
+        }
+    }
+
+    /*!
+     * @brief Dumps the statistics as a JSON object in a single line.
+     */
+    [[nodiscard]] std::string statsToJson() const {
+        auto lock = std::scoped_lock(mtx);
+        return format("{{ \"entries\": {}, \"bytes\": {}, \"capacity\": {}, \"hits\": {}, \"misses\": {}, "
+                      "\"evictions\": {} }}", entries.size(), totalBytes, capacity, nHits, nMisses, nEvictions);
+    }
+
+private:
+    static std::string makeKey(const SeedSet& seeds, const NodeStatePriorityArray& priority) {
+        return format("{}|{}|{}", join(seeds.Sa(), ","), join(seeds.Sr(), ","), join(priority, ","));
+    }
+
+    mutable std::mutex  mtx;
+    std::size_t         capacity;
+    std::size_t         totalBytes = 0;
+    std::uint64_t       nHits = 0;
+    std::uint64_t       nMisses = 0;
+    std::uint64_t       nEvictions = 0;
+    // From the most recently used one to the least
+    std::list<std::pair<std::string, Entry>>    entries;
+    std::unordered_map<std::string, decltype(entries)::iterator> index;
+};
+
+#endif //DAWNSEEKER_SKETCHCACHE_H
@@ -5,39 +5,298 @@
 #ifndef DAWNSEEKER_GRAPH_THREAD_H
 #define DAWNSEEKER_GRAPH_THREAD_H
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <ranges>
 #include <thread>
+#include <utility>
+#include <vector>
+#include "memory.h"
+#include "metrics.h"
+#include "trace.h"
 
-template <class FuncRange, class Arg1Range, class... Args>
-inline void runTaskGroup(FuncRange&& funcRange, Arg1Range&& arg1Range, Args&&... restArgs) {
-    using FuncType = std::ranges::range_value_t<FuncRange>;
-    using Arg1Type = std::ranges::range_value_t<Arg1Range>;
+/*!
+ * @brief Accounting context of a thread, i.e. its memory subsystem, memory account and metrics registry,
+ *        captured on construction and passed on to the threads working for it.
+ */
+struct ThreadContext {
+    memory::Subsystem   subsystem = memory::currentSubsystem();
+    memory::AccountTag  account = memory::currentAccount();
+    metrics::Registry*  registry = metrics::Registry::threadRegistry();
+};
 
-    auto argMutex  = std::mutex{};
-    auto iter      = std::ranges::begin(arg1Range);
-    auto endIter   = std::ranges::end(arg1Range);
+/*!
+ * @brief Applies a thread context to the calling thread during its lifetime.
+ */
+class ScopedThreadContext {
+public:
+    explicit ScopedThreadContext(const ThreadContext& ctx):
+    subsystem(ctx.subsystem), account(ctx.account), registry(ctx.registry) {}
 
-    auto threads = std::vector<std::thread>{};
-    for (auto&& func: funcRange) {
-        threads.emplace_back([&](auto&& func) {
-            auto arg1 = Arg1Type{};
+    ScopedThreadContext(const ScopedThreadContext&) = delete;
 
-            while (true) {
-                {
-                    auto lock = std::scoped_lock(argMutex);
-                    if (iter == endIter) {
+private:
+    memory::ScopedSubsystem     subsystem;
+    memory::ScopedAccount       account;
+    metrics::ScopedRegistry     registry;
+};
+
+/*!
+ * @brief Process-wide persistent thread pool.
+ *
+ * Threads are created on demand and kept alive until the program exits,
+ * thus no thread is created or joined per parallel call.
+ *
+ * Each parallel call runs with nWorkers workers: the calling thread itself as worker #0,
+ * and nWorkers - 1 pool threads as worker #1 ... #(nWorkers - 1).
+ * Worker id is passed to the task function so that per-worker contexts can be indexed by it.
+ *
+ * Parallel calls from different external threads (e.g. concurrent queries) run concurrently:
+ * each call is a job reserving nWorkers - 1 pool threads of its own, which are created if not enough,
+ * and idle pool threads join the pending jobs in the order of submission.
+ * Thus concurrent calls with n1, n2, ... workers keep up to (n1 - 1) + (n2 - 1) + ... pool threads busy,
+ * and the callers are responsible for splitting their thread budget.
+ * Slots not taken by any pool thread yet when the calling thread finishes the items are given up.
+ *
+ * Items are distributed without any lock: each worker owns a contiguous block of item indices
+ * and claims chunks from its front with an atomic counter.
+ * Once its own block is exhausted, it steals chunks from the blocks of the other workers the same way.
+ *
+ * Nested parallel calls (i.e. from inside a task) run serially in the calling worker as worker #0.
+ *
+ * Pool threads work in the context of the calling thread (see ThreadContext) during a call,
+ * thus their allocations and metrics are attributed to the subsystem, account and registry of the caller.
+ */
+class ThreadPool {
+public:
+    // How many chunks each block is split into, larger for better load balance
+    static constexpr std::size_t chunksPerWorker = 8;
+
+    /*!
+     * @brief Gets the process-wide thread pool.
+     */
+    static ThreadPool& global() {
+        static auto pool = ThreadPool{};
+        return pool;
+    }
+
+    ThreadPool() = default;
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator = (const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            auto lock = std::scoped_lock(mtx);
+            stopping = true;
+        }
+        jobCond.notify_all();
+        for (auto& t: threads) {
+            t.join();
+        }
+    }
+
+    /*!
+     * @brief Number of threads in the pool currently, excluding the calling thread.
+     */
+    [[nodiscard]] std::size_t nThreads() const {
+        return threads.size();
+    }
+
+    /*!
+     * @brief Runs func(workerId, i) for each i in [0, nItems) with nWorkers workers.
+     *
+     * Returns after all the items are done.
+     * If any task throws, the first exception is re-thrown to the caller after all the workers stop.
+     *
+     * @param nWorkers Number of workers, the calling thread included
+     * @param nItems Number of items
+     * @param func Task function func(workerId, i) where workerId in [0, nWorkers)
+     */
+    template <class Func>
+    void forEachIndex(std::size_t nWorkers, std::size_t nItems, Func&& func) {
+        nWorkers = std::max<std::size_t>(1, std::min(nWorkers, nItems));
+        if (nItems == 0) {
+            return;
+        }
+        if (nWorkers == 1 || insideTask()) {
+            auto guard = TaskGuard{};
+            for (std::size_t i = 0; i != nItems; i++) {
+                func(std::size_t{0}, i);
+            }
+            return;
+        }
+
+        auto chunk = std::max<std::size_t>(1, nItems / (nWorkers * chunksPerWorker));
+        auto blocks = std::make_unique<Block[]>(nWorkers);
+        for (std::size_t w = 0; w != nWorkers; w++) {
+            blocks[w].next = nItems * w / nWorkers;
+            blocks[w].end = nItems * (w + 1) / nWorkers;
+        }
+
+        auto errorMutex = std::mutex{};
+        auto error = std::exception_ptr{};
+        auto failed = std::atomic<bool>{false};
+
+        run(nWorkers, [&](std::size_t workerId) {
+            // Own block first, and then steals from others
+            for (std::size_t k = 0; k != nWorkers && !failed.load(std::memory_order_relaxed); k++) {
+                auto& block = blocks[(workerId + k) % nWorkers];
+                while (!failed.load(std::memory_order_relaxed)) {
+                    auto first = block.next.fetch_add(chunk, std::memory_order_relaxed);
+                    if (first >= block.end) {
                         break;
                     }
-                    arg1 = *iter++;
+                    try {
+                        for (auto i = first, last = std::min(first + chunk, block.end); i != last; i++) {
+                            func(workerId, i);
+                        }
+                    } catch (...) {
+                        auto lock = std::scoped_lock(errorMutex);
+                        if (!error) {
+                            error = std::current_exception();
+                        }
+                        failed = true;
+                    }
                 }
-                func(arg1, restArgs...);
             }
-        }, std::forward<FuncType>(func));
+        });
+        if (error) {
+            std::rethrow_exception(error);
+        }
     }
-    for (auto& t: threads) {
-        t.join();
+
+    /*!
+     * @brief Runs func(workerId, item) for each item in the range with nWorkers workers.
+     *
+     * See forEachIndex for details.
+     *
+     * @param nWorkers Number of workers, the calling thread included
+     * @param items A random access range of items
+     * @param func Task function func(workerId, item) where workerId in [0, nWorkers)
+     */
+    template <std::ranges::random_access_range Range, class Func>
+    void forEach(std::size_t nWorkers, Range&& items, Func&& func) {
+        auto first = std::ranges::begin(items);
+        forEachIndex(nWorkers, std::ranges::size(items), [&](std::size_t workerId, std::size_t i) {
+            func(workerId, first[i]);
+        });
     }
+
+private:
+    // A contiguous block of item indices [next, end), cache-line aligned to avoid false sharing
+    struct alignas(64) Block {
+        std::atomic<std::size_t>    next;
+        std::size_t                 end;
+    };
+
+    // Marks the current thread as running a task during its lifetime
+    struct TaskGuard {
+        bool old = std::exchange(insideTask(), true);
+        ~TaskGuard() {
+            insideTask() = old;
+        }
+    };
+
+    static bool& insideTask() {
+        thread_local bool flag = false;
+        return flag;
+    }
+
+    // A parallel call, whose nSlots = nWorkers - 1 worker slots are taken by pool threads
+    struct Job {
+        const std::function<void(std::size_t)>*     func;
+        ThreadContext                               context;
+        std::size_t                                 nSlots;
+        // Number of pool threads that have joined (as worker #1 ... #nJoined), and that are still running
+        std::size_t                                 nJoined = 0;
+        std::size_t                                 nRunning = 0;
+    };
+
+    // Runs func(workerId) on the calling thread as #0 and up to nWorkers - 1 pool threads
+    void run(std::size_t nWorkers, const std::function<void(std::size_t)>& func) {
+        auto job = Job{.func = &func, .context = ThreadContext{}, .nSlots = nWorkers - 1};
+        {
+            auto lock = std::scoped_lock(mtx);
+            // Each pending or running job has its own pool threads
+            nReserved += job.nSlots;
+            while (threads.size() < nReserved) {
+                threads.emplace_back([this, threadId = threads.size() + 1]() { workerLoop(threadId); });
+            }
+            pendingJobs.push_back(&job);
+        }
+        jobCond.notify_all();
+        {
+            auto guard = TaskGuard{};
+            func(0);
+        }
+        auto event = trace::ScopedEvent("waitWorkers");
+        auto lock = std::unique_lock(mtx);
+        // Slots not taken yet are given up, since all the items have been done once the calling thread returns
+        std::erase(pendingJobs, &job);
+        nReserved -= job.nSlots;
+        doneCond.wait(lock, [&]() { return job.nRunning == 0; });
+    }
+
+    void workerLoop(std::size_t threadId) {
+        trace::setThreadName(format("pool thread #{}", threadId));
+        for (auto lock = std::unique_lock(mtx); ; ) {
+            jobCond.wait(lock, [&]() { return stopping || !pendingJobs.empty(); });
+            if (stopping) {
+                return;
+            }
+            // Takes a slot of the earliest pending job
+            auto* job = pendingJobs.front();
+            auto workerId = ++job->nJoined;
+            job->nRunning += 1;
+            if (job->nJoined == job->nSlots) {
+                pendingJobs.pop_front();
+            }
+            lock.unlock();
+            {
+                auto guard = TaskGuard{};
+                auto scope = ScopedThreadContext(job->context);
+                (*job->func)(workerId);
+            }
+            lock.lock();
+            if (--job->nRunning == 0) {
+                doneCond.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread>    threads;
+    std::mutex                  mtx;
+    std::condition_variable     jobCond;
+    std::condition_variable     doneCond;
+    // Jobs with free slots, in the order of submission
+    std::deque<Job*>            pendingJobs;
+    // Total slots of the jobs submitted and not finished
+    std::size_t                 nReserved = 0;
+    bool                        stopping = false;
+};
+
+/*!
+ * @brief Runs func(workerId, i) for each i in [0, nItems) with the process-wide thread pool.
+ * See ThreadPool::forEachIndex for details.
+ */
+template <class Func>
+inline void parallelForIndex(std::size_t nWorkers, std::size_t nItems, Func&& func) {
+    ThreadPool::global().forEachIndex(nWorkers, nItems, std::forward<Func>(func));
+}
+
+/*!
+ * @brief Runs func(workerId, item) for each item in the range with the process-wide thread pool.
+ * See ThreadPool::forEach for details.
+ */
+template <std::ranges::random_access_range Range, class Func>
+inline void parallelForEach(std::size_t nWorkers, Range&& items, Func&& func) {
+    ThreadPool::global().forEach(nWorkers, std::forward<Range>(items), std::forward<Func>(func));
 }
 
 #endif //DAWNSEEKER_GRAPH_THREAD_H
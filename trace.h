@@ -0,0 +1,206 @@
+//
+// Created by Onlynagesha on 2022/5/28.
+//
+
+#ifndef DAWNSEEKER_TRACE_H
+#define DAWNSEEKER_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "global.h"
+#include "metrics.h"
+#include "utils/perthread.h"
+
+/*!
+ * @brief Optional lightweight tracer of worker activity, dumped as Chrome / Perfetto trace-event JSON.
+ *
+ * Each thread records complete events (name, start, duration) of its scopes to its own ring buffer,
+ * registered on its first event after the tracer is enabled and grown as needed.
+ * Once a buffer is full, the oldest events are overwritten.
+ * Nothing is recorded (and only a relaxed load is taken per scope) if the tracer is disabled.
+ *
+ * The trace is dumped after the run when all the workers are idle,
+ * and can be opened with chrome://tracing or https://ui.perfetto.dev.
+ */
+namespace trace {
+    // Capacity of the ring buffer of each thread, 6 MebiBytes at most per thread
+    constexpr std::size_t eventsPerThread = std::size_t{1} << 18;
+
+    struct Event {
+        // Name of the scope, which must be a string literal
+        const char*     name;
+        // Start time and duration in nanoseconds, since the program starts
+        std::uint64_t   start;
+        std::uint64_t   duration;
+    };
+
+    /*!
+     * @brief Ring buffer of a thread, written only by its owner thread.
+     */
+    struct ThreadBuffer {
+        std::string                 threadName;
+        std::vector<Event>          events;
+        // Total number of events recorded, the last min(count, eventsPerThread) of which are kept
+        std::atomic<std::uint64_t>  count = 0;
+
+        void push(const Event& e) {
+            auto n = count.load(std::memory_order_relaxed);
+            if (n < eventsPerThread) {
+                events.push_back(e);
+            } else {
+                events[n % eventsPerThread] = e;
+            }
+            count.store(n + 1, std::memory_order_release);
+        }
+    };
+
+    struct DumpResult {
+        // Whether the file is written successfully
+        bool            ok;
+        // Number of events written
+        std::uint64_t   nWritten;
+        // Number of events dropped, i.e. overwritten in the ring buffers
+        std::uint64_t   nDropped;
+    };
+
+    class Tracer {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /*!
+         * @brief Gets the process-wide tracer.
+         */
+        static Tracer& global() {
+            static auto tracer = Tracer{};
+            return tracer;
+        }
+
+        void enable() {
+            enabled_.store(true, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] bool enabled() const {
+            return enabled_.load(std::memory_order_relaxed);
+        }
+
+        /*!
+         * @brief Gets the nanoseconds since the program starts.
+         */
+        static std::uint64_t now() {
+            return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    Clock::now() - startTime).count();
+        }
+
+        /*!
+         * @brief Sets the name of the calling thread shown in the trace.
+         */
+        static void setThreadName(std::string name) {
+            localName() = std::move(name);
+        }
+
+        /*!
+         * @brief Records an event to the buffer of the calling thread.
+         */
+        void record(const Event& e) {
+            buffers.local([&](ThreadBuffer& buffer) {
+                buffer.threadName = localName().empty()
+                        ? format("thread #{}", buffers.blocks().size() - 1) : localName();
+            }).push(e);
+        }
+
+        /*!
+         * @brief Writes all the events kept in the buffers as trace-event JSON.
+         *
+         * All the threads should be idle during dumping.
+         *
+         * @param path Path of the output file
+         */
+        DumpResult dump(const std::string& path) {
+            auto lock = std::scoped_lock(mtx);
+            auto fout = std::ofstream(path);
+            fout << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+            auto first = true;
+            auto nWritten = std::uint64_t{0};
+            auto nDropped = std::uint64_t{0};
+            auto tid = std::size_t{0};
+            buffers.forEach([&](const ThreadBuffer& buffer) {
+                fout << (first ? "\n" : ",\n")
+                     << format(R"({{"name": "thread_name", "ph": "M", "pid": 1, "tid": {}, "args": {{"name": {}}}}})",
+                               tid, metrics::jsonString(buffer.threadName));
+                first = false;
+                auto count = buffer.count.load(std::memory_order_acquire);
+                auto from = count > eventsPerThread ? count - eventsPerThread : 0;
+                for (auto i = from; i != count; i++) {
+                    const auto& e = buffer.events[i % eventsPerThread];
+                    // Timestamps are in microseconds with fractions
+                    fout << format(",\n{{\"name\": {}, \"ph\": \"X\", \"pid\": 1, \"tid\": {}, "
+                                   "\"ts\": {:.3f}, \"dur\": {:.3f}}}",
+                                   metrics::jsonString(e.name), tid, 1e-3 * (double)e.start, 1e-3 * (double)e.duration);
+                }
+                nWritten += count - from;
+                nDropped += from;
+                tid += 1;
+            });
+            fout << "\n]}\n";
+            return {.ok = static_cast<bool>(fout), .nWritten = nWritten, .nDropped = nDropped};
+        }
+
+    private:
+        static std::string& localName() {
+            thread_local std::string name;
+            return name;
+        }
+
+        // Initialized before main() starts
+        static inline const Clock::time_point startTime = Clock::now();
+
+        std::atomic<bool>           enabled_ = false;
+        // Serializes dumping
+        std::mutex                              mtx;
+        utils::PerThreadBlocks<ThreadBuffer>    buffers;
+    };
+
+    inline void enable() {
+        Tracer::global().enable();
+    }
+
+    /*!
+     * @brief Sets the name of the calling thread shown in the trace.
+     */
+    inline void setThreadName(std::string name) {
+        Tracer::setThreadName(std::move(name));
+    }
+
+    /*!
+     * @brief Records the calling thread running a scope during its lifetime.
+     */
+    class ScopedEvent {
+    public:
+        explicit ScopedEvent(const char* name): name(name), start(Tracer::global().enabled() ? Tracer::now() : 0) {}
+
+        ScopedEvent(const ScopedEvent&) = delete;
+
+        ~ScopedEvent() {
+            if (start != 0) {
+                Tracer::global().record({.name = name, .start = start, .duration = Tracer::now() - start});
+            }
+        }
+
+    private:
+        const char*     name;
+        std::uint64_t   start;
+    };
+
+    /*!
+     * @brief Dumps the trace. See Tracer::dump for details.
+     */
+    inline DumpResult dump(const std::string& path) {
+        return Tracer::global().dump(path);
+    }
+}
+
+#endif //DAWNSEEKER_TRACE_H
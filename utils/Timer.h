@@ -8,7 +8,7 @@
 /*!
  * @file utils/Timer.h
  * @author DawnSeeker (onlynagesha@163.com)
- * @brief A lightweight timer based on system clock
+ * @brief A lightweight timer based on a monotonic clock, unaffected by system time adjustments
  */
 
 #include <chrono>
@@ -16,7 +16,7 @@
 namespace utils {
     struct Timer {
     public:
-        using Clock = std::chrono::system_clock;
+        using Clock = std::chrono::steady_clock;
         using TimePoint = Clock::time_point;
         // In seconds
         using Duration = std::chrono::duration<double>;
@@ -16,6 +16,7 @@
 #include "format.h"
 #include "misc.h"
 #include "numeric.h"
+#include "perthread.h"
 #include "random.h"
 #include "ranges.h"
 #include "string.h"
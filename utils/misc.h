@@ -21,8 +21,8 @@ namespace utils {
      *
      * `vec.capacity()`, instead of `vec.size()`, is used for the actual memory usage.
      *
-     * WARNING: Only nested std::vector<> is specially handled for type T.
-     * For other types, only sizeof(T) is counted.
+     * WARNING: Only nested std::vector<> and types with member function totalBytesUsed() (counting sizeof itself)
+     * are specially handled for type T. For other types, only sizeof(T) is counted.
      * This may produce inaccurate results for nested data structure type.
      *
      * e.g. For `std::vector<std::vector<int>>`, this function returns the true size
@@ -49,6 +49,11 @@ namespace utils {
             for (const auto& inner: vec) {
                 res += totalBytesUsed(inner);
             }
+        } else if constexpr (requires (const T& inner) { { inner.totalBytesUsed() } -> std::convertible_to<std::size_t>; }) {
+            res -= vec.size() * sizeof(T);
+            for (const auto& inner: vec) {
+                res += inner.totalBytesUsed();
+            }
         }
         return res;
     }
@@ -16,6 +16,7 @@
 #include <limits>
 #include <numeric>
 #include <stdexcept>
+#include <utility>
 
 namespace utils {
     /*!
@@ -57,6 +58,33 @@ namespace utils {
         return res;
     }
 
+    /*!
+     * @brief Quantile function (inverse CDF) of the standard normal distribution
+     *
+     * Solves $\Phi(x) = p$ by bisection where $\Phi(x) = \frac{1}{2} \mathrm{erfc}(-x / \sqrt{2})$,
+     * which is precise enough for computing confidence intervals.
+     *
+     * @param p Probability in (0, 1)
+     * @return x such that $\Phi(x) = p$
+     * @throws std::out_of_range if p is not in (0, 1)
+     */
+    inline double normalQuantile(double p) {
+        if (!(p > 0.0 && p < 1.0)) {
+            throw std::out_of_range("0 < p < 1 is not satisfied in normal quantile");
+        }
+        double lo = -40.0;
+        double hi = 40.0;
+        for (int i = 0; i < 128; i++) {
+            double mid = (lo + hi) / 2.0;
+            if (0.5 * std::erfc(-mid / std::sqrt(2.0)) < p) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        return (lo + hi) / 2.0;
+    }
+
     /*!
      * @brief Value-safe conversion of numbers (including integers and floating points) to specific type
      *
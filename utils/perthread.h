@@ -0,0 +1,120 @@
+//
+// Created by Onlynagesha on 2022/5/31.
+//
+
+#ifndef DAWNSEEKER_UTILS_PERTHREAD_H
+#define DAWNSEEKER_UTILS_PERTHREAD_H
+
+/*!
+ * @file utils/perthread.h
+ * @author DawnSeeker (onlynagesha@163.com)
+ * @brief Registry of per-thread blocks, each written by its owner thread and read by all
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace utils {
+    /*!
+     * @brief Per-thread blocks of type T, registered on the first access of each thread.
+     *
+     * Blocks are kept after their threads exit, so that readers still see what they have written.
+     * Addresses of the blocks are stable, since std::list never moves its elements.
+     * Each registry object has blocks of its own.
+     *
+     * Accessing the same registry as the previous access of the calling thread costs a comparison only.
+     * Otherwise, the block is looked up with the lock held.
+     *
+     * @tparam T Type of the blocks, which should be default-constructible
+     */
+    template <class T>
+    class PerThreadBlocks {
+    public:
+        PerThreadBlocks() = default;
+        PerThreadBlocks(const PerThreadBlocks&) = delete;
+        PerThreadBlocks& operator = (const PerThreadBlocks&) = delete;
+
+        /*!
+         * @brief Gets the block of the calling thread, with init(block) called once it's created.
+         *
+         * init is called with the lock held, thus it may read the other blocks via blocks().
+         */
+        template <class Init>
+        T& local(Init&& init) {
+            thread_local auto last = Cache{};
+            if (last.registryId != registryId) {
+                auto lock = std::scoped_lock(mtx);
+                auto [it, inserted] = index.try_emplace(threadSerial(), nullptr);
+                if (inserted) {
+                    it->second = &_blocks.emplace_back();
+                    init(*it->second);
+                }
+                last = {.registryId = registryId, .block = it->second};
+            }
+            return *last.block;
+        }
+
+        /*!
+         * @brief Gets the block of the calling thread, created by default if not yet.
+         */
+        T& local() {
+            return local([](T&) {});
+        }
+
+        /*!
+         * @brief Calls func(block) for each block in order of registration, with the lock held.
+         */
+        template <class Func>
+        void forEach(Func&& func) const {
+            auto lock = std::scoped_lock(mtx);
+            for (const auto& block: _blocks) {
+                func(block);
+            }
+        }
+
+        /*!
+         * @brief Calls func(block) for each block in order of registration, with the lock held.
+         */
+        template <class Func>
+        void forEach(Func&& func) {
+            auto lock = std::scoped_lock(mtx);
+            for (auto& block: _blocks) {
+                func(block);
+            }
+        }
+
+        /*!
+         * @brief Gets all the blocks, which should be accessed with the lock held, i.e. inside init of local().
+         */
+        [[nodiscard]] const std::list<T>& blocks() const {
+            return _blocks;
+        }
+
+    private:
+        // The registry accessed by the previous call of the calling thread, and the block of the thread in it
+        struct Cache {
+            std::uint64_t   registryId = 0;
+            T*              block = nullptr;
+        };
+
+        // Unique serial number of the calling thread. Unlike std::thread::id, it's never reused.
+        static std::uint64_t threadSerial() {
+            static constinit auto nextSerial = std::atomic<std::uint64_t>{0};
+            thread_local auto serial = nextSerial.fetch_add(1, std::memory_order_relaxed);
+            return serial;
+        }
+
+        static inline constinit auto nextRegistryId = std::atomic<std::uint64_t>{1};
+
+        // Unique id of the registry, so that a registry created at the address of a destroyed one is distinguished
+        std::uint64_t                               registryId = nextRegistryId.fetch_add(1);
+        mutable std::mutex                          mtx;
+        std::list<T>                                _blocks;
+        std::unordered_map<std::uint64_t, T*>       index;
+    };
+}
+
+#endif //DAWNSEEKER_UTILS_PERTHREAD_H
@@ -25,6 +25,18 @@ namespace utils {
     inline auto createMT19937Generator(unsigned initialSeed = 0) noexcept {
         return std::mt19937(initialSeed != 0 ? initialSeed : std::random_device()());
     }
+
+    /*!
+     * @brief Gets the std::mt19937 generator of the current thread, with a random-generated seed.
+     *
+     * Each thread has its own generator, thus it's safe to use without locking in multi-threading cases.
+     *
+     * @return Reference to the generator of the current thread
+     */
+    inline std::mt19937& threadLocalMT19937Generator() noexcept {
+        thread_local auto gen = createMT19937Generator();
+        return gen;
+    }
 }
 
 #endif //DAWNSEEKER_UTILS_RANDOM_H